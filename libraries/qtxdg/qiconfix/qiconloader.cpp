@@ -57,6 +57,17 @@
 #include <QtCore/QList>
 #include <QtCore/QHash>
 #include <QtCore/QDir>
+#include <QtCore/QFileInfo>
+#include <QtCore/QDateTime>
+#include <QtCore/QtAlgorithms>
+#include <QtCore/QtConcurrentRun>
+#include <QtGui/QImageReader>
+#include <QtGui/QWidget>
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QThread>
+#include <QtCore/QAtomicInt>
+#include <QtCore/QMutex>
+#include "../xdgdirs.h"
 #include <QtCore/QSettings>
 #include <QtGui/QPainter>
 #include <QtGui/QApplication>
@@ -73,11 +84,57 @@
 #if QT_VERSION < 0x040700
 #include <limits.h>
 #endif
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
 
 QT_BEGIN_NAMESPACE
 
 Q_GLOBAL_STATIC(QIconLoader, iconLoaderInstance)
 
+Q_GLOBAL_STATIC(QIconLoaderAsync, iconLoaderAsyncInstance)
+
+static QAtomicInt rasterWriteCount;
+
+// A raster file mapped by QIconRasterCache::find() and the image over it
+struct QIconRasterMapping
+{
+    QFile *file;
+    qint64 sourceMTime;
+    qint64 sourceSize;
+    QImage image;
+};
+
+struct QIconRasterMappings
+{
+    QMutex mutex;
+    QHash<QString, QIconRasterMapping> mappings;
+    QList<QFile *> retired;
+};
+
+Q_GLOBAL_STATIC(QIconRasterMappings, iconRasterMappings)
+
+#define QICONINDEX_CHECK_INTERVAL 5000
+#define QICONASYNC_DELIVER_DELAY 30
+
+#define QICONRASTER_MAGIC    0x51584952 // "QXIR"
+#define QICONRASTER_VERSION  1
+#define QICONRASTER_MAX_SIZE 256
+#define QICONRASTER_MAX_CACHE_BYTES (32 * 1024 * 1024)
+#define QICONRASTER_EXPIRE_INTERVAL 64 // Checks the size on every 64th raster written
+
+struct QIconRasterHeader
+{
+    quint32 magic;
+    quint32 version;
+    quint32 width;
+    quint32 height;
+    quint32 bytesPerLine;
+    quint32 reserved;
+    qint64 sourceMTime;
+    qint64 sourceSize;
+};
+
 /* Theme to use in last resort, if the theme does not have the icon, neither the parents  */
 /*static QString fallbackTheme()
 {
@@ -142,6 +199,22 @@ void QIconLoader::updateSystemTheme()
     }
 }
 
+/*
+ * The lookups answered from the caches of XdgIcon don't reach the indexes,
+ * so the caches call this before they are used.
+ */
+void QIconLoader::checkIndexes()
+{
+    QHash<QString, QIconTheme>::iterator it;
+    for (it = themeList.begin(); it != themeList.end(); ++it) {
+        if (it.value().index())
+            it.value().index()->checkForChanges();
+    }
+
+    if (m_pixmapsIndex)
+        m_pixmapsIndex->checkForChanges();
+}
+
 void QIconLoader::setThemeName(const QString &themeName)
 {
     m_userTheme = themeName;
@@ -249,6 +322,358 @@ QIconTheme::QIconTheme(const QString &themeName)
             m_parents.append(QLatin1String("hicolor"));
     }
 #endif //QT_NO_SETTINGS
+
+    if (m_valid)
+        m_index = new QIconThemeIndex(m_contentDirs, m_keyList);
+}
+
+
+static inline QString iconDirPath(const QString &contentDir, const QString &subDir)
+{
+    if (contentDir.isEmpty())
+        return subDir;
+    if (subDir.isEmpty())
+        return contentDir;
+    return contentDir + QLatin1Char('/') + subDir;
+}
+
+static uint iconDirMTime(const QString &path)
+{
+    QFileInfo info(path);
+    return info.exists() ? info.lastModified().toTime_t() : 0;
+}
+
+QIconThemeIndex::QIconThemeIndex(const QStringList &contentDirs, const QList<QIconDirInfo> &keyList)
+        : m_contentDirs(contentDirs), m_built(false)
+{
+    for (int i = 0; i < keyList.size(); ++i)
+        m_subDirs.append(keyList.at(i).path);
+}
+
+QString QIconThemeIndex::dirPath(int dirIndex, int contentDirIndex) const
+{
+    return iconDirPath(m_contentDirs.at(contentDirIndex), m_subDirs.at(dirIndex));
+}
+
+QString QIconThemeIndex::cachePath(int contentDirIndex) const
+{
+    const QString &contentDir = m_contentDirs.at(contentDirIndex);
+    if (contentDir.isEmpty())
+        return QString();
+    return contentDir + QLatin1String("/icon-theme.cache");
+}
+
+static bool indexEntryLessThan(const QIconIndexEntry &e1, const QIconIndexEntry &e2)
+{
+    if (e1.dirIndex != e2.dirIndex)
+        return e1.dirIndex < e2.dirIndex;
+    return e1.contentDirIndex < e2.contentDirIndex;
+}
+
+QVector<QIconIndexEntry> QIconThemeIndex::lookup(const QString &iconName)
+{
+    ensureUpToDate();
+    QVector<QIconIndexEntry> entries = m_entries.value(iconName);
+
+    bool cached = false;
+    for (int j = 0; j < m_caches.size(); ++j) {
+        if (!m_caches.at(j).isNull()) {
+            m_caches.at(j)->lookup(iconName, j, &entries);
+            cached = true;
+        }
+    }
+
+    if (cached)
+        qSort(entries.begin(), entries.end(), indexEntryLessThan);
+
+    return entries;
+}
+
+void QIconThemeIndex::ensureUpToDate()
+{
+    if (!m_built) {
+        rebuild();
+        return;
+    }
+
+    if (m_checked.elapsed() < QICONINDEX_CHECK_INTERVAL)
+        return;
+
+    m_checked.start();
+    for (int j = 0; j < m_contentDirs.size(); ++j) {
+        if (iconDirMTime(cachePath(j)) != m_cacheMTimes.at(j) ||
+            iconDirMTime(m_contentDirs.at(j)) != m_contentMTimes.at(j)) {
+            rebuild();
+            return;
+        }
+    }
+
+    int n = 0;
+    for (int i = 0; i < m_subDirs.size(); ++i) {
+        for (int j = 0; j < m_contentDirs.size(); ++j, ++n) {
+            if (m_caches.at(j).isNull() && iconDirMTime(dirPath(i, j)) != m_mtimes.at(n)) {
+                rebuild();
+                return;
+            }
+        }
+    }
+}
+
+void QIconThemeIndex::checkForChanges()
+{
+    if (m_built)
+        ensureUpToDate();
+}
+
+void QIconThemeIndex::rebuild()
+{
+    // The icons found in the old index may be gone or shadowed now
+    if (m_built)
+        iconLoaderInstance()->invalidateKey();
+
+    const QString svgext(QLatin1String(".svg"));
+    const QString pngext(QLatin1String(".png"));
+    const QString xpmext(QLatin1String(".xpm"));
+
+    m_entries.clear();
+    m_mtimes.clear();
+    m_mtimes.reserve(m_subDirs.size() * m_contentDirs.size());
+    m_contentMTimes.clear();
+    m_cacheMTimes.clear();
+    m_caches.clear();
+
+    // Like GTK does, the cache is used only if it's newer than the theme dir
+    for (int j = 0; j < m_contentDirs.size(); ++j) {
+        const QString cacheFile = cachePath(j);
+        uint cacheMTime = iconDirMTime(cacheFile);
+        uint contentMTime = iconDirMTime(m_contentDirs.at(j));
+        m_cacheMTimes.append(cacheMTime);
+        m_contentMTimes.append(contentMTime);
+
+        QSharedPointer<QIconCacheGtkReader> cache;
+        if (cacheMTime && cacheMTime >= contentMTime) {
+            cache = QSharedPointer<QIconCacheGtkReader>(new QIconCacheGtkReader(cacheFile, m_subDirs));
+            if (!cache->isValid())
+                cache.clear();
+        }
+        m_caches.append(cache);
+    }
+
+    for (int i = 0; i < m_subDirs.size(); ++i) {
+        for (int j = 0; j < m_contentDirs.size(); ++j) {
+            if (!m_caches.at(j).isNull()) {
+                m_mtimes.append(0);
+                continue;
+            }
+
+            QDir dir(dirPath(i, j));
+            m_mtimes.append(iconDirMTime(dir.path()));
+            if (!m_mtimes.last())
+                continue;
+
+            QHash<QString, uchar> found;
+            const QStringList files = dir.entryList(QDir::Files);
+            foreach (const QString &file, files) {
+                uchar ext;
+                if (file.endsWith(pngext))
+                    ext = QIconIndexEntry::Png;
+                else if (file.endsWith(svgext))
+                    ext = QIconIndexEntry::Svg;
+                else if (file.endsWith(xpmext))
+                    ext = QIconIndexEntry::Xpm;
+                else
+                    continue;
+
+                found[file.left(file.length() - 4)] |= ext;
+            }
+
+            QHash<QString, uchar>::const_iterator it;
+            for (it = found.constBegin(); it != found.constEnd(); ++it) {
+                QIconIndexEntry entry;
+                entry.dirIndex = i;
+                entry.contentDirIndex = j;
+                entry.extensions = it.value();
+                m_entries[it.key()].append(entry);
+            }
+        }
+    }
+
+    m_built = true;
+    m_checked.start();
+}
+
+/*
+ * The format of the file is described in the gtk+ docs/iconcache.txt, all
+ * numbers are big endian:
+ *   Header:    CARD16 major, CARD16 minor, CARD32 hash offset, CARD32 dir list offset
+ *   DirList:   CARD32 count, CARD32 dir name offset[count]
+ *   Hash:      CARD32 bucket count, CARD32 icon offset[bucket count]
+ *   Icon:      CARD32 chain offset, CARD32 name offset, CARD32 image list offset
+ *   ImageList: CARD32 count, Image[count]
+ *   Image:     CARD16 dir index, CARD16 flags, CARD32 image data offset
+ */
+#define GTK_CACHE_NONE       0xffffffff
+#define GTK_CACHE_HAS_XPM    0x1
+#define GTK_CACHE_HAS_SVG    0x2
+#define GTK_CACHE_HAS_PNG    0x4
+
+static quint32 gtkIconNameHash(const char *name)
+{
+    const signed char *p = reinterpret_cast<const signed char *>(name);
+    quint32 h = *p;
+    if (h)
+        for (p += 1; *p != '\0'; p++)
+            h = (h << 5) - h + *p;
+    return h;
+}
+
+QIconCacheGtkReader::QIconCacheGtkReader(const QString &fileName, const QStringList &subDirs)
+        : m_data(0), m_size(0), m_isValid(false)
+{
+    m_file.setFileName(fileName);
+    if (!m_file.open(QFile::ReadOnly))
+        return;
+
+    m_size = m_file.size();
+    m_data = m_file.map(0, m_size);
+    if (!m_data)
+        return;
+
+    m_isValid = true;
+    if (read16(0) != 1) { // major version
+        m_isValid = false;
+        return;
+    }
+
+    QHash<QString, int> subDirIndexes;
+    for (int i = 0; i < subDirs.size(); ++i)
+        subDirIndexes.insert(subDirs.at(i), i);
+
+    // The directories missing in the index.theme are ignored
+    const quint32 dirListOffset = read32(8);
+    const quint32 dirCount = read32(dirListOffset);
+    for (quint32 i = 0; i < dirCount && m_isValid; ++i) {
+        const char *dir = readString(read32(dirListOffset + 4 + 4 * i));
+        m_dirIndexes.append(dir ? subDirIndexes.value(QString::fromUtf8(dir), -1) : -1);
+    }
+}
+
+quint16 QIconCacheGtkReader::read16(uint offset) const
+{
+    if (m_size < 2 || offset > m_size - 2 || (offset & 0x1)) {
+        m_isValid = false;
+        return 0;
+    }
+    return m_data[offset] << 8 | m_data[offset + 1];
+}
+
+quint32 QIconCacheGtkReader::read32(uint offset) const
+{
+    if (m_size < 4 || offset > m_size - 4 || (offset & 0x3)) {
+        m_isValid = false;
+        return 0;
+    }
+    return m_data[offset] << 24 | m_data[offset + 1] << 16 | m_data[offset + 2] << 8 | m_data[offset + 3];
+}
+
+const char *QIconCacheGtkReader::readString(uint offset) const
+{
+    if (offset >= m_size || !memchr(m_data + offset, 0, m_size - offset)) {
+        m_isValid = false;
+        return 0;
+    }
+    return reinterpret_cast<const char *>(m_data + offset);
+}
+
+void QIconCacheGtkReader::lookup(const QString &iconName, int contentDirIndex,
+                                 QVector<QIconIndexEntry> *entries) const
+{
+    if (!m_isValid || iconName.isEmpty())
+        return;
+
+    const QByteArray name = iconName.toUtf8();
+    const quint32 hashOffset = read32(4);
+    const quint32 bucketCount = read32(hashOffset);
+    if (!m_isValid || !bucketCount)
+        return;
+
+    quint32 iconOffset = read32(hashOffset + 4 + 4 * (gtkIconNameHash(name.constData()) % bucketCount));
+
+    // The chain length is limited in case of a corrupted file
+    for (uint n = 0; iconOffset != GTK_CACHE_NONE && m_isValid && n < m_size / 12; ++n) {
+        const char *s = readString(read32(iconOffset + 4));
+        if (s && qstrcmp(s, name.constData()) == 0) {
+            const quint32 listOffset = read32(iconOffset + 8);
+            const quint32 count = read32(listOffset);
+            for (quint32 i = 0; i < count && m_isValid; ++i) {
+                const quint16 dir = read16(listOffset + 4 + 8 * i);
+                const quint16 flags = read16(listOffset + 4 + 8 * i + 2);
+                if (dir >= m_dirIndexes.size() || m_dirIndexes.at(dir) < 0)
+                    continue;
+
+                uchar ext = 0;
+                if (flags & GTK_CACHE_HAS_PNG)
+                    ext |= QIconIndexEntry::Png;
+                if (flags & GTK_CACHE_HAS_SVG)
+                    ext |= QIconIndexEntry::Svg;
+                if (flags & GTK_CACHE_HAS_XPM)
+                    ext |= QIconIndexEntry::Xpm;
+                if (!ext)
+                    continue;
+
+                QIconIndexEntry entry;
+                entry.dirIndex = m_dirIndexes.at(dir);
+                entry.contentDirIndex = contentDirIndex;
+                entry.extensions = ext;
+                entries->append(entry);
+            }
+            return;
+        }
+        iconOffset = read32(iconOffset);
+    }
+}
+
+// Only the first content dir having the icon is used for each subdir,
+// png files are preferred over svg and xpm ones.
+void QIconLoader::addIndexEntries(QThemeIconEntries &entries,
+                                  const QVector<QIconIndexEntry> &found,
+                                  const QStringList &contentDirs,
+                                  const QList<QIconDirInfo> &subDirs,
+                                  const QString &iconName) const
+{
+    int lastDir = -1;
+    for (int n = 0; n < found.size(); ++n) {
+        const QIconIndexEntry &hit = found.at(n);
+        if (hit.dirIndex == lastDir)
+            continue;
+
+        const QIconDirInfo &dirInfo = subDirs.at(hit.dirIndex);
+        const QString fileName = iconDirPath(contentDirs.at(hit.contentDirIndex), dirInfo.path) +
+                                 QLatin1Char('/') + iconName;
+
+        if (hit.extensions & QIconIndexEntry::Png) {
+            PixmapEntry *iconEntry = new PixmapEntry;
+            iconEntry->dir = dirInfo;
+            iconEntry->filename = fileName + QLatin1String(".png");
+            // Notice we ensure that pixmap entries always come before
+            // scalable to preserve search order afterwards
+            entries.prepend(iconEntry);
+        } else if (m_supportsSvg && (hit.extensions & QIconIndexEntry::Svg)) {
+            ScalableEntry *iconEntry = new ScalableEntry;
+            iconEntry->dir = dirInfo;
+            iconEntry->filename = fileName + QLatin1String(".svg");
+            entries.append(iconEntry);
+        } else if (hit.extensions & QIconIndexEntry::Xpm) {
+            PixmapEntry *iconEntry = new PixmapEntry;
+            iconEntry->dir = dirInfo;
+            iconEntry->filename = fileName + QLatin1String(".xpm");
+            entries.append(iconEntry);
+        } else {
+            continue;
+        }
+
+        lastDir = hit.dirIndex;
+    }
 }
 
 
@@ -273,53 +698,10 @@ QThemeIconEntries QIconLoader::findIconHelper(const QString &themeName,
         themeList.insert(themeName, theme);
     }
 
-    QStringList contentDirs = theme.contentDirs();
-    QList<QIconDirInfo> subDirs = theme.keyList();
-
-    const QString svgext(QLatin1String(".svg"));
-    const QString pngext(QLatin1String(".png"));
-    const QString xpmext(QLatin1String(".xpm"));
-
     // Add all relevant files
-    for (int i = 0; i < subDirs.size() ; ++i)
-    {
-        const QIconDirInfo &dirInfo = subDirs.at(i);
-        QString subdir = dirInfo.path;
-
-        foreach (QString contentDir, contentDirs)
-        {
-            QDir currentDir(contentDir + '/' + subdir);
-
-            if (currentDir.exists(iconName + pngext))
-            {
-                PixmapEntry *iconEntry = new PixmapEntry;
-                iconEntry->dir = dirInfo;
-                iconEntry->filename = currentDir.filePath(iconName + pngext);
-                // Notice we ensure that pixmap entries always come before
-                // scalable to preserve search order afterwards
-                entries.prepend(iconEntry);
-                break;
-            }
-            else if (m_supportsSvg &&
-                     currentDir.exists(iconName + svgext))
-            {
-                ScalableEntry *iconEntry = new ScalableEntry;
-                iconEntry->dir = dirInfo;
-                iconEntry->filename = currentDir.filePath(iconName + svgext);
-                entries.append(iconEntry);
-                break;
-            }
-            else if (currentDir.exists(iconName + xpmext))
-            {
-                PixmapEntry *iconEntry = new PixmapEntry;
-                iconEntry->dir = dirInfo;
-                iconEntry->filename = currentDir.filePath(iconName + xpmext);
-                // Notice we ensure that pixmap entries always come before
-                // scalable to preserve search order afterwards
-                entries.append(iconEntry);
-                break;
-            }
-        }
+    if (theme.index()) {
+        addIndexEntries(entries, theme.index()->lookup(iconName),
+                        theme.contentDirs(), theme.keyList(), iconName);
     }
 
     if (entries.isEmpty()) {
@@ -349,30 +731,16 @@ QThemeIconEntries QIconLoader::findIconHelper(const QString &themeName,
     /* Freedesktop standard says to look in /usr/share/pixmaps last */
     if (entries.isEmpty()) {
         const QString pixmaps(QLatin1String("/usr/share/pixmaps"));
+        QStringList pixmapsDirs;
+        pixmapsDirs << QString();
+        QList<QIconDirInfo> pixmapsKeys;
+        pixmapsKeys << QIconDirInfo(pixmaps);
 
-        QDir currentDir(pixmaps);
-        if (currentDir.exists(iconName + pngext)) {
-            PixmapEntry *iconEntry = new PixmapEntry;
-            iconEntry->dir = pixmaps;
-            iconEntry->filename = currentDir.filePath(iconName + pngext);
-            // Notice we ensure that pixmap entries allways come before
-            // scalable to preserve search order afterwards
-            entries.prepend(iconEntry);
-        } else if (m_supportsSvg &&
-                   currentDir.exists(iconName + svgext)) {
-            ScalableEntry *iconEntry = new ScalableEntry;
-            iconEntry->dir = pixmaps;
-            iconEntry->filename = currentDir.filePath(iconName + svgext);
-            entries.append(iconEntry);
-        } else if (currentDir.exists(iconName + xpmext)) {
-            PixmapEntry *iconEntry = new PixmapEntry;
-            iconEntry->dir = pixmaps;
-            iconEntry->filename = currentDir.filePath(iconName + xpmext);
-            // Notice we ensure that pixmap entries always come before
-            // scalable to preserve search order afterwards
-            entries.append(iconEntry);
-        }
+        if (!m_pixmapsIndex)
+            m_pixmapsIndex = new QIconThemeIndex(pixmapsDirs, pixmapsKeys);
 
+        addIndexEntries(entries, m_pixmapsIndex->lookup(iconName),
+                        pixmapsDirs, pixmapsKeys, iconName);
     }
 #endif
 
@@ -572,10 +940,328 @@ QSize QIconLoaderEngineFixed::actualSize(const QSize &size, QIcon::Mode mode,
     return QIconEngineV2::actualSize(size, mode, state);
 }
 
+QString QIconRasterCache::cacheDir()
+{
+    return XdgDirs::cacheHome(false) + QLatin1String("/qtxdg/icons");
+}
+
+QString QIconRasterCache::rasterFileName(const QString &fileName, const QSize &size)
+{
+    const QString key = QString("%1\n%2x%3").arg(fileName).arg(size.width()).arg(size.height());
+    const QByteArray hash = QCryptographicHash::hash(key.toUtf8(), QCryptographicHash::Md5);
+    return QString("%1/%2.argb").arg(cacheDir(), QString::fromLatin1(hash.toHex()));
+}
+
+// Thread safe, it's called from the async loader workers too. The raster isn't
+// read, the returned image is built over the mapped file and its pages are
+// shared with the other processes. The mapping is kept for the life of the
+// process: in Qt 4 the image and the pixmaps made from it can't tell when they
+// stop using the memory. The writers never change a raster file in place, they
+// rename a new one over it, so the mapped file never shrinks.
+QImage QIconRasterCache::find(const QString &fileName, const QSize &size)
+{
+    if (fileName.startsWith(QLatin1Char(':')))
+        return QImage();
+
+    const QFileInfo source(fileName);
+    if (!source.exists())
+        return QImage();
+
+    const qint64 sourceMTime = source.lastModified().toTime_t();
+    const qint64 sourceSize = source.size();
+    const QString rasterFile = rasterFileName(fileName, size);
+
+    QIconRasterMappings *mappings = iconRasterMappings();
+    QMutexLocker locker(&mappings->mutex);
+
+    QHash<QString, QIconRasterMapping>::const_iterator it = mappings->mappings.constFind(rasterFile);
+    if (it != mappings->mappings.constEnd() &&
+        it.value().sourceMTime == sourceMTime && it.value().sourceSize == sourceSize)
+        return it.value().image;
+
+    QFile *file = new QFile(rasterFile);
+    const qint64 fileSize = file->open(QFile::ReadOnly) ? file->size() : 0;
+    const uchar *data = fileSize >= (qint64)sizeof(QIconRasterHeader) ? file->map(0, fileSize) : 0;
+    // The mapping stays after the file is closed, it's removed with the QFile
+    file->close();
+
+    if (!data) {
+        delete file;
+        return QImage();
+    }
+
+    const QIconRasterHeader *header = reinterpret_cast<const QIconRasterHeader *>(data);
+    if (header->magic != QICONRASTER_MAGIC || header->version != QICONRASTER_VERSION ||
+        header->sourceMTime != sourceMTime || header->sourceSize != sourceSize ||
+        header->width > QICONRASTER_MAX_SIZE || header->height > QICONRASTER_MAX_SIZE ||
+        header->bytesPerLine != header->width * 4 ||
+        fileSize < (qint64)sizeof(QIconRasterHeader) + (qint64)header->bytesPerLine * header->height) {
+        delete file;
+        return QImage();
+    }
+
+    // The image is read only, a change would detach it from the mapping
+    QIconRasterMapping mapping;
+    mapping.file = file;
+    mapping.sourceMTime = sourceMTime;
+    mapping.sourceSize = sourceSize;
+    mapping.image = QImage(data + sizeof(QIconRasterHeader), header->width, header->height,
+                           header->bytesPerLine, QImage::Format_ARGB32_Premultiplied);
+
+    // The outdated mapping may still be used by the images handed out before
+    if (it != mappings->mappings.constEnd())
+        mappings->retired << it.value().file;
+
+    mappings->mappings.insert(rasterFile, mapping);
+    return mapping.image;
+}
+
+// The raster is written to a temporary file and renamed, so the other
+// processes never read a partially written one.
+void QIconRasterCache::insert(const QString &fileName, const QSize &size, const QImage &image)
+{
+    if (image.isNull() || fileName.startsWith(QLatin1Char(':')) ||
+        image.width() > QICONRASTER_MAX_SIZE || image.height() > QICONRASTER_MAX_SIZE)
+        return;
+
+    const QFileInfo source(fileName);
+    if (!source.exists())
+        return;
+
+    const QImage raster = image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+
+    QIconRasterHeader header;
+    header.magic = QICONRASTER_MAGIC;
+    header.version = QICONRASTER_VERSION;
+    header.width = raster.width();
+    header.height = raster.height();
+    header.bytesPerLine = raster.bytesPerLine();
+    header.reserved = 0;
+    header.sourceMTime = source.lastModified().toTime_t();
+    header.sourceSize = source.size();
+
+    const QString rasterFile = rasterFileName(fileName, size);
+    QDir().mkpath(QFileInfo(rasterFile).absolutePath());
+
+    const QString tmpFile = QString("%1.%2.%3").arg(rasterFile).arg(getpid())
+                                .arg(quintptr(QThread::currentThreadId()));
+    QFile file(tmpFile);
+    if (!file.open(QFile::WriteOnly | QFile::Truncate))
+        return;
+
+    bool ok = file.write(reinterpret_cast<const char *>(&header), sizeof(header)) == sizeof(header) &&
+              file.write(reinterpret_cast<const char *>(raster.bits()), raster.byteCount()) == raster.byteCount();
+    file.close();
+
+    if (!ok || ::rename(QFile::encodeName(tmpFile).constData(), QFile::encodeName(rasterFile).constData()) != 0)
+        QFile::remove(tmpFile);
+
+    // The first raster written by the process checks the size too
+    if (rasterWriteCount.fetchAndAddRelaxed(1) % QICONRASTER_EXPIRE_INTERVAL == 0)
+        expire();
+}
+
+// The file is written on a worker thread, the GUI thread only passes the image
+void QIconRasterCache::insertAsync(const QString &fileName, const QSize &size, const QImage &image)
+{
+    if (!image.isNull())
+        QtConcurrent::run(&QIconRasterCache::insert, fileName, size, image);
+}
+
+static bool rasterLessThan(const QFileInfo &a, const QFileInfo &b)
+{
+    return a.lastModified() < b.lastModified();
+}
+
+// Removes the oldest rasters until the directory takes 3/4 of the limit. The
+// rasters of the changed or removed icons are never read again, they go first.
+// Several processes may run it at once, removing a file twice is harmless.
+void QIconRasterCache::expire()
+{
+    QDir dir(cacheDir());
+    QFileInfoList files = dir.entryInfoList(QDir::Files | QDir::NoDotAndDotDot);
+
+    qint64 total = 0;
+    foreach (const QFileInfo &fi, files)
+        total += fi.size();
+
+    if (total <= QICONRASTER_MAX_CACHE_BYTES)
+        return;
+
+    qSort(files.begin(), files.end(), rasterLessThan);
+    const qint64 target = QICONRASTER_MAX_CACHE_BYTES / 4 * 3;
+    for (int i = 0; i < files.count() && total > target; ++i) {
+        if (dir.remove(files.at(i).fileName()))
+            total -= files.at(i).size();
+    }
+}
+
+static QPixmap iconModePixmap(const QString &baseKey, const QPixmap &basePixmap, QIcon::Mode mode)
+{
+    const QString key = QString("%1_%2_%3").arg(baseKey).arg(mode).arg(qApp->palette().cacheKey());
+    QPixmap pm;
+    if (!QPixmapCache::find(key, &pm)) {
+        QStyleOption opt(0);
+        opt.palette = qApp->palette();
+        pm = qApp->style()->generatedIconPixmap(mode, basePixmap, &opt);
+        QPixmapCache::insert(key, pm);
+    }
+    return pm;
+}
+
+// Returns a null pixmap if no other process has rasterized the icon yet
+static QPixmap sharedIconPixmap(const QString &fileName, const QSize &size, QIcon::Mode mode)
+{
+    const QString key = QString("$xdg_shared_%1_%2x%3").arg(fileName).arg(size.width()).arg(size.height());
+    QPixmap basePixmap;
+    if (!QPixmapCache::find(key, &basePixmap)) {
+        const QImage image = QIconRasterCache::find(fileName, size);
+        if (image.isNull())
+            return QPixmap();
+
+        basePixmap = QPixmap::fromImage(image);
+        QPixmapCache::insert(key, basePixmap);
+    }
+    return iconModePixmap(key, basePixmap, mode);
+}
+
+QIconLoaderAsync::QIconLoaderAsync()
+        : m_widget(0)
+{
+    m_deliverTimer.setSingleShot(true);
+    m_deliverTimer.setInterval(QICONASYNC_DELIVER_DELAY);
+    connect(&m_deliverTimer, SIGNAL(timeout()), this, SLOT(deliver()));
+}
+
+QIconLoaderAsync *QIconLoaderAsync::instance()
+{
+    return iconLoaderAsyncInstance();
+}
+
+QWidget *QIconLoaderAsync::setWidget(QWidget *widget)
+{
+    QWidget *prev = m_widget;
+    m_widget = widget;
+    return prev;
+}
+
+QPixmap QIconLoaderAsync::placeholder(const QSize &size) const
+{
+    QString key = QString("$xdg_async_placeholder_%1x%2").arg(size.width()).arg(size.height());
+    QPixmap pm;
+    if (!QPixmapCache::find(key, &pm)) {
+        pm = QPixmap(size);
+        pm.fill(Qt::transparent);
+        QPixmapCache::insert(key, pm);
+    }
+    return pm;
+}
+
+QPixmap QIconLoaderAsync::pixmap(const QString &fileName, const QSize &size, QIcon::Mode mode,
+                                 bool scalable, bool *failed)
+{
+    const QString key = QString("$xdg_async_%1_%2x%3").arg(fileName).arg(size.width()).arg(size.height());
+    if (m_failed.contains(key)) {
+        *failed = true;
+        return QPixmap();
+    }
+
+    // The pixmaps are created on the GUI thread
+    QHash<QString, QImage>::iterator it = m_ready.find(key);
+    if (it != m_ready.end()) {
+        QPixmapCache::insert(key, QPixmap::fromImage(it.value()));
+        m_ready.erase(it);
+    }
+
+    QPixmap basePixmap;
+    if (QPixmapCache::find(key, &basePixmap))
+        return iconModePixmap(key, basePixmap, mode);
+
+    QList<QPointer<QWidget> > &widgets = m_pending[key];
+    if (widgets.isEmpty())
+        QtConcurrent::run(&QIconLoaderAsync::decode, this, key, fileName, size, scalable);
+
+    if (!widgets.contains(m_widget))
+        widgets.append(m_widget);
+
+    return placeholder(size);
+}
+
+// Runs on the worker thread
+void QIconLoaderAsync::decode(QIconLoaderAsync *loader, const QString &key,
+                              const QString &fileName, const QSize &size, bool scalable)
+{
+    QImage image = QIconRasterCache::find(fileName, size);
+    if (!image.isNull()) {
+        QMetaObject::invokeMethod(loader, "imageReady", Qt::QueuedConnection,
+                                  Q_ARG(QString, key), Q_ARG(QImage, image));
+        return;
+    }
+
+    QImageReader reader(fileName);
+    if (scalable) {
+        QSize scaledSize = reader.size();
+        if (scaledSize.isValid())
+            scaledSize.scale(size, Qt::KeepAspectRatio);
+        else
+            scaledSize = size;
+        reader.setScaledSize(scaledSize);
+    }
+
+    image = reader.read();
+
+    // Never bigger than requested, see QTBUG-17953
+    if (!image.isNull() && (image.width() > size.width() || image.height() > size.height()))
+        image = image.scaled(size, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+
+    QIconRasterCache::insert(fileName, size, image);
+
+    QMetaObject::invokeMethod(loader, "imageReady", Qt::QueuedConnection,
+                              Q_ARG(QString, key), Q_ARG(QImage, image));
+}
+
+void QIconLoaderAsync::imageReady(const QString &key, const QImage &image)
+{
+    if (image.isNull())
+        m_failed.insert(key);
+    else
+        m_ready.insert(key, image);
+
+    m_toUpdate << m_pending.take(key);
+    if (!m_deliverTimer.isActive())
+        m_deliverTimer.start();
+}
+
+void QIconLoaderAsync::deliver()
+{
+    QSet<QWidget *> updated;
+    foreach (const QPointer<QWidget> &widget, m_toUpdate) {
+        if (widget && !updated.contains(widget)) {
+            updated.insert(widget);
+            widget->update();
+        }
+    }
+    m_toUpdate.clear();
+}
+
 QPixmap PixmapEntry::pixmap(const QSize &size, QIcon::Mode mode, QIcon::State state)
 {
     Q_UNUSED(state);
 
+    if (basePixmap.isNull() && QIconLoaderAsync::instance()->isActive()) {
+        bool failed = false;
+        QPixmap pm = QIconLoaderAsync::instance()->pixmap(filename, size, mode, false, &failed);
+        if (!failed)
+            return pm;
+    }
+
+    // Use the icon rasterized by another process
+    if (basePixmap.isNull()) {
+        QPixmap pm = sharedIconPixmap(filename, size, mode);
+        if (!pm.isNull())
+            return pm;
+    }
+
     // Ensure that basePixmap is lazily initialized before generating the
     // key, otherwise the cache key is not unique
     if (basePixmap.isNull())
@@ -600,6 +1286,11 @@ QPixmap PixmapEntry::pixmap(const QSize &size, QIcon::Mode mode, QIcon::State st
         if (basePixmap.size() != actualSize)
             basePixmap = basePixmap.scaled(actualSize, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
 
+        if (mode == QIcon::Normal && !sharedSizes.contains(size)) {
+            sharedSizes.append(size);
+            QIconRasterCache::insertAsync(filename, size, basePixmap.toImage());
+        }
+
         QStyleOption opt(0);
         opt.palette = qApp->palette();
         cachedPixmap = qApp->style()->generatedIconPixmap(mode, basePixmap, &opt);
@@ -610,11 +1301,29 @@ QPixmap PixmapEntry::pixmap(const QSize &size, QIcon::Mode mode, QIcon::State st
 
 QPixmap ScalableEntry::pixmap(const QSize &size, QIcon::Mode mode, QIcon::State state)
 {
-    if (svgIcon.isNull())
+    if (svgIcon.isNull() && QIconLoaderAsync::instance()->isActive()) {
+        bool failed = false;
+        QPixmap pm = QIconLoaderAsync::instance()->pixmap(filename, size, mode, true, &failed);
+        if (!failed)
+            return pm;
+    }
+
+    if (svgIcon.isNull()) {
+        // Use the icon rasterized by another process
+        QPixmap pm = sharedIconPixmap(filename, size, mode);
+        if (!pm.isNull())
+            return pm;
+
         svgIcon = QIcon(filename);
+    }
 
     // Simply reuse svg icon engine
-    return svgIcon.pixmap(size, mode, state);
+    QPixmap pm = svgIcon.pixmap(size, mode, state);
+    if (mode == QIcon::Normal && !sharedSizes.contains(size)) {
+        sharedSizes.append(size);
+        QIconRasterCache::insertAsync(filename, size, pm.toImage());
+    }
+    return pm;
 }
 
 QPixmap QIconLoaderEngineFixed::pixmap(const QSize &size, QIcon::Mode mode,
@@ -74,10 +74,20 @@
 //#include "qt/qicon_p.h"
 //#include "qt/qfactoryloader_p.h"
 #include <QtCore/QHash>
+#include <QtCore/QVector>
+#include <QtCore/QTime>
+#include <QtCore/QSharedData>
+#include <QtCore/QSharedPointer>
+#include <QtCore/QFile>
+#include <QtCore/QTimer>
+#include <QtCore/QPointer>
+#include <QtCore/QSet>
+#include <QtGui/QImage>
 
 QT_BEGIN_NAMESPACE
 
 class QIconLoader;
+class QWidget;
 
 struct QIconDirInfo
 {
@@ -106,6 +116,7 @@ public:
                            QIcon::State state) = 0;
     QString filename;
     QIconDirInfo dir;
+    QList<QSize> sharedSizes;
     static int count;
 };
 
@@ -150,6 +161,73 @@ private:
     friend class QIconLoader;
 };
 
+struct QIconIndexEntry
+{
+    enum Extension { Png = 0x1, Svg = 0x2, Xpm = 0x4 };
+    short dirIndex;         // index in the key list of the theme
+    short contentDirIndex;  // index in the content dirs of the theme
+    uchar extensions;
+};
+
+/*
+ * Reads the icon-theme.cache file generated by gtk-update-icon-cache. The file
+ * is mapped into memory, so a lookup doesn't make any syscalls.
+ */
+class QIconCacheGtkReader
+{
+public:
+    QIconCacheGtkReader(const QString &fileName, const QStringList &subDirs);
+    bool isValid() const { return m_isValid; }
+    void lookup(const QString &iconName, int contentDirIndex, QVector<QIconIndexEntry> *entries) const;
+
+private:
+    quint16 read16(uint offset) const;
+    quint32 read32(uint offset) const;
+    const char *readString(uint offset) const;
+
+    QFile m_file;
+    const uchar *m_data;
+    uint m_size;
+    QVector<int> m_dirIndexes;
+    mutable bool m_isValid;
+};
+
+/*
+ * The names of the icon files in all directories of the theme, so a lookup
+ * doesn't stat the files. The index is rebuilt when the mtime of any
+ * directory has changed, the mtimes are checked at most once per
+ * QICONINDEX_CHECK_INTERVAL. The content dirs having an icon-theme.cache
+ * newer than the dir itself are not listed, the cache is used instead.
+ * Rebuilding a built index invalidates the theme key of the loader, so the
+ * engines and the lookup caches of XdgIcon drop what they found before.
+ */
+class QIconThemeIndex : public QSharedData
+{
+public:
+    QIconThemeIndex(const QStringList &contentDirs, const QList<QIconDirInfo> &keyList);
+
+    // Entries are sorted by the dir index, then by the content dir index.
+    QVector<QIconIndexEntry> lookup(const QString &iconName);
+    // Rebuilds the index if it was built and its dirs have changed since.
+    void checkForChanges();
+
+private:
+    void ensureUpToDate();
+    void rebuild();
+    QString dirPath(int dirIndex, int contentDirIndex) const;
+    QString cachePath(int contentDirIndex) const;
+
+    QStringList m_contentDirs;
+    QStringList m_subDirs;
+    QVector<uint> m_mtimes;
+    QVector<uint> m_contentMTimes;
+    QVector<uint> m_cacheMTimes;
+    QList<QSharedPointer<QIconCacheGtkReader> > m_caches;
+    QHash<QString, QVector<QIconIndexEntry> > m_entries;
+    QTime m_checked;
+    bool m_built;
+};
+
 class QIconTheme
 {
 public:
@@ -160,6 +238,7 @@ public:
     QString contentDir() { return m_contentDir; }
     QStringList contentDirs() { return m_contentDirs; }
     bool isValid() { return m_valid; }
+    QIconThemeIndex *index() { return m_index.data(); }
 
 private:
     QString m_contentDir;
@@ -167,6 +246,72 @@ private:
     QList <QIconDirInfo> m_keyList;
     QStringList m_parents;
     bool m_valid;
+    QExplicitlySharedDataPointer<QIconThemeIndex> m_index;
+};
+
+/*
+ * The icons scaled to the requested sizes are stored for all processes of the
+ * user in the $XDG_CACHE_HOME/qtxdg/icons directory, so each icon is decoded
+ * and scaled once per machine. The rasters are mapped, not read, so the pages
+ * of the images are shared by the processes too; only the pixmaps are their own.
+ * The raster is stored as premultiplied ARGB32 together with the mtime and the
+ * size of the icon file, it's used only if they are unchanged. Only the Normal
+ * mode is stored, the other modes depend on the style.
+ *
+ * The directory is bounded by QICONRASTER_MAX_CACHE_BYTES, the oldest rasters
+ * are removed first.
+ */
+class QIconRasterCache
+{
+public:
+    static QImage find(const QString &fileName, const QSize &size);
+    static void insert(const QString &fileName, const QSize &size, const QImage &image);
+    static void insertAsync(const QString &fileName, const QSize &size, const QImage &image);
+
+private:
+    static QString cacheDir();
+    static QString rasterFileName(const QString &fileName, const QSize &size);
+    static void expire();
+};
+
+/*
+ * Decodes and scales the icon files on the worker threads for the widget being
+ * painted now. Until the image is ready a transparent placeholder is returned.
+ * The finished images are delivered in batches: the requesting widgets are
+ * updated once per QICONASYNC_DELIVER_DELAY, then the pixmaps are created
+ * from the images on the next paint.
+ */
+class QIconLoaderAsync : public QObject
+{
+    Q_OBJECT
+public:
+    QIconLoaderAsync();
+    static QIconLoaderAsync *instance();
+
+    bool isActive() const { return m_widget != 0; }
+    // Returns the previous widget
+    QWidget *setWidget(QWidget *widget);
+
+    // The failed is set if the file can't be decoded on the worker thread,
+    // the caller should load it itself.
+    QPixmap pixmap(const QString &fileName, const QSize &size, QIcon::Mode mode,
+                   bool scalable, bool *failed);
+
+private slots:
+    void imageReady(const QString &key, const QImage &image);
+    void deliver();
+
+private:
+    static void decode(QIconLoaderAsync *loader, const QString &key,
+                       const QString &fileName, const QSize &size, bool scalable);
+    QPixmap placeholder(const QSize &size) const;
+
+    QWidget *m_widget;
+    QHash<QString, QImage> m_ready;
+    QSet<QString> m_failed;
+    QHash<QString, QList<QPointer<QWidget> > > m_pending;
+    QList<QPointer<QWidget> > m_toUpdate;
+    QTimer m_deliverTimer;
 };
 
 class QIconLoader : public QObject
@@ -186,11 +331,17 @@ public:
     void updateSystemTheme();
     void invalidateKey() { m_themeKey++; }
     void ensureInitialized();
+    void checkIndexes();
 
 private:
     QThemeIconEntries findIconHelper(const QString &themeName,
                                      const QString &iconName,
                                      QStringList &visited) const;
+    void addIndexEntries(QThemeIconEntries &entries,
+                         const QVector<QIconIndexEntry> &found,
+                         const QStringList &contentDirs,
+                         const QList<QIconDirInfo> &subDirs,
+                         const QString &iconName) const;
     uint m_themeKey;
     bool m_supportsSvg;
     bool m_initialized;
@@ -199,6 +350,7 @@ private:
     mutable QString m_systemTheme;
     mutable QStringList m_iconDirs;
     mutable QHash <QString, QIconTheme> themeList;
+    mutable QExplicitlySharedDataPointer<QIconThemeIndex> m_pixmapsIndex;
 };
 
 QT_END_NAMESPACE
@@ -0,0 +1,895 @@
+/* BEGIN_COMMON_COPYRIGHT_HEADER
+ * (c)LGPL2+
+ *
+ * Razor - a lightweight, Qt based, desktop toolset
+ * http://razor-qt.org
+ *
+ * Copyright: 2010-2012 Razor team
+ * Authors:
+ *   Alexander Sokoloff <sokoloff.a@gmail.com>
+ *
+ * This program or library is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA
+ *
+ * END_COMMON_COPYRIGHT_HEADER */
+
+#include "qtxdgbenchmark.h"
+#include "xdgdesktopfile.h"
+#include "xdgmenu.h"
+#include "xdgicon.h"
+#include "xdgmime.h"
+
+#include <QtTest/QtTest>
+#include <QtGui/QApplication>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QTextStream>
+#include <QtCore/QTime>
+#include <QtCore/QMap>
+#include <QtCore/QVariant>
+
+#include <stdlib.h>
+#include <magic.h>
+
+#define RESULTS_FILE "qtxdg-benchmark.tsv"
+#define CATEGORY_COUNT 10
+
+
+/************************************************
+ The allocations are counted by replacing malloc,
+ the Qt containers don't use operator new. It's
+ glibc specific, like the rest of the desktop.
+ ************************************************/
+static quint64 allocationCount = 0;
+static quint64 allocatedBytes = 0;
+
+extern "C"
+{
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+
+void* malloc(size_t size)
+{
+    __sync_fetch_and_add(&allocationCount, 1);
+    __sync_fetch_and_add(&allocatedBytes, size);
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size)
+{
+    __sync_fetch_and_add(&allocationCount, 1);
+    __sync_fetch_and_add(&allocatedBytes, count * size);
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* ptr, size_t size)
+{
+    __sync_fetch_and_add(&allocationCount, 1);
+    __sync_fetch_and_add(&allocatedBytes, size);
+    return __libc_realloc(ptr, size);
+}
+}
+
+
+/************************************************
+
+ ************************************************/
+class AllocationCounter
+{
+public:
+    AllocationCounter():
+        mCount(allocationCount),
+        mBytes(allocatedBytes)
+    {
+    }
+
+    quint64 count() const { return allocationCount - mCount; }
+    quint64 bytes() const { return allocatedBytes - mBytes; }
+
+private:
+    quint64 mCount;
+    quint64 mBytes;
+};
+
+
+static const char* const categories[CATEGORY_COUNT] = {
+    "AudioVideo", "Development", "Education", "Game", "Graphics",
+    "Network", "Office", "Settings", "System", "Utility"
+};
+
+
+// The transparent 1x1 PNG, the icons are only looked up.
+static const char pngData[] =
+    "\x89PNG\r\n\x1a\n\x00\x00\x00\x0dIHDR\x00\x00\x00\x01\x00\x00\x00\x01\x08\x06\x00\x00\x00"
+    "\x1f\x15\xc4\x89\x00\x00\x00\x0aIDATx\x9c\x63\x00\x01\x00\x00\x05\x00\x01\x0d\x0a\x2d\xb4"
+    "\x00\x00\x00\x00IEND\xae\x42\x60\x82";
+
+
+/************************************************
+
+ ************************************************/
+static void writeFile(const QString& fileName, const QByteArray& data)
+{
+    QFile file(fileName);
+    if (!file.open(QFile::WriteOnly))
+        qFatal("Cannot write file %s", qPrintable(fileName));
+
+    file.write(data);
+}
+
+
+/************************************************
+
+ ************************************************/
+static void removeDir(const QString& path)
+{
+    QDir dir(path);
+    foreach (QFileInfo fi, dir.entryInfoList(QDir::AllEntries | QDir::Hidden | QDir::System | QDir::NoDotAndDotDot))
+    {
+        if (fi.isDir() && !fi.isSymLink())
+            removeDir(fi.filePath());
+        else
+            dir.remove(fi.fileName());
+    }
+
+    dir.rmdir(path);
+}
+
+
+/************************************************
+
+ ************************************************/
+QtXdgBenchmark::QtXdgBenchmark():
+    QObject()
+{
+}
+
+
+/************************************************
+ The caches of the library are placed in the root
+ too, so the user's caches are not touched.
+ ************************************************/
+void QtXdgBenchmark::initTestCase()
+{
+    mRoot = QString("%1/qtxdg-benchmark-%2").arg(QDir::tempPath()).arg(QCoreApplication::applicationPid());
+    removeDir(mRoot);
+
+    qputenv("XDG_CACHE_HOME", QFile::encodeName(mRoot + "/cache"));
+    qputenv("XDG_MENU_PREFIX", "");
+    QIcon::setThemeSearchPaths(QStringList() << mRoot + "/icons");
+
+    generate(100);
+    generate(1000);
+    generate(10000);
+}
+
+
+/************************************************
+
+ ************************************************/
+void QtXdgBenchmark::cleanupTestCase()
+{
+    removeDir(mRoot);
+
+    QFile file(RESULTS_FILE);
+    if (!file.open(QFile::WriteOnly | QFile::Text))
+    {
+        qWarning("Cannot write file %s", RESULTS_FILE);
+        return;
+    }
+
+    QTextStream ts(&file);
+    ts << "test\tsize\tmetric\tvalue\n";
+    foreach (QString line, mResults)
+        ts << line << "\n";
+}
+
+
+/************************************************
+
+ ************************************************/
+void QtXdgBenchmark::addSizes()
+{
+    QTest::addColumn<int>("count");
+    QTest::newRow("100")   << 100;
+    QTest::newRow("1000")  << 1000;
+    QTest::newRow("10000") << 10000;
+}
+
+
+/************************************************
+ Two rows for each size, like "legacy-100" and
+ "current-100", the column tells them apart.
+ ************************************************/
+void QtXdgBenchmark::addVariants(const char* column, const QString& on, const QString& off)
+{
+    QTest::addColumn<int>("count");
+    QTest::addColumn<bool>(column);
+
+    foreach (int count, QList<int>() << 100 << 1000 << 10000)
+    {
+        QTest::newRow(qPrintable(QString("%1-%2").arg(on).arg(count)))  << count << true;
+        QTest::newRow(qPrintable(QString("%1-%2").arg(off).arg(count))) << count << false;
+    }
+}
+
+
+/************************************************
+
+ ************************************************/
+QString QtXdgBenchmark::rootDir(int count) const
+{
+    return QString("%1/%2").arg(mRoot).arg(count);
+}
+
+
+/************************************************
+ Every 10th desktop file is in the subdirectory,
+ every 3rd one goes to the submenu. The merged
+ menu file moves its menu into another one.
+ ************************************************/
+void QtXdgBenchmark::generate(int count)
+{
+    QString root = rootDir(count);
+    QString apps = root + "/data/applications";
+    QString dirs = root + "/data/desktop-directories";
+    QString menus = root + "/config/menus";
+    QString icons = QString("%1/icons/bench-%2").arg(mRoot).arg(count);
+    QString files = root + "/files";
+
+    QDir().mkpath(apps + "/bench");
+    QDir().mkpath(dirs);
+    QDir().mkpath(menus + "/applications-merged");
+    QDir().mkpath(files);
+
+    int iconCount = qMax(10, count / 10);
+
+    // Desktop files ..............................
+    QStringList desktopFiles;
+    for (int i=0; i<count; ++i)
+    {
+        QString fileName;
+        if (i % 10 == 9)
+            fileName = QString("%1/bench/app-%2.desktop").arg(apps).arg(i);
+        else
+            fileName = QString("%1/bench-app-%2.desktop").arg(apps).arg(i);
+
+        QString categoryList = categories[i % CATEGORY_COUNT];
+        if (i % 3 == 0)
+            categoryList += ";X-BenchSub";
+
+        QString data = QString(
+            "[Desktop Entry]\n"
+            "Type=Application\n"
+            "Name=Bench App %1\n"
+            "Name[de]=Bench Anwendung %1\n"
+            "Name[fr]=Application de test %1\n"
+            "GenericName=Benchmark Application\n"
+            "GenericName[de]=Testanwendung\n"
+            "Comment=The synthetic application number %1\n"
+            "Comment[de]=Die synthetische Anwendung Nummer %1\n"
+            "Exec=bench-app-%1 %U\n"
+            "Icon=bench-app-%2\n"
+            "Terminal=false\n"
+            "StartupNotify=true\n"
+            "MimeType=text/plain;image/png;\n"
+            "Categories=%3;\n"
+            "\n"
+            "[Desktop Action NewWindow]\n"
+            "Name=New Window\n"
+            "Exec=bench-app-%1 --new-window\n")
+                .arg(i)
+                .arg(i % iconCount)
+                .arg(categoryList);
+
+        writeFile(fileName, data.toUtf8());
+        desktopFiles << fileName;
+    }
+    mDesktopFiles.insert(count, desktopFiles);
+
+    // Directory files ............................
+    for (int i=0; i<CATEGORY_COUNT; ++i)
+    {
+        QString data = QString(
+            "[Desktop Entry]\n"
+            "Type=Directory\n"
+            "Name=%1\n"
+            "Comment=The %1 applications\n"
+            "Icon=bench-app-%2\n")
+                .arg(categories[i])
+                .arg(i);
+
+        writeFile(QString("%1/bench-%2.directory").arg(dirs, categories[i]), data.toUtf8());
+    }
+
+    // Menu files .................................
+    QString menu;
+    QTextStream ms(&menu);
+    ms << "<!DOCTYPE Menu PUBLIC \"-//freedesktop//DTD Menu 1.0//EN\"\n"
+          " \"http://www.freedesktop.org/standards/menu-spec/menu-1.0.dtd\">\n"
+          "<Menu>\n"
+          "  <Name>Applications</Name>\n"
+          "  <DefaultAppDirs/>\n"
+          "  <DefaultDirectoryDirs/>\n"
+          "  <DefaultMergeDirs/>\n";
+
+    for (int i=0; i<CATEGORY_COUNT; ++i)
+    {
+        ms << "  <Menu>\n"
+              "    <Name>" << categories[i] << "</Name>\n"
+              "    <Directory>bench-" << categories[i] << ".directory</Directory>\n"
+              "    <Include><And><Category>" << categories[i] << "</Category>"
+              "<Not><Category>X-BenchSub</Category></Not></And></Include>\n"
+              "    <Menu>\n"
+              "      <Name>Tools</Name>\n"
+              "      <Include><And><Category>" << categories[i] << "</Category>"
+              "<Category>X-BenchSub</Category></And></Include>\n"
+              "      <Layout><Merge type=\"files\"/><Separator/><Merge type=\"menus\"/></Layout>\n"
+              "    </Menu>\n"
+              "  </Menu>\n";
+    }
+
+    ms << "  <Menu>\n"
+          "    <Name>Other</Name>\n"
+          "    <OnlyUnallocated/>\n"
+          "    <Include><All/></Include>\n"
+          "  </Menu>\n"
+          "</Menu>\n";
+    ms.flush();
+    writeFile(menus + "/applications.menu", menu.toUtf8());
+
+    QString merged;
+    QTextStream mms(&merged);
+    mms << "<!DOCTYPE Menu PUBLIC \"-//freedesktop//DTD Menu 1.0//EN\"\n"
+           " \"http://www.freedesktop.org/standards/menu-spec/menu-1.0.dtd\">\n"
+           "<Menu>\n"
+           "  <Name>Applications</Name>\n"
+           "  <Menu>\n"
+           "    <Name>Favorites</Name>\n"
+           "    <Include>\n";
+
+    for (int i=0; i<qMin(count, 50); i+=5)
+        mms << "      <Filename>bench-app-" << i << ".desktop</Filename>\n";
+
+    mms << "    </Include>\n"
+           "  </Menu>\n"
+           "  <Move><Old>Favorites</Old><New>Utility/Favorites</New></Move>\n"
+           "</Menu>\n";
+    mms.flush();
+    writeFile(menus + "/applications-merged/bench-favorites.menu", merged.toUtf8());
+
+    // Icon theme .................................
+    QStringList iconDirs;
+    iconDirs << "16x16/apps" << "32x32/apps" << "48x48/apps";
+
+    QString index;
+    QTextStream is(&index);
+    is << "[Icon Theme]\n"
+          "Name=Bench\n"
+          "Directories=" << iconDirs.join(",") << "\n";
+
+    foreach (QString dir, iconDirs)
+    {
+        QDir().mkpath(icons + "/" + dir);
+        is << "\n[" << dir << "]\n"
+              "Size=" << dir.section('x', 0, 0) << "\n"
+              "Context=Applications\n"
+              "Type=Fixed\n";
+    }
+    is.flush();
+    writeFile(icons + "/index.theme", index.toUtf8());
+
+    QByteArray png(pngData, sizeof(pngData) - 1);
+    QStringList iconNames;
+    for (int i=0; i<iconCount; ++i)
+    {
+        QString name = QString("bench-app-%1").arg(i);
+        foreach (QString dir, iconDirs)
+            writeFile(QString("%1/%2/%3.png").arg(icons, dir, name), png);
+
+        iconNames << name;
+    }
+    mIconNames.insert(count, iconNames);
+
+    // Files for the mime detection ...............
+    QStringList mimeFiles;
+    for (int i=0; i<qMax(10, count / 10); ++i)
+    {
+        QString fileName;
+        switch (i % 4)
+        {
+        case 0:
+            fileName = QString("%1/notes-%2.txt").arg(files).arg(i);
+            writeFile(fileName, QString("The synthetic text file %1.\n").arg(i).toUtf8());
+            break;
+
+        case 1:
+            fileName = QString("%1/script-%2.sh").arg(files).arg(i);
+            writeFile(fileName, QString("#!/bin/sh\necho %1\n").arg(i).toUtf8());
+            break;
+
+        case 2:
+            fileName = QString("%1/image-%2.png").arg(files).arg(i);
+            writeFile(fileName, png);
+            break;
+
+        default:
+            fileName = QString("%1/launcher-%2.desktop").arg(files).arg(i);
+            QFile::copy(desktopFiles.at(i % desktopFiles.count()), fileName);
+            break;
+        }
+
+        mimeFiles << fileName;
+    }
+    mMimeFiles.insert(count, mimeFiles);
+}
+
+
+/************************************************
+
+ ************************************************/
+void QtXdgBenchmark::useRoot(int count)
+{
+    QString root = rootDir(count);
+    qputenv("XDG_DATA_HOME",   QFile::encodeName(root + "/data-home"));
+    qputenv("XDG_DATA_DIRS",   QFile::encodeName(root + "/data"));
+    qputenv("XDG_CONFIG_HOME", QFile::encodeName(root + "/config-home"));
+    qputenv("XDG_CONFIG_DIRS", QFile::encodeName(root + "/config"));
+}
+
+
+/************************************************
+ Runs the case once more, outside of QBENCHMARK.
+ ************************************************/
+void QtXdgBenchmark::measure(Run run, int count, int items)
+{
+    QTime time;
+    time.start();
+    AllocationCounter counter;
+
+    (this->*run)(count);
+
+    quint64 allocations = counter.count();
+    quint64 bytes = counter.bytes();
+    int msecs = time.elapsed();
+
+    addResult("items", items);
+    addResult("msecs", msecs);
+    if (items)
+        addResult("usecs-per-item", qint64(msecs) * 1000 / items);
+    addResult("allocations", allocations);
+    addResult("bytes", bytes);
+}
+
+
+/************************************************
+
+ ************************************************/
+void QtXdgBenchmark::addResult(const QString& metric, qint64 value)
+{
+    mResults << QString("%1\t%2\t%3\t%4")
+                    .arg(QTest::currentTestFunction())
+                    .arg(QTest::currentDataTag())
+                    .arg(metric)
+                    .arg(value);
+}
+
+
+/************************************************
+ The parser only, the XdgDesktopFileCache is not
+ used.
+ ************************************************/
+void QtXdgBenchmark::loadDesktopFiles(int count)
+{
+    foreach (QString fileName, mDesktopFiles.value(count))
+    {
+        XdgDesktopFile file;
+        file.load(fileName);
+    }
+}
+
+
+/************************************************
+
+ ************************************************/
+void QtXdgBenchmark::desktopFileLoad_data()
+{
+    addSizes();
+}
+
+
+/************************************************
+
+ ************************************************/
+void QtXdgBenchmark::desktopFileLoad()
+{
+    QFETCH(int, count);
+
+    QBENCHMARK {
+        loadDesktopFiles(count);
+    }
+
+    measure(&QtXdgBenchmark::loadDesktopFiles, count, mDesktopFiles.value(count).count());
+}
+
+
+/************************************************
+ The line based parser of the 0.4 releases, kept
+ as the reference for the desktopFileParse case.
+ ************************************************/
+static bool legacyRead(const QString& fileName, const QString& prefix, QMap<QString, QVariant>& items)
+{
+    QFile file(fileName);
+
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+        return false;
+
+    QString section;
+    QTextStream stream(&file);
+    bool prefixExists = false;
+    while (!stream.atEnd()) {
+        QString line = stream.readLine().trimmed();
+
+        // Skip comments ......................
+        if (line.startsWith('#'))
+            continue;
+
+
+        // Section ..............................
+        if (line.startsWith('[') && line.endsWith(']'))
+        {
+            section = line.mid(1, line.length()-2);
+            if (section == prefix)
+                prefixExists = true;
+
+            continue;
+        }
+
+        QString key = line.section('=', 0, 0).trimmed();
+        QString value = line.section('=', 1).trimmed();
+
+        if (key.isEmpty())
+            continue;
+
+        // Remove quotes ........................
+        if ((value.startsWith('"') && value.endsWith('"')) ||
+            (value.startsWith('\'') && value.endsWith('\'')))
+            value = value.mid(1, value.length()-2);
+
+        items[section + "/" + key] = QVariant(value);
+    }
+
+    return prefix.isEmpty() || prefixExists;
+}
+
+
+/************************************************
+
+ ************************************************/
+void QtXdgBenchmark::parseLegacyDesktopFiles(int count)
+{
+    foreach (QString fileName, mDesktopFiles.value(count))
+    {
+        QMap<QString, QVariant> items;
+        legacyRead(fileName, "Desktop Entry", items);
+    }
+}
+
+
+/************************************************
+ The one pass parser against the legacy one, the
+ throughput is input-bytes / msecs.
+ ************************************************/
+void QtXdgBenchmark::desktopFileParse_data()
+{
+    addVariants("legacy", "legacy", "current");
+}
+
+
+/************************************************
+
+ ************************************************/
+void QtXdgBenchmark::desktopFileParse()
+{
+    QFETCH(int, count);
+    QFETCH(bool, legacy);
+
+    Run run = legacy ? &QtXdgBenchmark::parseLegacyDesktopFiles : &QtXdgBenchmark::loadDesktopFiles;
+
+    QBENCHMARK {
+        (this->*run)(count);
+    }
+
+    qint64 inputBytes = 0;
+    foreach (QString fileName, mDesktopFiles.value(count))
+        inputBytes += QFileInfo(fileName).size();
+
+    measure(run, count, mDesktopFiles.value(count).count());
+    addResult("input-bytes", inputBytes);
+}
+
+
+/************************************************
+ The menu cache is removed, so the menu is built.
+ The desktop files are already in the memory cache
+ after the first run, like on the rebuild.
+ ************************************************/
+void QtXdgBenchmark::readMenu(int count)
+{
+    QDir cacheDir(mRoot + "/cache/qtxdg");
+    foreach (QString dirName, cacheDir.entryList(QStringList("menu-*"), QDir::Dirs))
+        cacheDir.remove(dirName + "/menu.cache");
+
+    XdgMenu menu;
+    menu.setShared(false);
+    menu.setEnvironments("RAZOR");
+    if (!menu.read(rootDir(count) + "/config/menus/applications.menu"))
+        qWarning("%s", qPrintable(menu.errorString()));
+}
+
+
+/************************************************
+
+ ************************************************/
+void QtXdgBenchmark::menuRead_data()
+{
+    addSizes();
+}
+
+
+/************************************************
+
+ ************************************************/
+void QtXdgBenchmark::menuRead()
+{
+    QFETCH(int, count);
+    useRoot(count);
+
+    QBENCHMARK {
+        readMenu(count);
+    }
+
+    measure(&QtXdgBenchmark::readMenu, count, mDesktopFiles.value(count).count());
+}
+
+
+/************************************************
+ The menu is loaded from the cache written by the
+ previous run.
+ ************************************************/
+void QtXdgBenchmark::readCachedMenu(int count)
+{
+    XdgMenu menu;
+    menu.setShared(false);
+    menu.setEnvironments("RAZOR");
+    if (!menu.read(rootDir(count) + "/config/menus/applications.menu"))
+        qWarning("%s", qPrintable(menu.errorString()));
+}
+
+
+/************************************************
+
+ ************************************************/
+void QtXdgBenchmark::menuReadCached_data()
+{
+    addSizes();
+}
+
+
+/************************************************
+
+ ************************************************/
+void QtXdgBenchmark::menuReadCached()
+{
+    QFETCH(int, count);
+    useRoot(count);
+    readCachedMenu(count);
+
+    QBENCHMARK {
+        readCachedMenu(count);
+    }
+
+    measure(&QtXdgBenchmark::readCachedMenu, count, mDesktopFiles.value(count).count());
+}
+
+
+/************************************************
+ With the log directory the menu is always built,
+ the stage times are copied from timings.tsv.
+ ************************************************/
+void QtXdgBenchmark::menuStages_data()
+{
+    addSizes();
+}
+
+
+/************************************************
+
+ ************************************************/
+void QtXdgBenchmark::menuStages()
+{
+    QFETCH(int, count);
+    useRoot(count);
+
+    QString logDir = QString("%1/log-%2").arg(mRoot).arg(count);
+    QDir().mkpath(logDir);
+
+    QBENCHMARK_ONCE {
+        XdgMenu menu;
+        menu.setShared(false);
+        menu.setEnvironments("RAZOR");
+        menu.setLogDir(logDir);
+        QVERIFY2(menu.read(rootDir(count) + "/config/menus/applications.menu"), qPrintable(menu.errorString()));
+    }
+
+    QFile file(logDir + "/timings.tsv");
+    QVERIFY(file.open(QFile::ReadOnly | QFile::Text));
+
+    QTextStream ts(&file);
+    while (!ts.atEnd())
+    {
+        QString line = ts.readLine();
+        QString name = line.section('\t', 0, 0);
+        if (!name.isEmpty())
+            addResult(name, line.section('\t', 1, 1).toLongLong());
+    }
+}
+
+
+/************************************************
+ After the first run the icons are answered from
+ the lookup caches of XdgIcon, the theme is not
+ searched.
+ ************************************************/
+void QtXdgBenchmark::lookupIcons(int count)
+{
+    foreach (QString name, mIconNames.value(count))
+        XdgIcon::fromTheme(name);
+}
+
+
+/************************************************
+ Switching the theme invalidates the theme key, so
+ the lookup caches are cleared and the engines look
+ up the icons in the theme index again.
+ ************************************************/
+void QtXdgBenchmark::lookupIconsCold(int count)
+{
+    XdgIcon::setThemeName("hicolor");
+    XdgIcon::setThemeName(QString("bench-%1").arg(count));
+    lookupIcons(count);
+}
+
+
+/************************************************
+
+ ************************************************/
+void QtXdgBenchmark::iconFromTheme_data()
+{
+    addVariants("cold", "cold", "warm");
+}
+
+
+/************************************************
+
+ ************************************************/
+void QtXdgBenchmark::iconFromTheme()
+{
+    QFETCH(int, count);
+    QFETCH(bool, cold);
+
+    XdgIcon::setThemeName(QString("bench-%1").arg(count));
+    QVERIFY(!XdgIcon::fromTheme(mIconNames.value(count).first()).isNull());
+
+    Run run = cold ? &QtXdgBenchmark::lookupIconsCold : &QtXdgBenchmark::lookupIcons;
+
+    QBENCHMARK {
+        (this->*run)(count);
+    }
+
+    measure(run, count, mIconNames.value(count).count());
+}
+
+
+/************************************************
+
+ ************************************************/
+void QtXdgBenchmark::detectMimeTypes(int count)
+{
+    foreach (QString fileName, mMimeFiles.value(count))
+        XdgMimeInfo(QFileInfo(fileName)).mimeType();
+}
+
+
+/************************************************
+ Before the magic handle was kept per thread, the
+ database was loaded for every file.
+ ************************************************/
+static QString legacyMimeType(const QString& fileName)
+{
+    QString result("application/octet-stream");
+
+    magic_t magicMimePredictor = magic_open(MAGIC_MIME_TYPE);
+    if (!magicMimePredictor)
+        return result;
+
+    if (magic_load(magicMimePredictor, 0) == 0)
+    {
+        QByteArray ar = QFileInfo(fileName).absoluteFilePath().toLocal8Bit();
+        result = QString(magic_file(magicMimePredictor, ar.data()));
+    }
+
+    magic_close(magicMimePredictor);
+    return result;
+}
+
+
+/************************************************
+
+ ************************************************/
+void QtXdgBenchmark::detectLegacyMimeTypes(int count)
+{
+    foreach (QString fileName, mMimeFiles.value(count))
+        legacyMimeType(fileName);
+}
+
+
+/************************************************
+ The per file cost is in the usecs-per-item
+ results of the legacy and current rows.
+ ************************************************/
+void QtXdgBenchmark::mimeInfo_data()
+{
+    addVariants("legacy", "legacy", "current");
+}
+
+
+/************************************************
+
+ ************************************************/
+void QtXdgBenchmark::mimeInfo()
+{
+    QFETCH(int, count);
+    QFETCH(bool, legacy);
+
+    // The timings are comparable only if both find the same types.
+    if (!legacy)
+    {
+        foreach (QString fileName, mMimeFiles.value(count))
+            QCOMPARE(XdgMimeInfo(QFileInfo(fileName)).mimeType(), legacyMimeType(fileName));
+    }
+
+    Run run = legacy ? &QtXdgBenchmark::detectLegacyMimeTypes : &QtXdgBenchmark::detectMimeTypes;
+
+    QBENCHMARK {
+        (this->*run)(count);
+    }
+
+    measure(run, count, mMimeFiles.value(count).count());
+}
+
+
+/************************************************
+ The icons are only looked up, the GUI is not
+ needed, so the benchmark runs without X server.
+ ************************************************/
+int main(int argc, char** argv)
+{
+    QApplication app(argc, argv, false);
+    QtXdgBenchmark benchmark;
+    return QTest::qExec(&benchmark, argc, argv);
+}
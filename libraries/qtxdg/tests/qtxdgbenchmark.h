@@ -0,0 +1,100 @@
+/* BEGIN_COMMON_COPYRIGHT_HEADER
+ * (c)LGPL2+
+ *
+ * Razor - a lightweight, Qt based, desktop toolset
+ * http://razor-qt.org
+ *
+ * Copyright: 2010-2012 Razor team
+ * Authors:
+ *   Alexander Sokoloff <sokoloff.a@gmail.com>
+ *
+ * This program or library is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA
+ *
+ * END_COMMON_COPYRIGHT_HEADER */
+
+#ifndef QTXDG_QTXDGBENCHMARK_H
+#define QTXDG_QTXDGBENCHMARK_H
+
+#include <QtCore/QObject>
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+#include <QtCore/QHash>
+
+/*! The benchmarks of the qtxdg library. The synthetic XDG data roots with 100, 1,000 and
+    10,000 desktop files, the menu files and the icon themes are generated in the temporary
+    directory. Besides the QTestLib output, every case runs once more outside of QBENCHMARK
+    and writes its time, the number of the processed items and the allocations to the
+    qtxdg-benchmark.tsv file as tab separated "test size metric value" lines. */
+class QtXdgBenchmark: public QObject
+{
+    Q_OBJECT
+public:
+    QtXdgBenchmark();
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void desktopFileLoad_data();
+    void desktopFileLoad();
+
+    void desktopFileParse_data();
+    void desktopFileParse();
+
+    void menuRead_data();
+    void menuRead();
+
+    void menuReadCached_data();
+    void menuReadCached();
+
+    void menuStages_data();
+    void menuStages();
+
+    void iconFromTheme_data();
+    void iconFromTheme();
+
+    void mimeInfo_data();
+    void mimeInfo();
+
+private:
+    typedef void (QtXdgBenchmark::*Run)(int count);
+
+    void addSizes();
+    void addVariants(const char* column, const QString& on, const QString& off);
+    QString rootDir(int count) const;
+    void generate(int count);
+    void useRoot(int count);
+
+    void measure(Run run, int count, int items);
+    void addResult(const QString& metric, qint64 value);
+
+    void loadDesktopFiles(int count);
+    void parseLegacyDesktopFiles(int count);
+    void readMenu(int count);
+    void readCachedMenu(int count);
+    void lookupIcons(int count);
+    void lookupIconsCold(int count);
+    void detectMimeTypes(int count);
+    void detectLegacyMimeTypes(int count);
+
+    QString mRoot;
+    QStringList mResults;
+    QHash<int, QStringList> mDesktopFiles;
+    QHash<int, QStringList> mIconNames;
+    QHash<int, QStringList> mMimeFiles;
+};
+
+#endif // QTXDG_QTXDGBENCHMARK_H
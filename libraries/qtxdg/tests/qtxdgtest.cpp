@@ -0,0 +1,172 @@
+/* BEGIN_COMMON_COPYRIGHT_HEADER
+ * (c)LGPL2+
+ *
+ * Razor - a lightweight, Qt based, desktop toolset
+ * http://razor-qt.org
+ *
+ * Copyright: 2010-2012 Razor team
+ * Authors:
+ *   Alexander Sokoloff <sokoloff.a@gmail.com>
+ *
+ * This program or library is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA
+ *
+ * END_COMMON_COPYRIGHT_HEADER */
+
+#include "qtxdgtest.h"
+#include "xdgdesktopfile.h"
+
+#include <QtTest/QtTest>
+#include <QtGui/QApplication>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+
+
+/************************************************
+
+ ************************************************/
+static void writeFile(const QString& fileName, const QByteArray& data)
+{
+    QFile file(fileName);
+    if (!file.open(QFile::WriteOnly))
+        qFatal("Cannot write file %s", qPrintable(fileName));
+
+    file.write(data);
+}
+
+
+/************************************************
+
+ ************************************************/
+QtXdgTest::QtXdgTest():
+    QObject()
+{
+}
+
+
+/************************************************
+
+ ************************************************/
+void QtXdgTest::initTestCase()
+{
+    mRoot = QString("%1/qtxdg-test-%2").arg(QDir::tempPath()).arg(QCoreApplication::applicationPid());
+    QDir().mkpath(mRoot);
+    qputenv("XDG_CACHE_HOME", QFile::encodeName(mRoot + "/cache"));
+}
+
+
+/************************************************
+
+ ************************************************/
+void QtXdgTest::cleanupTestCase()
+{
+    QDir dir(mRoot);
+    foreach (QString fileName, dir.entryList(QDir::Files))
+        dir.remove(fileName);
+}
+
+
+/************************************************
+ The value is read from the file, saved and read
+ again, both reads must give the expected value.
+ ************************************************/
+void QtXdgTest::desktopFileRoundTrip_data()
+{
+    QTest::addColumn<QString>("key");
+    QTest::addColumn<QString>("line");
+    QTest::addColumn<QString>("expected");
+
+    QTest::newRow("list separator")  << "Keywords" << "Keywords=a\\;b;c;"     << "a\\;b;c;";
+    QTest::newRow("newline")         << "Comment"  << "Comment=one\\ntwo"      << "one\ntwo";
+    QTest::newRow("tab")             << "Comment"  << "Comment=one\\ttwo"      << "one\ttwo";
+    QTest::newRow("space")           << "Comment"  << "Comment=\\sone two\\s"  << " one two ";
+    QTest::newRow("backslash")       << "Comment"  << "Comment=one\\\\two"     << "one\\two";
+}
+
+
+/************************************************
+
+ ************************************************/
+void QtXdgTest::desktopFileRoundTrip()
+{
+    QFETCH(QString, key);
+    QFETCH(QString, line);
+    QFETCH(QString, expected);
+
+    QString fileName = mRoot + "/roundtrip.desktop";
+    QString savedName = mRoot + "/roundtrip-saved.desktop";
+
+    QString data = QString("[Desktop Entry]\n"
+                           "Type=Application\n"
+                           "Name=Round Trip\n"
+                           "Exec=roundtrip\n"
+                           "%1\n").arg(line);
+    writeFile(fileName, data.toUtf8());
+
+    XdgDesktopFile file;
+    QVERIFY(file.load(fileName));
+    QCOMPARE(file.value(key).toString(), expected);
+
+    QVERIFY(file.save(savedName));
+
+    XdgDesktopFile saved;
+    QVERIFY(saved.load(savedName));
+    QCOMPARE(saved.value(key).toString(), expected);
+}
+
+
+/************************************************
+ The cache keeps only the best translations, the
+ other ones are read from the file when asked for.
+ ************************************************/
+void QtXdgTest::desktopFileCachedTranslations()
+{
+    QString fileName = mRoot + "/translations.desktop";
+    QString savedName = mRoot + "/translations-saved.desktop";
+
+    writeFile(fileName, "[Desktop Entry]\n"
+                        "Type=Application\n"
+                        "Exec=translations\n"
+                        "Name=Base\n"
+                        "Name[zz]=Other\n");
+
+    XdgDesktopFile loaded;
+    QVERIFY(loaded.load(fileName));
+
+    XdgDesktopFile cached = XdgDesktopFileCache::load(fileName);
+    QVERIFY(cached.isValid());
+    QCOMPARE(cached.localizedValue("Name").toString(), QString("Base"));
+    QVERIFY(cached.contains("Name[zz]"));
+    QCOMPARE(cached.value("Name[zz]").toString(), QString("Other"));
+    QVERIFY(!cached.contains("Name[yy]"));
+    QVERIFY(cached == loaded);
+
+    QVERIFY(cached.save(savedName));
+
+    XdgDesktopFile saved;
+    QVERIFY(saved.load(savedName));
+    QCOMPARE(saved.value("Name[zz]").toString(), QString("Other"));
+}
+
+
+/************************************************
+
+ ************************************************/
+int main(int argc, char** argv)
+{
+    QApplication app(argc, argv, false);
+    QtXdgTest test;
+    return QTest::qExec(&test, argc, argv);
+}
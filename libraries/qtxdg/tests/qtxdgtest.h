@@ -0,0 +1,55 @@
+/* BEGIN_COMMON_COPYRIGHT_HEADER
+ * (c)LGPL2+
+ *
+ * Razor - a lightweight, Qt based, desktop toolset
+ * http://razor-qt.org
+ *
+ * Copyright: 2010-2012 Razor team
+ * Authors:
+ *   Alexander Sokoloff <sokoloff.a@gmail.com>
+ *
+ * This program or library is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA
+ *
+ * END_COMMON_COPYRIGHT_HEADER */
+
+#ifndef QTXDG_QTXDGTEST_H
+#define QTXDG_QTXDGTEST_H
+
+#include <QtCore/QObject>
+#include <QtCore/QString>
+
+/*! The unit tests of the qtxdg library. The files are written to the temporary
+    directory, the user's data and caches are not touched. */
+class QtXdgTest: public QObject
+{
+    Q_OBJECT
+public:
+    QtXdgTest();
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void desktopFileRoundTrip_data();
+    void desktopFileRoundTrip();
+
+    void desktopFileCachedTranslations();
+
+private:
+    QString mRoot;
+};
+
+#endif // QTXDG_QTXDGTEST_H
@@ -29,7 +29,80 @@
 #include "xdgaction.h"
 #include "xdgicon.h"
 #include <QtCore/QDebug>
-#include <QtCore/QCoreApplication>
+#include <QtGui/QIconEngineV2>
+#include <QtGui/QPainter>
+
+
+/************************************************
+ Looks the icon up in the theme when it's painted
+ first, the actions of the never shown menus don't
+ touch the icon theme at all.
+ ************************************************/
+class XdgActionIconEngine: public QIconEngineV2
+{
+public:
+    explicit XdgActionIconEngine(const QString& iconName):
+        QIconEngineV2(),
+        mIconName(iconName),
+        mResolved(false)
+    {
+    }
+
+    void paint(QPainter *painter, const QRect &rect, QIcon::Mode mode, QIcon::State state)
+    {
+        icon().paint(painter, rect, Qt::AlignCenter, mode, state);
+    }
+
+    QPixmap pixmap(const QSize &size, QIcon::Mode mode, QIcon::State state)
+    {
+        return icon().pixmap(size, mode, state);
+    }
+
+    QSize actualSize(const QSize &size, QIcon::Mode mode, QIcon::State state)
+    {
+        return icon().actualSize(size, mode, state);
+    }
+
+    QIconEngineV2 *clone() const
+    {
+        return new XdgActionIconEngine(*this);
+    }
+
+    QString key() const
+    {
+        return QLatin1String("XdgActionIconEngine");
+    }
+
+    void virtual_hook(int id, void *data)
+    {
+        if (id == QIconEngineV2::AvailableSizesHook)
+        {
+            QIconEngineV2::AvailableSizesArgument &arg =
+                    *reinterpret_cast<QIconEngineV2::AvailableSizesArgument*>(data);
+            arg.sizes = icon().availableSizes(arg.mode, arg.state);
+            return;
+        }
+
+        QIconEngineV2::virtual_hook(id, data);
+    }
+
+private:
+    const QIcon& icon()
+    {
+        if (!mResolved)
+        {
+            mIcon = XdgIcon::fromTheme(mIconName);
+            if (mIcon.isNull())
+                mIcon = XdgIcon::fromTheme("application-x-executable");
+            mResolved = true;
+        }
+        return mIcon;
+    }
+
+    QString mIconName;
+    QIcon mIcon;
+    bool mResolved;
+};
 
 
 /************************************************
@@ -122,7 +195,7 @@ void XdgAction::load(const XdgDesktopFile& desktopFile)
         setToolTip(mDesktopFile.comment());
 
         connect(this, SIGNAL(triggered()), this, SLOT(runConmmand()));
-        QMetaObject::invokeMethod(this, "updateIcon", Qt::QueuedConnection);
+        updateIcon();
     }
     else
     {
@@ -144,12 +217,10 @@ void XdgAction::runConmmand() const
 
 
 /************************************************
-
+ The icon is looked up on the first paint, see
+ XdgActionIconEngine.
  ************************************************/
 void XdgAction::updateIcon()
 {
-    setIcon(mDesktopFile.icon());
-    if (icon().isNull())
-        setIcon(XdgIcon::fromTheme("application-x-executable"));
-    QCoreApplication::processEvents();
+    setIcon(QIcon(new XdgActionIconEngine(mDesktopFile.iconName())));
 }
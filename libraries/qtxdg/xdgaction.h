@@ -41,7 +41,7 @@
 
   The following properties of the action are set based on the desktopFile.
     Text    - XdgDesktopFile localizeValue("Name")
-    Icon    - XdgDesktopFile icon()
+    Icon    - XdgDesktopFile icon(), looked up when the icon is painted first
     ToolTip - XdgDesktopFile localizeValue("Comment")
 
   Internally this function will create a copy of the desktopFile, so you
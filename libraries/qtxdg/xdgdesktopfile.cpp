@@ -34,6 +34,8 @@
 #include <stdlib.h>
 
 #include "xdgdesktopfile.h"
+#include "xdgdesktopfile_p.h"
+#include "xdgpathindex.h"
 #include "xdgmime.h"
 #include "xdgicon.h"
 #include "xdgdirs.h"
@@ -45,10 +47,16 @@
 #include <QtCore/QFileInfo>
 #include <QDebug>
 #include <QtCore/QHash>
+#include <QtCore/QSet>
+#include <QtCore/QTextStream>
+#include <QtCore/QtAlgorithms>
+#include <QtCore/QMutex>
+#include <QtCore/QReadWriteLock>
 #include <QtCore/QProcess>
 #include <QUrl>
 #include <QDesktopServices>
 #include <unistd.h>
+#include <string.h>
 
 
 /************************************************
@@ -73,15 +81,55 @@ QString &doEscape(QString& str, const QHash<QChar,QChar> &repl)
  The escape sequences \s, \n, \t, \r, and \\ are supported for values
  of type string and localestring, meaning ASCII space, newline, tab,
  carriage return, and backslash, respectively.
+ The list separator escape \; is kept by the parser, so it's written
+ as is. The leading and trailing spaces are trimmed by the parser, they
+ are written as \s.
  ************************************************/
 QString &escape(QString& str)
 {
-    QHash<QChar,QChar> repl;
-    repl.insert('\n',  'n');
-    repl.insert('\t',  't');
-    repl.insert('\r',  'r');
+    int first = 0;
+    while (first < str.length() && str.at(first) == ' ')
+        ++first;
+
+    int last = str.length() - 1;
+    while (last >= first && str.at(last) == ' ')
+        --last;
+
+    QString res;
+    res.reserve(str.length());
+    const QChar* begin = str.constData();
+    const QChar* c = begin;
+    const QChar* end = c + str.length();
+    for (; c != end; ++c)
+    {
+        switch (c->unicode())
+        {
+        case ' ':
+            if (c - begin < first || c - begin > last)
+                res += QLatin1String("\\s");
+            else
+                res += *c;
+            break;
 
-    return doEscape(str, repl);
+        case '\\':
+            if (c + 1 != end && *(c + 1) == ';')
+            {
+                res += QLatin1String("\\;");
+                ++c;
+            }
+            else
+                res += QLatin1String("\\\\");
+            break;
+
+        case '\n':  res += QLatin1String("\\n");  break;
+        case '\t':  res += QLatin1String("\\t");  break;
+        case '\r':  res += QLatin1String("\\r");  break;
+        default:    res += *c;
+        }
+    }
+
+    str = res;
+    return str;
 }
 
 
@@ -151,16 +199,35 @@ QString &doUnEscape(QString& str, const QHash<QChar,QChar> &repl)
  ************************************************/
 QString &unEscape(QString& str)
 {
-    QHash<QChar,QChar> repl;
-    repl.insert('\\', '\\');
-    repl.insert('s',  ' ');
-    repl.insert('n',  '\n');
-    repl.insert('t',  '\t');
-    repl.insert('r',  '\r');
+    int n = str.indexOf('\\');
+    if (n < 0)
+        return str;
 
-    return doUnEscape(str, repl);
-}
+    QString res = str.left(n);
+    res.reserve(str.length());
+    const int len = str.length();
+    while (n < len)
+    {
+        const QChar c = str.at(n);
+        if (c == '\\' && n < len - 1)
+        {
+            switch (str.at(n+1).unicode())
+            {
+            case '\\': res += '\\'; n += 2; continue;
+            case 's':  res += ' ';  n += 2; continue;
+            case 'n':  res += '\n'; n += 2; continue;
+            case 't':  res += '\t'; n += 2; continue;
+            case 'r':  res += '\r'; n += 2; continue;
+            }
+        }
+
+        res += c;
+        ++n;
+    }
 
+    str = res;
+    return str;
+}
 
 
 /************************************************
@@ -233,38 +300,214 @@ QString &unEscapeExec(QString& str)
     return doUnEscape(str, repl);
 }
 
-enum Triple {
-    Undef,
-    True,
-    False
-};
+/************************************************
+
+ ************************************************/
+XdgDesktopFileData::XdgDesktopFileData():
+    mIsValid(false),
+    mKeepTranslations(true),
+    mOnlyShowIn(0),
+    mNotShowIn(0),
+    mHasOnlyShowIn(false),
+    mNoDisplay(false),
+    mHidden(false),
+    mTerminal(false)
+{
+}
+
+
+typedef QSet<QString> XdgStringPool;
+Q_GLOBAL_STATIC(XdgStringPool, stringPool)
+Q_GLOBAL_STATIC(QReadWriteLock, stringPoolLock)
+
+/************************************************
+ The files can be parsed from several threads, most
+ of the names are already in the pool, so the pool
+ is locked for writing only for the new names.
+ ************************************************/
+QString internString(const QString& str)
+{
+    XdgStringPool* pool = stringPool();
+    {
+        QReadLocker locker(stringPoolLock());
+        XdgStringPool::const_iterator i = pool->constFind(str);
+        if (i != pool->constEnd())
+            return *i;
+    }
+
+    QWriteLocker locker(stringPoolLock());
+    XdgStringPool::const_iterator i = pool->constFind(str);
+    if (i != pool->constEnd())
+        return *i;
+
+    pool->insert(str);
+    return str;
+}
+
+
+/************************************************
+ LC_MESSAGES value	Possible keys in order of matching
+ lang_COUNTRY@MODIFIER	lang_COUNTRY@MODIFIER, lang_COUNTRY, lang@MODIFIER, lang,
+                        default value
+ lang_COUNTRY	        lang_COUNTRY, lang, default value
+ lang@MODIFIER	        lang@MODIFIER, lang, default value
+ lang	                lang, default value
+ ************************************************/
+static QStringList buildLocaleNames()
+{
+    QString lang = getenv("LC_MESSAGES");
+
+    if (lang.isEmpty())
+        lang = getenv("LC_ALL");
+
+    if (lang.isEmpty())
+         lang = getenv("LANG");
+
+
+    QString modifier = lang.section('@', 1);
+    if (!modifier.isEmpty())
+        lang.truncate(lang.length() - modifier.length() - 1);
+
+    QString encoding = lang.section('.', 1);
+    if (!encoding.isEmpty())
+        lang.truncate(lang.length() - encoding.length() - 1);
+
+
+    QString country = lang.section('_', 1);
+    if (!country.isEmpty())
+        lang.truncate(lang.length() - country.length() - 1);
+
+
+    QStringList res;
+    if (lang.isEmpty())
+        return res;
+
+    if (!modifier.isEmpty() && !country.isEmpty())
+        res << QString("%1_%2@%3").arg(lang, country, modifier);
+
+    if (!country.isEmpty())
+        res << QString("%1_%2").arg(lang, country);
+
+    if (!modifier.isEmpty())
+        res << QString("%1@%2").arg(lang, modifier);
+
+    res << lang;
+    return res;
+}
+
 
-class XdgDesktopFileData: public QSharedData {
-public:
-    XdgDesktopFileData();
-    bool read(const QString &prefix);
-    XdgDesktopFile::Type detectType(XdgDesktopFile *q) const;
-    bool startApplicationDetached(const XdgDesktopFile *q, const QStringList& urls) const;
-    bool startLinkDetached(const XdgDesktopFile *q) const;
+/************************************************
 
-    QString mFileName;
-    bool mIsValid;
-    mutable bool mValidIsChecked;
-    mutable Triple mIsShow;
-    QMap<QString, QVariant> mItems;
+ ************************************************/
+static QList<QByteArray> buildLocaleNamesLatin1()
+{
+    QList<QByteArray> res;
+    foreach (QString name, XdgDesktopFile::localeNames())
+        res << name.toLatin1();
 
-    XdgDesktopFile::Type mType;
-};
+    return res;
+}
+
+Q_GLOBAL_STATIC_WITH_ARGS(QStringList, localeNamesInstance, (buildLocaleNames()))
+Q_GLOBAL_STATIC_WITH_ARGS(QList<QByteArray>, localeNamesLatin1Instance, (buildLocaleNamesLatin1()))
 
 
 /************************************************
 
  ************************************************/
-XdgDesktopFileData::XdgDesktopFileData():
-    mIsValid(false),
-    mValidIsChecked(false),
-    mIsShow(Undef)
+QStringList XdgDesktopFile::localeNames()
+{
+    return *localeNamesInstance();
+}
+
+
+/************************************************
+
+ ************************************************/
+int localeRank(const char* locale, int length)
 {
+    const QList<QByteArray>& names = *localeNamesLatin1Instance();
+    for (int i=0; i<names.count(); ++i)
+    {
+        if (names.at(i).size() == length && memcmp(names.at(i).constData(), locale, length) == 0)
+            return i;
+    }
+
+    return -1;
+}
+
+
+/************************************************
+
+ ************************************************/
+int localeRank(const QString& locale)
+{
+    return localeNamesInstance()->indexOf(locale);
+}
+
+
+/************************************************
+ Splits "Key[locale]" to the "Key" and "locale" parts.
+ ************************************************/
+static bool splitLocalizedKey(const QString& localizedKey, QString* key, QString* locale)
+{
+    if (!localizedKey.endsWith(']'))
+        return false;
+
+    int n = localizedKey.indexOf('[');
+    if (n < 1)
+        return false;
+
+    *key = localizedKey.left(n);
+    *locale = localizedKey.mid(n + 1, localizedKey.length() - n - 2);
+    return true;
+}
+
+
+/************************************************
+ The KDE modifiers like URL[$e] are not translations.
+ ************************************************/
+static inline bool isLocaleName(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+
+/************************************************
+
+ ************************************************/
+static bool localizedLessThan(const XdgDesktopFileLocalizedItem& a, const XdgDesktopFileLocalizedItem& b)
+{
+    int res = QString::compare(a.group, b.group);
+    if (res == 0)
+        res = QString::compare(a.key, b.key);
+
+    if (res == 0)
+        return a.rank < b.rank;
+
+    return res < 0;
+}
+
+
+/************************************************
+
+ ************************************************/
+static bool itemLessThan(const XdgDesktopFileItem& a, const XdgDesktopFileItem& b)
+{
+    int res = QString::compare(a.group, b.group);
+    if (res == 0)
+        res = QString::compare(a.key, b.key);
+
+    return res < 0;
+}
+
+
+/************************************************
+
+ ************************************************/
+static inline bool isSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\v' || c == '\f';
 }
 
 
@@ -275,42 +518,166 @@ bool XdgDesktopFileData::read(const QString &prefix)
 {
     QFile file(mFileName);
 
-    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+    if (!file.open(QIODevice::ReadOnly))
         return false;
 
+    return parse(file.readAll(), prefix);
+}
+
+
+/************************************************
+ One pass over the raw file content. The group and key
+ names are interned, the values are unescaped here once,
+ so the value() doesn't need to do it on every call.
+ ************************************************/
+bool XdgDesktopFileData::parse(const QByteArray& content, const QString &prefix)
+{
+    QVector<XdgDesktopFileItem> items;
+    // The translations for the current locales, the index is the position in the translations.
+    QVector<XdgDesktopFileItem> translations;
+    QVector<XdgDesktopFileLocalizedItem> localized;
     QString section;
-    QTextStream stream(&file);
     bool prefixExists = false;
-    while (!stream.atEnd()) {
-        QString line = stream.readLine().trimmed();
 
-        // Skip comments ......................
-        if (line.startsWith('#'))
+    const char* p   = content.constData();
+    const char* end = p + content.size();
+
+    while (p < end)
+    {
+        const char* b = p;
+        const char* e = static_cast<const char*>(memchr(p, '\n', end - p));
+        if (!e)
+            e = end;
+        p = e + 1;
+
+        while (b < e && isSpace(*b))
+            ++b;
+
+        while (e > b && isSpace(*(e-1)))
+            --e;
+
+        // Skip empty lines and comments .......
+        if (b == e || *b == '#')
             continue;
 
 
         // Section ..............................
-        if (line.startsWith('[') && line.endsWith(']'))
+        if (*b == '[' && *(e-1) == ']' && e - b > 1)
         {
-            section = line.mid(1, line.length()-2);
+            section = internString(QString::fromUtf8(b + 1, e - b - 2));
             if (section == prefix)
                 prefixExists = true;
 
             continue;
         }
 
-        QString key = line.section('=', 0, 0).trimmed();
-        QString value = line.section('=', 1).trimmed();
+        const char* eq = static_cast<const char*>(memchr(b, '=', e - b));
+        const char* keyEnd = eq ? eq : e;
+        while (keyEnd > b && isSpace(*(keyEnd-1)))
+            --keyEnd;
+
+        if (keyEnd == b)
+            continue;
+
+        // Localized key .......................
+        int rank = -1;
+        const char* baseEnd = keyEnd;
+        if (*(keyEnd-1) == ']')
+        {
+            const char* lb = static_cast<const char*>(memchr(b, '[', keyEnd - b));
+            if (lb && lb > b)
+            {
+                rank = localeRank(lb + 1, keyEnd - lb - 2);
+                // Translations for other locales are not needed
+                if (rank < 0 && isLocaleName(lb[1]) && !mKeepTranslations)
+                    continue;
+
+                baseEnd = lb;
+            }
+        }
+
+        QString key = internString(QString::fromUtf8(b, keyEnd - b));
+
+        QString value;
+        if (eq)
+        {
+            const char* vb = eq + 1;
+            const char* ve = e;
+            while (vb < ve && isSpace(*vb))
+                ++vb;
+
+            // Remove quotes ........................
+            if (ve - vb > 1 &&
+                ((*vb == '"'  && *(ve-1) == '"') ||
+                 (*vb == '\'' && *(ve-1) == '\'')))
+            {
+                ++vb;
+                --ve;
+            }
+
+            value = QString::fromUtf8(vb, ve - vb);
+            unEscape(value);
+        }
+
+        if (rank < 0)
+        {
+            items.append(XdgDesktopFileItem(section, key, QVariant(value)));
+            continue;
+        }
+
+        QString baseKey = internString(QString::fromUtf8(b, baseEnd - b));
+        localized.append(XdgDesktopFileLocalizedItem(section, baseKey, translations.count(), rank));
+        translations.append(XdgDesktopFileItem(section, key, QVariant(value)));
+    }
+
 
-        if (key.isEmpty())
+    // Only the best translations are stored if the others
+    // aren't kept. The duplicate keys are all stored, the
+    // last value wins below.
+    qStableSort(localized.begin(), localized.end(), localizedLessThan);
+    int best = -1;
+    for (int i=0; i<localized.count(); ++i)
+    {
+        const XdgDesktopFileLocalizedItem& item = localized.at(i);
+        if (best < 0 ||
+            localized.at(best).key   != item.key ||
+            localized.at(best).group != item.group)
+        {
+            best = i;
+        }
+
+        if (mKeepTranslations || item.rank == localized.at(best).rank)
+            items.append(translations.at(item.index));
+    }
+
+
+    // Sort the items, for the duplicate keys the last value wins.
+    qStableSort(items.begin(), items.end(), itemLessThan);
+    mItems.clear();
+    mItems.reserve(items.count());
+    for (int i=0; i<items.count(); ++i)
+    {
+        if (i+1 < items.count() &&
+            items.at(i).key   == items.at(i+1).key &&
+            items.at(i).group == items.at(i+1).group)
             continue;
 
-        // Remove quotes ........................
-        if ((value.startsWith('"') && value.endsWith('"')) ||
-            (value.startsWith('\'') && value.endsWith('\'')))
-            value = value.mid(1, value.length()-2);
+        mItems.append(items.at(i));
+    }
+
+
+    // Refer the best translation for every key.
+    mLocalized.clear();
+    for (int i=0; i<localized.count(); ++i)
+    {
+        const XdgDesktopFileLocalizedItem& item = localized.at(i);
+        if (!mLocalized.isEmpty() &&
+            mLocalized.last().key   == item.key &&
+            mLocalized.last().group == item.group)
+            continue;
 
-        mItems[section + "/" + key] = QVariant(value);
+        int index = indexOf(item.group, translations.at(item.index).key);
+        mLocalized.append(XdgDesktopFileLocalizedItem(item.group, item.key, index, item.rank));
     }
 
 
@@ -320,6 +687,256 @@ bool XdgDesktopFileData::read(const QString &prefix)
 }
 
 
+/************************************************
+ Returns the position of the first item that is not
+ less than group/key.
+ ************************************************/
+template<class Item>
+static int itemsLowerBound(const QVector<Item>& items, const QString& group, const QString& key)
+{
+    int first = 0;
+    int count = items.count();
+
+    while (count > 0)
+    {
+        int step = count / 2;
+        int mid = first + step;
+        const Item& item = items.at(mid);
+
+        int res = QString::compare(item.group, group);
+        if (res == 0)
+            res = QString::compare(item.key, key);
+
+        if (res < 0)
+        {
+            first = mid + 1;
+            count -= step + 1;
+        }
+        else
+        {
+            count = step;
+        }
+    }
+
+    return first;
+}
+
+
+/************************************************
+
+ ************************************************/
+int XdgDesktopFileData::lowerBound(const QString& group, const QString& key) const
+{
+    return itemsLowerBound(mItems, group, key);
+}
+
+
+/************************************************
+ Returns the position of the item in mItems, or -1.
+ ************************************************/
+int XdgDesktopFileData::indexOf(const QString& group, const QString& key) const
+{
+    int n = lowerBound(group, key);
+    if (n < mItems.count() &&
+        mItems.at(n).key == key &&
+        mItems.at(n).group == group)
+        return n;
+
+    return -1;
+}
+
+
+/************************************************
+
+ ************************************************/
+const QVariant* XdgDesktopFileData::find(const QString& group, const QString& key) const
+{
+    int n = lowerBound(group, key);
+    if (n < mItems.count())
+    {
+        const XdgDesktopFileItem& item = mItems.at(n);
+        if (item.key == key && item.group == group)
+            return &item.value;
+    }
+
+    return 0;
+}
+
+
+/************************************************
+ The translations refer the items by the positions,
+ so they are shifted, and the best one is selected
+ again if the key is a translation.
+ ************************************************/
+void XdgDesktopFileData::insert(const QString& group, const QString& key, const QVariant& value)
+{
+    int n = lowerBound(group, key);
+    if (n < mItems.count() &&
+        mItems.at(n).key == key &&
+        mItems.at(n).group == group)
+    {
+        mItems[n].value = value;
+        return;
+    }
+
+    mItems.insert(n, XdgDesktopFileItem(internString(group), internString(key), value));
+    for (int i=0; i<mLocalized.count(); ++i)
+    {
+        if (mLocalized.at(i).index >= n)
+            ++mLocalized[i].index;
+    }
+
+    QString baseKey, locale;
+    if (splitLocalizedKey(key, &baseKey, &locale))
+        selectLocalized(group, baseKey);
+}
+
+
+/************************************************
+
+ ************************************************/
+void XdgDesktopFileData::remove(const QString& group, const QString& key)
+{
+    int n = indexOf(group, key);
+    if (n < 0)
+        return;
+
+    mItems.remove(n);
+    for (int i=0; i<mLocalized.count(); ++i)
+    {
+        if (mLocalized.at(i).index > n)
+            --mLocalized[i].index;
+    }
+
+    QString baseKey, locale;
+    if (splitLocalizedKey(key, &baseKey, &locale))
+        selectLocalized(group, baseKey);
+}
+
+
+/************************************************
+
+ ************************************************/
+const XdgDesktopFileLocalizedItem* XdgDesktopFileData::findLocalized(const QString& group, const QString& key) const
+{
+    int n = itemsLowerBound(mLocalized, group, key);
+    if (n < mLocalized.count())
+    {
+        const XdgDesktopFileLocalizedItem& item = mLocalized.at(n);
+        if (item.key == key && item.group == group)
+            return &item;
+    }
+
+    return 0;
+}
+
+
+/************************************************
+ Selects the best of the stored translations for
+ the key, see localeNames() for the order.
+ ************************************************/
+void XdgDesktopFileData::selectLocalized(const QString& group, const QString& key)
+{
+    int n = itemsLowerBound(mLocalized, group, key);
+    if (n < mLocalized.count() &&
+        mLocalized.at(n).key == key &&
+        mLocalized.at(n).group == group)
+    {
+        mLocalized.remove(n);
+    }
+
+    const QStringList names = XdgDesktopFile::localeNames();
+    for (int i=0; i<names.count(); ++i)
+    {
+        int index = indexOf(group, QString("%1[%2]").arg(key, names.at(i)));
+        if (index > -1)
+        {
+            mLocalized.insert(n, XdgDesktopFileLocalizedItem(internString(group), internString(key), index, i));
+            return;
+        }
+    }
+}
+
+
+/************************************************
+ Returns true if the key is a translation which may
+ be in the file, but wasn't stored.
+ ************************************************/
+static bool isTranslation(const QString& key)
+{
+    QString baseKey, locale;
+    return splitLocalizedKey(key, &baseKey, &locale) &&
+           !locale.isEmpty() && isLocaleName(locale.at(0).toLatin1());
+}
+
+bool XdgDesktopFileData::isDropped(const QString& key) const
+{
+    return !mKeepTranslations && isTranslation(key);
+}
+
+
+/************************************************
+ The file is read again and the translations which
+ were not stored are added, the other items are
+ left as they are.
+ ************************************************/
+void XdgDesktopFileData::loadTranslations()
+{
+    if (mKeepTranslations)
+        return;
+
+    mKeepTranslations = true;
+
+    XdgDesktopFileData full;
+    full.mFileName = mFileName;
+    if (!full.read(QString()))
+        return;
+
+    foreach (const XdgDesktopFileItem& item, full.mItems)
+    {
+        if (isTranslation(item.key) && indexOf(item.group, item.key) < 0)
+            insert(item.group, item.key, item.value);
+    }
+}
+
+
+/************************************************
+ Returns the copy having all the translations, the
+ cached files are shared, so they are not changed.
+ ************************************************/
+XdgDesktopFileData XdgDesktopFileData::withTranslations() const
+{
+    XdgDesktopFileData res(*this);
+    res.loadTranslations();
+    return res;
+}
+
+
+/************************************************
+ The keys are "Key" when the prefix is set, and
+ "Group/Key" otherwise.
+ ************************************************/
+static inline void splitKey(const QString& prefix, const QString& path, QString* group, QString* key)
+{
+    if (!prefix.isEmpty())
+    {
+        *group = prefix;
+        *key = path;
+        return;
+    }
+
+    int n = path.indexOf('/');
+    if (n < 0)
+    {
+        *key = path;
+        return;
+    }
+
+    *group = path.left(n);
+    *key = path.mid(n + 1);
+}
+
+
 /************************************************
 
  ************************************************/
@@ -473,7 +1090,10 @@ XdgDesktopFile& XdgDesktopFile::operator=(const XdgDesktopFile& other)
  ************************************************/
 bool XdgDesktopFile::operator==(const XdgDesktopFile &other) const
 {
-    return d->mItems == other.d->mItems;
+    if (d->mKeepTranslations && other.d->mKeepTranslations)
+        return d->mItems == other.d->mItems;
+
+    return d->withTranslations().mItems == other.d->withTranslations().mItems;
 }
 
 
@@ -484,6 +1104,7 @@ bool XdgDesktopFile::load(const QString& fileName)
 {
     d->mFileName = fileName;
     d->read(prefix());
+    d->decode(prefix());
     d->mIsValid = d->mIsValid && check();
     d->mType = d->detectType(this);
     return isValid();
@@ -491,26 +1112,27 @@ bool XdgDesktopFile::load(const QString& fileName)
 
 
 /************************************************
-
+ The translations not stored by the cache are saved
+ too, they are read from the file.
  ************************************************/
 bool XdgDesktopFile::save(QIODevice *device) const
 {
     QTextStream stream(device);
-    QMap<QString, QVariant>::const_iterator i = d->mItems.constBegin();
+    stream.setCodec("UTF-8");
 
+    const XdgDesktopFileData data = d->withTranslations();
     QString section;
-    while (i != d->mItems.constEnd())
+    for (int i=0; i<data.mItems.count(); ++i)
     {
-        QString path = i.key();
-        QString sect =  path.section('/',0,0);
-        if (sect != section)
+        const XdgDesktopFileItem& item = data.mItems.at(i);
+        if (item.group != section)
         {
-            section = sect;
+            section = item.group;
             stream << "[" << section << "]" << endl;
         }
-        QString key = path.section('/', 1);
-        stream << key << "=" << i.value().toString() << endl;
-        ++i;
+
+        QString value = item.value.toString();
+        stream << item.key << "=" << escape(value) << endl;
     }
     return true;
 }
@@ -530,19 +1152,27 @@ bool XdgDesktopFile::save(const QString &fileName) const
 
 
 /************************************************
-
+ The cache stores only the best translations, the
+ file is read for the other ones.
  ************************************************/
 QVariant XdgDesktopFile::value(const QString& key, const QVariant& defaultValue) const
 {
-    QString path = (!prefix().isEmpty()) ? prefix() + "/" + key : key;
-    QVariant res = d->mItems.value(path, defaultValue);
-    if (res.type() == QVariant::String)
+    QString group, name;
+    splitKey(prefix(), key, &group, &name);
+
+    const QVariant* res = d->find(group, name);
+    if (res)
+        return *res;
+
+    if (d->isDropped(name))
     {
-        QString s = res.toString();
-        return unEscape(s);
+        const XdgDesktopFileData data = d->withTranslations();
+        res = data.find(group, name);
+        if (res)
+            return *res;
     }
 
-    return res;
+    return defaultValue;
 }
 
 
@@ -551,22 +1181,24 @@ QVariant XdgDesktopFile::value(const QString& key, const QVariant& defaultValue)
  ************************************************/
 void XdgDesktopFile::setValue(const QString &key, const QVariant &value)
 {
-    QString path = (!prefix().isEmpty()) ? prefix() + "/" + key : key;
-    if (value.type() == QVariant::String)
-    {
-
-        QString s=value.toString();
-        if (key.toUpper() == "EXEC")
-            escapeExec(s);
-        else
-            escape(s);
+    QString group, name;
+    splitKey(prefix(), key, &group, &name);
 
-        d->mItems[path] = QVariant(s);
-    }
-    else
+    QVariant v = value;
+    if (value.type() == QVariant::String && name.toUpper() == "EXEC")
     {
-        d->mItems[path] = value;
+        // The Exec value keeps quoting, expandExecString() undoes it.
+        QString s = value.toString();
+        escapeExec(s);
+        v = QVariant(unEscape(s));
     }
+
+    // The file is completed first, the saved file keeps its translations.
+    d->loadTranslations();
+    d->insert(group, name, v);
+
+    if (group == prefix() && XdgDesktopFileData::isDecodedKey(name))
+        d->decode(prefix());
 }
 
 
@@ -580,86 +1212,35 @@ void XdgDesktopFile::setLocalizedValue(const QString &key, const QVariant &value
 
 
 /************************************************
- LC_MESSAGES value	Possible keys in order of matching
- lang_COUNTRY@MODIFIER	lang_COUNTRY@MODIFIER, lang_COUNTRY, lang@MODIFIER, lang,
-                        default value
- lang_COUNTRY	        lang_COUNTRY, lang, default value
- lang@MODIFIER	        lang@MODIFIER, lang, default value
- lang	                lang, default value
+ The best translation is selected when the file is
+ parsed, see localeNames() for the order of matching.
  ************************************************/
 QString XdgDesktopFile::localizedKey(const QString& key) const
 {
-    QString lang = getenv("LC_MESSAGES");
-
-    if (lang.isEmpty())
-        lang = getenv("LC_ALL");
-
-    if (lang.isEmpty())
-         lang = getenv("LANG");
-
-
-    QString modifier = lang.section('@', 1);
-    if (!modifier.isEmpty())
-        lang.truncate(lang.length() - modifier.length() - 1);
-
-    QString encoding = lang.section('.', 1);
-    if (!encoding.isEmpty())
-        lang.truncate(lang.length() - encoding.length() - 1);
-
-
-    QString country = lang.section('_', 1);
-    if (!country.isEmpty())
-        lang.truncate(lang.length() - country.length() - 1);
-
-
-
-    //qDebug() << "LC_MESSAGES: " << getenv("LC_MESSAGES");
-    //qDebug() << "Lang:" << lang;
-    //qDebug() << "Country:" << country;
-    //qDebug() << "Encoding:" << encoding;
-    //qDebug() << "Modifier:" << modifier;
-
-
-    if (!modifier.isEmpty() && !country.isEmpty())
-    {
-        QString k = QString("%1[%2_%3@%4]").arg(key, lang, country, modifier);
-        //qDebug() << "\t try " << k << contains(k);
-        if (contains(k))
-            return k;
-    }
-
-    if (!country.isEmpty())
-    {
-        QString k = QString("%1[%2_%3]").arg(key, lang, country);
-        //qDebug() << "\t try " << k  << contains(k);
-        if (contains(k))
-            return k;
-    }
-
-    if (!modifier.isEmpty())
-    {
-        QString k = QString("%1[%2@%3]").arg(key, lang, modifier);
-        //qDebug() << "\t try " << k  << contains(k);
-        if (contains(k))
-            return k;
-    }
-
-    QString k = QString("%1[%2]").arg(key, lang);
-    //qDebug() << "\t try " << k  << contains(k);
-    if (contains(k))
-        return k;
+    QString group, name;
+    splitKey(prefix(), key, &group, &name);
 
+    const XdgDesktopFileLocalizedItem* item = d->findLocalized(group, name);
+    if (item)
+        return QString("%1[%2]").arg(key, localeNames().at(item->rank));
 
-    //qDebug() << "\t try " << key  << contains(key);
     return key;
 }
 
+
 /************************************************
 
  ************************************************/
 QVariant XdgDesktopFile::localizedValue(const QString& key, const QVariant& defaultValue) const
 {
-    return value(localizedKey(key), defaultValue);
+    QString group, name;
+    splitKey(prefix(), key, &group, &name);
+
+    const XdgDesktopFileLocalizedItem* item = d->findLocalized(group, name);
+    if (item)
+        return d->localizedValue(*item);
+
+    return value(key, defaultValue);
 }
 
 
@@ -668,8 +1249,13 @@ QVariant XdgDesktopFile::localizedValue(const QString& key, const QVariant& defa
  ************************************************/
 void XdgDesktopFile::removeEntry(const QString& key)
 {
-    QString path = (!prefix().isEmpty()) ? prefix() + "/" + key : key;
-    d->mItems.remove(path);
+    QString group, name;
+    splitKey(prefix(), key, &group, &name);
+    d->loadTranslations();
+    d->remove(group, name);
+
+    if (group == prefix() && XdgDesktopFileData::isDecodedKey(name))
+        d->decode(prefix());
 }
 
 
@@ -678,8 +1264,12 @@ void XdgDesktopFile::removeEntry(const QString& key)
  ************************************************/
 bool XdgDesktopFile::contains(const QString& key) const
 {
-    QString path = (!prefix().isEmpty()) ? prefix() + "/" + key : key;
-    return d->mItems.contains(path);
+    QString group, name;
+    splitKey(prefix(), key, &group, &name);
+    if (d->find(group, name))
+        return true;
+
+    return d->isDropped(name) && d->withTranslations().find(group, name) != 0;
 }
 
 
@@ -810,6 +1400,112 @@ static QStringList parseCombinedArgString(const QString &program)
 }
 
 
+/************************************************
+ The values used by the menu builder and the rules are
+ decoded once, so the checks don't touch the strings.
+ ************************************************/
+void XdgDesktopFileData::decode(const QString &prefix)
+{
+    // Categories ..........................
+    mCategories.clear();
+    const QVariant* v = find(prefix, "Categories");
+    if (v)
+    {
+        foreach (QString category, v->toString().split(';', QString::SkipEmptyParts))
+            mCategories << XdgDesktopFile::categoryId(category);
+
+        qSort(mCategories);
+    }
+
+    // OnlyShowIn & NotShowIn ..............
+    v = find(prefix, "OnlyShowIn");
+    mHasOnlyShowIn = (v != 0);
+    mOnlyShowIn = v ? XdgDesktopFile::environmentMask(v->toString().split(';', QString::SkipEmptyParts)) : 0;
+
+    v = find(prefix, "NotShowIn");
+    mNotShowIn = v ? XdgDesktopFile::environmentMask(v->toString().split(';', QString::SkipEmptyParts)) : 0;
+
+    // Flags ...............................
+    v = find(prefix, "NoDisplay");
+    mNoDisplay = v && v->toBool();
+
+    v = find(prefix, "Hidden");
+    mHidden = v && v->toBool();
+
+    v = find(prefix, "Terminal");
+    mTerminal = v && v->toBool();
+
+    // Exec ................................
+    mExecArgs.clear();
+    v = find(prefix, "Exec");
+    if (v)
+    {
+        QString execStr = v->toString();
+        unEscapeExec(execStr);
+        mExecArgs = parseCombinedArgString(execStr);
+
+        // The parseCombinedArgString() splits the string by the space symbols,
+        // we temporarily replaced them on the special characters.
+        // Now we reverse it.
+        for (QStringList::Iterator i=mExecArgs.begin(); i!=mExecArgs.end(); ++i)
+        {
+            i->replace(01, ' ');
+            i->replace(02, '\t');
+            i->replace(03, '\n');
+        }
+    }
+}
+
+
+/************************************************
+
+ ************************************************/
+bool XdgDesktopFileData::isDecodedKey(const QString& key)
+{
+    return key == "Categories" ||
+           key == "OnlyShowIn" ||
+           key == "NotShowIn"  ||
+           key == "NoDisplay"  ||
+           key == "Hidden"     ||
+           key == "Terminal"   ||
+           key == "Exec";
+}
+
+
+/************************************************
+ The group and key names are interned, so only
+ the values are counted.
+ ************************************************/
+static inline qint64 variantSize(const QVariant& value)
+{
+    if (value.type() == QVariant::String)
+        return value.toString().capacity() * sizeof(QChar);
+
+    return 0;
+}
+
+
+/************************************************
+
+ ************************************************/
+qint64 XdgDesktopFileData::approximateSize() const
+{
+    qint64 res = sizeof(XdgDesktopFileData) + mFileName.capacity() * sizeof(QChar);
+
+    res += mItems.capacity() * sizeof(XdgDesktopFileItem);
+    foreach (const XdgDesktopFileItem& item, mItems)
+        res += variantSize(item.value);
+
+    res += mLocalized.capacity() * sizeof(XdgDesktopFileLocalizedItem);
+
+    res += mCategories.capacity() * sizeof(int);
+    foreach (const QString& arg, mExecArgs)
+        res += sizeof(QString) + arg.capacity() * sizeof(QChar);
+
+    return res;
+}
+
+
 /************************************************
 
  ************************************************/
@@ -883,19 +1579,8 @@ QStringList XdgDesktopFile::expandExecString(const QStringList& urls) const
 
     QStringList result;
 
-    QString execStr = value("Exec").toString();
-    unEscapeExec(execStr);
-    QStringList tokens = parseCombinedArgString(execStr);
-
-    foreach (QString token, tokens)
+    foreach (const QString& token, d->mExecArgs)
     {
-        // The parseCombinedArgString() splits the string by the space symbols,
-        // we temporarily replaced them on the special characters.
-        // Now we reverse it.
-        token.replace(01, ' ');
-        token.replace(02, '\t');
-        token.replace(03, '\n');
-
         // ----------------------------------------------------------
         // A single file name, even if multiple files are selected.
         if (token == "%f")
@@ -996,18 +1681,7 @@ QStringList XdgDesktopFile::expandExecString(const QStringList& urls) const
  ************************************************/
 bool checkTryExec(const QString& progName)
 {
-    if (progName.startsWith(QDir::separator()))
-        return QFileInfo(progName).isExecutable();
-
-    QStringList dirs = QString(getenv("PATH")).split(":");
-
-    foreach (QString dir, dirs)
-    {
-        if (QFileInfo(QDir(dir), progName).isExecutable())
-            return true;
-    }
-
-    return false;
+    return XdgPathIndex::isExecutable(progName);
 }
 
 
@@ -1016,20 +1690,12 @@ bool checkTryExec(const QString& progName)
  ************************************************/
 bool XdgDesktopFile::isShow(const QString& environment) const
 {
-    if (d->mIsShow != Undef)
-        return d->mIsShow == True;
-
-    d->mIsShow = False;
     // Means "this application exists, but don't display it in the menus".
-    if (value("NoDisplay").toBool())
+    if (d->mNoDisplay)
         return false;
 
     // The file is inapplicable to the current environment
-    if (!isApplicable(true, environment))
-        return false;
-
-    d->mIsShow = True;
-    return true;
+    return isApplicable(true, environment);
 }
 
 
@@ -1040,26 +1706,13 @@ bool XdgDesktopFile::isApplicable(bool excludeHidden, const QString& environment
 {
     // Hidden should have been called Deleted. It means the user deleted
     // (at his level) something that was present
-    if (excludeHidden && value("Hidden").toBool())
+    if (excludeHidden && d->mHidden)
         return false;
 
     // A list of strings identifying the environments that should display/not
     // display a given desktop entry.
-    // OnlyShowIn ........
-    if (contains("OnlyShowIn"))
-    {
-        QString s = ";" + value("OnlyShowIn").toString() + ";";
-        if (!s.contains(environment))
-            return false;
-    }
-
-    // NotShowIn .........
-    if (contains("NotShowIn"))
-    {
-        QString s = ";" + value("NotShowIn").toString() + ";";
-        if (s.contains(environment))
-            return false;
-    }
+    if (!isShownIn(QStringList(environment)))
+        return false;
 
     // actually installed. If not, entry may not show in menus, etc.
     QString s = value("TryExec").toString();
@@ -1073,207 +1726,211 @@ bool XdgDesktopFile::isApplicable(bool excludeHidden, const QString& environment
 /************************************************
 
  ************************************************/
-QString expandDynamicUrl(QString url)
+QStringList XdgDesktopFile::execArgs() const
 {
-    for (int i=0; environ[i]; i++)
-    {
-        QString line(environ[i]);
-        QString name = line.section("=", 0, 0);
-        QString val =  line.section("=", 1);
-        url.replace(QString("$%1").arg(name), val);
-        url.replace(QString("${%1}").arg(name), val);
-    }
-
-    return url;
+    return d->mExecArgs;
 }
 
 
+typedef QHash<QString, int> XdgNameIdHash;
+Q_GLOBAL_STATIC(XdgNameIdHash, categoryIdHash)
+Q_GLOBAL_STATIC(XdgNameIdHash, environmentBitHash)
+Q_GLOBAL_STATIC(QMutex, nameIdMutex)
+
 /************************************************
 
  ************************************************/
-QString XdgDesktopFile::url() const
+int XdgDesktopFile::categoryId(const QString& category)
 {
-    if (type() != LinkType)
-        return QString();
+    QMutexLocker locker(nameIdMutex());
+    XdgNameIdHash* hash = categoryIdHash();
 
-   QString url;
+    XdgNameIdHash::ConstIterator i = hash->constFind(category);
+    if (i != hash->constEnd())
+        return i.value();
 
-   url = value("URL").toString();
-   if (!url.isEmpty())
-   return url;
+    int id = hash->count();
+    hash->insert(category, id);
+    return id;
+}
 
-    // WTF? What standard describes it?
-    url = expandDynamicUrl(value("URL[$e]").toString());
-    if (!url.isEmpty())
-        return url;
 
-    return QString();
-}
+/************************************************
 
+ ************************************************/
+QVector<int> XdgDesktopFile::categoryIds() const
+{
+    return d->mCategories;
+}
 
 
 /************************************************
 
  ************************************************/
-QString findDesktopFile(const QString& dirName, const QString& desktopName)
+bool XdgDesktopFile::hasCategory(int categoryId) const
 {
-    QDir dir(dirName);
-    QFileInfo fi(dir, desktopName);
+    return qBinaryFind(d->mCategories.constBegin(), d->mCategories.constEnd(), categoryId) != d->mCategories.constEnd();
+}
+
+
+/************************************************
+ The last bit is shared by all the names which came
+ after the others have been taken.
+ ************************************************/
+#define ENVIRONMENT_OVERFLOW_BIT (Q_UINT64_C(1) << 63)
 
-    if (fi.exists())
-        return fi.canonicalFilePath();
+quint64 XdgDesktopFile::environmentMask(const QStringList& environments)
+{
+    QMutexLocker locker(nameIdMutex());
+    XdgNameIdHash* hash = environmentBitHash();
 
-    // Working recursively ............
-    QFileInfoList dirs = dir.entryInfoList(QStringList(), QDir::Dirs | QDir::NoDotAndDotDot);
-    foreach (QFileInfo d, dirs)
+    quint64 res = 0;
+    foreach (QString env, environments)
     {
-        QString cn = d.canonicalFilePath();
-        if (dirName != cn)
+        XdgNameIdHash::ConstIterator i = hash->constFind(env);
+        if (i != hash->constEnd())
+        {
+            res |= Q_UINT64_C(1) << i.value();
+            continue;
+        }
+
+        if (hash->count() == 63)
         {
-            QString f = findDesktopFile(cn, desktopName);
-            if (!f.isEmpty())
-                return f;
+            res |= ENVIRONMENT_OVERFLOW_BIT;
+            continue;
         }
+
+        int bit = hash->count();
+        hash->insert(env, bit);
+        res |= Q_UINT64_C(1) << bit;
     }
 
-    return QString();
+    return res;
 }
 
 
 /************************************************
-
+ A name of the file without its own bit never equals
+ a name having one, so the bits are enough unless the
+ checked environments have a name without the bit.
  ************************************************/
-QString findDesktopFile(const QString& desktopName)
+bool XdgDesktopFile::isShownIn(const QStringList& environments, quint64 environmentMask) const
 {
-    QStringList dataDirs = XdgDirs::dataDirs();
-    dataDirs.prepend(XdgDirs::dataHome(false));
-
-    foreach (QString dirName, dataDirs)
+    if (environmentMask & ENVIRONMENT_OVERFLOW_BIT)
     {
-        QString f = findDesktopFile(dirName + "/applications", desktopName);
-        if (!f.isEmpty())
-            return f;
+        // OnlyShowIn ........
+        if (d->mHasOnlyShowIn)
+        {
+            bool found = false;
+            foreach (QString env, value("OnlyShowIn").toString().split(';', QString::SkipEmptyParts))
+            {
+                if (environments.contains(env))
+                {
+                    found = true;
+                    break;
+                }
+            }
+
+            if (!found)
+                return false;
+        }
+
+        // NotShowIn .........
+        foreach (QString env, value("NotShowIn").toString().split(';', QString::SkipEmptyParts))
+        {
+            if (environments.contains(env))
+                return false;
+        }
+
+        return true;
     }
 
-    return QString();
-}
+    // OnlyShowIn ........
+    if (d->mHasOnlyShowIn && !(d->mOnlyShowIn & environmentMask))
+        return false;
 
+    // NotShowIn .........
+    if (d->mNotShowIn & environmentMask)
+        return false;
 
+    return true;
+}
 
 
 /************************************************
 
  ************************************************/
-XdgDesktopFile* XdgDesktopFileCache::getFile(const QString& fileName)
+bool XdgDesktopFile::isShownIn(const QStringList& environments) const
 {
-    static QHash<QString, XdgDesktopFile*> mDesktopFiles;
-    if (mDesktopFiles.contains(fileName))
-         return mDesktopFiles.value(fileName);
-
-
-    if (fileName.startsWith(QDir::separator()))
-    {
-        // Absolute path ........................
-        //qDebug() << "XdgDesktopFileCache: add new file" << fileName;
-        XdgDesktopFile* desktopFile = new XdgDesktopFile();
-        desktopFile->load(fileName);
-        mDesktopFiles.insert(fileName, desktopFile);
-        return desktopFile;
-    }
-    else
-    {
-        // Search desktop file ..................
-        QString filePath = findDesktopFile(fileName);
-        //qDebug() << "Sokoloff XdgDesktopFileCache::getFile found fileName" << fileName << filePath;
-        XdgDesktopFile* desktopFile;
+    return isShownIn(environments, environmentMask(environments));
+}
 
-        if (!mDesktopFiles.contains(filePath))
-        {
-            desktopFile = new XdgDesktopFile();
-            desktopFile->load(filePath);
-            mDesktopFiles.insert(filePath, desktopFile);
-        }
-        else
-            desktopFile = mDesktopFiles.value(filePath);
 
+/************************************************
 
-        mDesktopFiles.insert(fileName, desktopFile);
-        return desktopFile;
-    }
+ ************************************************/
+bool XdgDesktopFile::noDisplay() const
+{
+    return d->mNoDisplay;
 }
 
 
-
 /************************************************
 
  ************************************************/
-void loadMimeCacheDir(const QString& dirName, QHash<QString, XdgDesktopFile*>* cache)
+bool XdgDesktopFile::isHidden() const
 {
-    QDir dir(dirName);
-    // Directories have the type "application/x-directory", but in the desktop file
-    // are shown as "inode/directory". To handle these cases, we use this hash.
-    QHash<QString, QString> specials;
-    specials.insert("inode/directory", "application/x-directory");
+    return d->mHidden;
+}
 
 
-    // Working recursively ............
-    QFileInfoList files = dir.entryInfoList(QStringList(), QDir::Files | QDir::Dirs | QDir::NoDotAndDotDot);
-    foreach (QFileInfo f, files)
-    {
-        if (f.isDir())
-        {
-            loadMimeCacheDir(f.absoluteFilePath(), cache);
-            continue;
-        }
+/************************************************
 
+ ************************************************/
+bool XdgDesktopFile::terminal() const
+{
+    return d->mTerminal;
+}
 
-        XdgDesktopFile* df = XdgDesktopFileCache::getFile(f.absoluteFilePath());
-        if (!df)
-            continue;
 
-        QStringList mimes = df->value("MimeType").toString().split(';', QString::SkipEmptyParts);
-        int newPref= df->value("InitialPreference", 0).toInt();
+/************************************************
 
-        foreach (QString m, mimes)
-        {
-            // If the association doesn't exist or its priority is less.
-            if (!cache->contains(m) ||
-                cache->value(m)->value("InitialPreference", 0).toInt() < newPref)
-            {
-                cache->insert(m, df);
-                if (specials.contains(m))
-                    cache->insert(specials.value(m), df);
-            }
-        }
+ ************************************************/
+QString expandDynamicUrl(QString url)
+{
+    for (int i=0; environ[i]; i++)
+    {
+        QString line(environ[i]);
+        QString name = line.section("=", 0, 0);
+        QString val =  line.section("=", 1);
+        url.replace(QString("$%1").arg(name), val);
+        url.replace(QString("${%1}").arg(name), val);
     }
 
+    return url;
 }
 
 
 /************************************************
 
  ************************************************/
-XdgDesktopFile* XdgDesktopFileCache::getDefaultApp(const QString& mimeType)
+QString XdgDesktopFile::url() const
 {
-    static QHash<QString, XdgDesktopFile*> cache;
-    // Initialize the cache .....................
-    if (cache.isEmpty())
-    {
-        QStringList dataDirs = XdgDirs::dataDirs();
-        dataDirs.prepend(XdgDirs::dataHome(false));
-
-        foreach (QString dirName, dataDirs)
-            loadMimeCacheDir(dirName + "/applications", &cache);
-    }
-    // ..........................................
+    if (type() != LinkType)
+        return QString();
 
+   QString url;
 
-    if (cache.contains(mimeType))
-        return cache.value(mimeType);
-    else
-        return 0;
-}
+   url = value("URL").toString();
+   if (!url.isEmpty())
+   return url;
 
+    // WTF? What standard describes it?
+    url = expandDynamicUrl(value("URL[$e]").toString());
+    if (!url.isEmpty())
+        return url;
 
+    return QString();
+}
 
 
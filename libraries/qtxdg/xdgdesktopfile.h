@@ -35,6 +35,7 @@
 #include <QtCore/QString>
 #include <QtCore/QVariant>
 #include <QtCore/QStringList>
+#include <QtCore/QVector>
 #include <QtGui/QIcon>
 
 class XdgDesktopFileData;
@@ -125,6 +126,10 @@ public:
     //! Returns true if there exists a setting called key; returns false otherwise.
     bool contains(const QString& key) const;
 
+    /*! Returns the locale names in order of matching the localized keys. The list is built once from the
+        LC_MESSAGES, LC_ALL or LANG variable, e.g. "sr_YU@Latn", "sr_YU", "sr@Latn", "sr". */
+    static QStringList localeNames();
+
     //! Returns true if the XdgDesktopFile is valid; otherwise returns false.
     bool isValid() const;
 
@@ -165,6 +170,10 @@ public:
         @par urls - A list of files or URLS. Each file is passed as a separate argument to the result string program.*/
     QStringList expandExecString(const QStringList& urls = QStringList()) const;
 
+    /*! Returns the Exec value split to the program and arguments. The field codes like %f or %U
+        are not expanded. The list is built once when the file is loaded. */
+    QStringList execArgs() const;
+
     /*! Returns the URL for the Link desktop file; otherwise an empty string is returned.  */
     QString url() const;
 
@@ -178,6 +187,38 @@ public:
                              that are Hidden */
     bool isApplicable(bool excludeHidden = true, const QString& environment = "Razor") const;
 
+    /*! Returns the identifier of the category name. The same name always gets the same identifier
+        in the process, so the categories can be compared without string operations. */
+    static int categoryId(const QString& category);
+
+    //! Returns the sorted identifiers of the categories from the Categories key. @see categoryId()
+    QVector<int> categoryIds() const;
+
+    //! Returns true if the Categories key contains the category. @see categoryId()
+    bool hasCategory(int categoryId) const;
+
+    /*! Returns the bit mask for the list of the environments. Each environment name gets its own bit,
+        up to 63 different names in the process, the later names share the last bit. @see isShownIn() */
+    static quint64 environmentMask(const QStringList& environments);
+
+    /*! Checks the OnlyShowIn and NotShowIn keys against the environments.
+        @par environments - the names of the environments
+        @par environmentMask - the mask returned by environmentMask() for the same names. The bits are
+             compared, the names only if one of the environments has no own bit. */
+    bool isShownIn(const QStringList& environments, quint64 environmentMask) const;
+
+    //! @overload Computes the mask of the environments.
+    bool isShownIn(const QStringList& environments) const;
+
+    //! Returns the value of the NoDisplay key, the application exists, but should not be displayed in the menus.
+    bool noDisplay() const;
+
+    //! Returns the value of the Hidden key, the user deleted (at his level) this entry.
+    bool isHidden() const;
+
+    //! Returns the value of the Terminal key, the program runs in a terminal window.
+    bool terminal() const;
+
 protected:
     virtual QString prefix() const { return "Desktop Entry"; }
     virtual bool check() const { return true; }
@@ -187,6 +228,8 @@ private:
     QString localizedKey(const QString& key) const;
 
     QSharedDataPointer<XdgDesktopFileData> d;
+    friend class XdgDesktopFileCache;
+    friend class XdgDesktopFileCachePrivate;
 };
 
 
@@ -194,11 +237,53 @@ private:
 typedef QList<XdgDesktopFile> XdgDesktopFileList;
 
 
+//! The counters of the XdgDesktopFileCache. @see XdgDesktopFileCache::statistics()
+struct XdgDesktopFileCacheStatistics
+{
+    quint64 hits;       //! The requests served from the memory.
+    quint64 misses;     //! The requests that loaded the file.
+    quint64 reloads;    //! The files reloaded after they were changed on the disk.
+    quint64 evictions;  //! The entries dropped because of the maxEntries() limit.
+    int entries;        //! The number of the resident entries.
+    qint64 bytes;       //! The approximate memory held by the resident entries.
+};
+
+
+/*! The XdgDesktopFileCache class provides shared access to the desktop files. All methods are thread-safe.
+ The parsed files are kept in the $XDG_CACHE_HOME/qtxdg/desktop-entries.cache between
+ runs, so the unchanged files are not parsed again.
+
+ The objects returned by getFile() and getDefaultApp() are shared by all callers and are never
+ deleted, so the pointers stay valid for the life of the program. They must not be modified.
+ The changed files are reloaded automatically: the following calls return a new object, the
+ old one keeps the old data. */
 class XdgDesktopFileCache
 {
 public:
     static XdgDesktopFile* getFile(const QString& fileName);
     static XdgDesktopFile* getDefaultApp(const QString& mimeType);
+
+    /*! Returns a copy of the cached file. The copy is implicitly shared with the cache, so it is
+        cheap; it is not affected by the later reloads and it can be used from any thread. */
+    static XdgDesktopFile snapshot(const QString& fileName);
+
+    /*! Loads the files into the cache in parallel using the global QThreadPool. Returns when all
+        files are loaded, the following getFile() calls for these files don't touch the disk. */
+    static void preload(const QStringList& fileNames);
+
+    //! Returns the maximum number of the resident entries, 0 means unlimited.
+    static int maxEntries();
+
+    /*! Sets the maximum number of the resident entries, 0 (default) means unlimited. The entries
+        returned by getFile() are never dropped. */
+    static void setMaxEntries(int count);
+
+    //! Returns the hit/miss/reload counters and the memory held by the cache.
+    static XdgDesktopFileCacheStatistics statistics();
+
+private:
+    static XdgDesktopFile load(const QString& fileName);
+    friend class XdgDesktopFileCachePrivate;
 };
 
 
@@ -0,0 +1,134 @@
+/* BEGIN_COMMON_COPYRIGHT_HEADER
+ * (c)LGPL2+
+ *
+ * Razor - a lightweight, Qt based, desktop toolset
+ * http://razor-qt.org
+ *
+ * Copyright: 2010-2012 Razor team
+ * Authors:
+ *   Alexander Sokoloff <sokoloff.a@gmail.com>
+ *
+ * This program or library is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA
+ *
+ * END_COMMON_COPYRIGHT_HEADER */
+
+#ifndef QTXDG_XDGDESKTOPFILE_P_H
+#define QTXDG_XDGDESKTOPFILE_P_H
+
+#include "xdgdesktopfile.h"
+#include <QtCore/QSharedData>
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+#include <QtCore/QVector>
+#include <QtCore/QVariant>
+
+/*! Returns the shared copy of the str. The group and key names are interned,
+    so all parsed files share the same strings for them. */
+QString internString(const QString& str);
+
+
+struct XdgDesktopFileItem
+{
+    XdgDesktopFileItem() {}
+    XdgDesktopFileItem(const QString& _group, const QString& _key, const QVariant& _value):
+        group(_group), key(_key), value(_value) {}
+
+    bool operator==(const XdgDesktopFileItem& other) const
+    {
+        return group == other.group && key == other.key && value == other.value;
+    }
+
+    QString group;
+    QString key;
+    QVariant value;
+};
+Q_DECLARE_TYPEINFO(XdgDesktopFileItem, Q_MOVABLE_TYPE);
+
+
+/*! The best matching translation for the key. The index is the position of the
+    translated item in XdgDesktopFileData::mItems, the rank is the index of the
+    locale in XdgDesktopFile::localeNames(). */
+struct XdgDesktopFileLocalizedItem
+{
+    XdgDesktopFileLocalizedItem(): index(-1), rank(0) {}
+    XdgDesktopFileLocalizedItem(const QString& _group, const QString& _key, int _index, int _rank):
+        group(_group), key(_key), index(_index), rank(_rank) {}
+
+    QString group;
+    QString key;
+    int index;
+    int rank;
+};
+Q_DECLARE_TYPEINFO(XdgDesktopFileLocalizedItem, Q_MOVABLE_TYPE);
+
+
+/*! Returns the index of the locale in XdgDesktopFile::localeNames(), or -1 if the
+    locale is not in the current locale chain. */
+int localeRank(const char* locale, int length);
+int localeRank(const QString& locale);
+
+
+class XdgDesktopFileData: public QSharedData {
+public:
+    XdgDesktopFileData();
+    bool read(const QString &prefix);
+    bool parse(const QByteArray& content, const QString &prefix);
+
+    int lowerBound(const QString& group, const QString& key) const;
+    int indexOf(const QString& group, const QString& key) const;
+    const QVariant* find(const QString& group, const QString& key) const;
+    void insert(const QString& group, const QString& key, const QVariant& value);
+    void remove(const QString& group, const QString& key);
+
+    const XdgDesktopFileLocalizedItem* findLocalized(const QString& group, const QString& key) const;
+    const QVariant& localizedValue(const XdgDesktopFileLocalizedItem& item) const { return mItems.at(item.index).value; }
+    void selectLocalized(const QString& group, const QString& key);
+
+    bool isDropped(const QString& key) const;
+    void loadTranslations();
+    XdgDesktopFileData withTranslations() const;
+
+    XdgDesktopFile::Type detectType(XdgDesktopFile *q) const;
+    bool startApplicationDetached(const XdgDesktopFile *q, const QStringList& urls) const;
+    bool startLinkDetached(const XdgDesktopFile *q) const;
+
+    void decode(const QString &prefix);
+    qint64 approximateSize() const;
+    static bool isDecodedKey(const QString& key);
+
+    QString mFileName;
+    bool mIsValid;
+    // Sorted by group and key, the string values are already unescaped.
+    QVector<XdgDesktopFileItem> mItems;
+    // The best matching translations, sorted by group and key.
+    QVector<XdgDesktopFileLocalizedItem> mLocalized;
+    // If false, the translations for other locales were not stored, see loadTranslations().
+    bool mKeepTranslations;
+
+    XdgDesktopFile::Type mType;
+
+    // Pre-decoded values of the main group, see decode().
+    QVector<int> mCategories;
+    quint64 mOnlyShowIn;
+    quint64 mNotShowIn;
+    bool mHasOnlyShowIn;
+    bool mNoDisplay;
+    bool mHidden;
+    bool mTerminal;
+    QStringList mExecArgs;
+};
+
+#endif // QTXDG_XDGDESKTOPFILE_P_H
@@ -0,0 +1,1441 @@
+/* BEGIN_COMMON_COPYRIGHT_HEADER
+ * (c)LGPL2+
+ *
+ * Razor - a lightweight, Qt based, desktop toolset
+ * http://razor-qt.org
+ *
+ * Copyright: 2010-2012 Razor team
+ * Authors:
+ *   Alexander Sokoloff <sokoloff.a@gmail.com>
+ *
+ * This program or library is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA
+ *
+ * END_COMMON_COPYRIGHT_HEADER */
+
+#include "xdgdesktopfile.h"
+#include "xdgdesktopfile_p.h"
+#include "xdgdesktopfilecache_p.h"
+#include "xdgdirs.h"
+
+#include <QtCore/QDir>
+#include <QtCore/QFileInfo>
+#include <QtCore/QHash>
+#include <QtCore/QDataStream>
+#include <QtCore/QVector>
+#include <QtCore/QCoreApplication>
+#include <QtCore/QFileSystemWatcher>
+#include <QtCore/QMap>
+#include <QtCore/QThread>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QtConcurrentMap>
+#include <QtCore/QDebug>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+
+#define CACHE_FILE_MAGIC   0x51584443  // "QXDC"
+#define CACHE_FILE_VERSION 6
+
+// The lengths of the group and key strings and the type of the value.
+#define CACHE_MIN_ITEM_SIZE 12
+
+
+static void saveCacheFile()
+{
+    XdgDesktopFileCacheFile::instance()->save();
+}
+
+
+Q_GLOBAL_STATIC(QMutex, instanceMutex)
+
+/************************************************
+ The shared objects can be created from any thread,
+ but they watch the files, so they live in the main
+ thread.
+ ************************************************/
+static void moveToMainThread(QObject* object)
+{
+    if (QCoreApplication::instance())
+        object->moveToThread(QCoreApplication::instance()->thread());
+}
+
+
+/************************************************
+
+ ************************************************/
+XdgDesktopFileCacheFile::XdgDesktopFileCacheFile():
+    mMap(0),
+    mMapSize(0),
+    mDataStart(0),
+    mOpened(false)
+{
+    mFileName = XdgDirs::cacheHome(false) + "/qtxdg/desktop-entries.cache";
+}
+
+
+/************************************************
+
+ ************************************************/
+XdgDesktopFileCacheFile::~XdgDesktopFileCacheFile()
+{
+    close();
+}
+
+
+/************************************************
+
+ ************************************************/
+XdgDesktopFileCacheFile* XdgDesktopFileCacheFile::instance()
+{
+    static XdgDesktopFileCacheFile* inst = 0;
+    QMutexLocker locker(instanceMutex());
+    if (!inst)
+    {
+        inst = new XdgDesktopFileCacheFile();
+        qAddPostRoutine(saveCacheFile);
+    }
+    return inst;
+}
+
+
+/************************************************
+ Maps the cache file into memory and reads the index.
+ The index is placed before the records, the record
+ offsets are counted from the end of the index.
+ ************************************************/
+void XdgDesktopFileCacheFile::open()
+{
+    mOpened = true;
+
+    mFile.setFileName(mFileName);
+    if (!mFile.open(QIODevice::ReadOnly))
+        return;
+
+    mMapSize = mFile.size();
+    mMap = mFile.map(0, mMapSize);
+    if (!mMap)
+    {
+        mFile.close();
+        return;
+    }
+
+    QByteArray bytes = QByteArray::fromRawData((const char*)mMap, mMapSize);
+    QDataStream stream(bytes);
+    stream.setVersion(QDataStream::Qt_4_6);
+
+    quint32 magic, version, count;
+    QStringList locales;
+    stream >> magic >> version;
+    if (magic == CACHE_FILE_MAGIC && version == CACHE_FILE_VERSION)
+        stream >> locales;
+
+    // The entries keep only the best translations for the current locale.
+    if (magic != CACHE_FILE_MAGIC ||
+        version != CACHE_FILE_VERSION ||
+        locales != XdgDesktopFile::localeNames())
+    {
+        close();
+        return;
+    }
+
+    stream >> count;
+    for (quint32 i=0; i<count && stream.status() == QDataStream::Ok; ++i)
+    {
+        QString path;
+        Record rec;
+        stream >> path >> rec.mtime >> rec.mtimeNsec >> rec.size >> rec.inode >> rec.offset >> rec.length;
+        mIndex.insert(path, rec);
+    }
+
+    mDataStart = stream.device()->pos();
+    if (stream.status() != QDataStream::Ok)
+    {
+        qWarning() << "XdgDesktopFileCacheFile: the cache file is corrupted" << mFileName;
+        close();
+    }
+}
+
+
+/************************************************
+
+ ************************************************/
+void XdgDesktopFileCacheFile::close()
+{
+    mIndex.clear();
+    if (mMap)
+        mFile.unmap(const_cast<uchar*>(mMap));
+
+    mMap = 0;
+    mMapSize = 0;
+    mDataStart = 0;
+    mFile.close();
+}
+
+
+/************************************************
+
+ ************************************************/
+bool XdgDesktopFileCacheFile::fileStat(const QString& fileName, Record* rec)
+{
+    struct stat st;
+    if (::stat(QFile::encodeName(fileName).constData(), &st) != 0)
+        return false;
+
+    rec->mtime = st.st_mtime;
+    rec->mtimeNsec = st.st_mtim.tv_nsec;
+    rec->size  = st.st_size;
+    rec->inode = st.st_ino;
+    return true;
+}
+
+
+/************************************************
+
+ ************************************************/
+bool XdgDesktopFileCacheFile::read(const QString& fileName, XdgDesktopFileData* data)
+{
+    Record rec;
+    {
+        QMutexLocker locker(&mMutex);
+        if (!mOpened)
+            open();
+
+        QHash<QString, Record>::const_iterator i = mIndex.constFind(fileName);
+        if (i == mIndex.constEnd())
+            return false;
+
+        rec = i.value();
+    }
+
+    // The map is read-only and stays valid until the object
+    // is destroyed, so the record is read without the lock.
+    Record cur;
+    if (!fileStat(fileName, &cur) || !cur.sameFile(rec))
+        return false;
+
+    if (mDataStart + rec.offset + rec.length > mMapSize)
+        return false;
+
+    QByteArray bytes = QByteArray::fromRawData((const char*)mMap + mDataStart + rec.offset, rec.length);
+    QDataStream stream(bytes);
+    stream.setVersion(QDataStream::Qt_4_6);
+
+    bool isValid;
+    quint32 count;
+    stream >> isValid >> count;
+
+    // The count is checked against the rest of the record,
+    // so a corrupted file can't make us allocate too much.
+    QVector<XdgDesktopFileItem> items;
+    items.reserve(qMin<qint64>(count, (bytes.size() - stream.device()->pos()) / CACHE_MIN_ITEM_SIZE));
+    for (quint32 n=0; n<count && stream.status() == QDataStream::Ok; ++n)
+    {
+        QString group, key;
+        QVariant value;
+        stream >> group >> key >> value;
+        items.append(XdgDesktopFileItem(internString(group), internString(key), value));
+    }
+
+    stream >> count;
+    QVector<XdgDesktopFileLocalizedItem> localized;
+    localized.reserve(qMin<qint64>(count, (bytes.size() - stream.device()->pos()) / CACHE_MIN_ITEM_SIZE));
+    for (quint32 n=0; n<count && stream.status() == QDataStream::Ok; ++n)
+    {
+        QString group, key;
+        qint32 index, rank;
+        stream >> group >> key >> index >> rank;
+        if (index < 0 || index >= items.count())
+            return false;
+
+        localized.append(XdgDesktopFileLocalizedItem(internString(group), internString(key), index, rank));
+    }
+
+    if (stream.status() != QDataStream::Ok)
+        return false;
+
+    // The entries were parsed without the translations for other locales.
+    data->mFileName = fileName;
+    data->mIsValid = isValid;
+    data->mItems = items;
+    data->mLocalized = localized;
+    data->mKeepTranslations = false;
+    return true;
+}
+
+
+/************************************************
+
+ ************************************************/
+void XdgDesktopFileCacheFile::write(const XdgDesktopFileData* data)
+{
+    Record rec;
+    if (!fileStat(data->mFileName, &rec))
+        return;
+
+    QByteArray bytes;
+    QDataStream stream(&bytes, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_4_6);
+    stream << data->mIsValid << (quint32)data->mItems.count();
+    foreach (const XdgDesktopFileItem& item, data->mItems)
+        stream << item.group << item.key << item.value;
+
+    stream << (quint32)data->mLocalized.count();
+    foreach (const XdgDesktopFileLocalizedItem& item, data->mLocalized)
+        stream << item.group << item.key << (qint32)item.index << (qint32)item.rank;
+
+    rec.offset = 0;
+    rec.length = bytes.size();
+
+    QMutexLocker locker(&mMutex);
+    mDirtyIndex.insert(data->mFileName, rec);
+    mDirtyData.insert(data->mFileName, bytes);
+}
+
+
+/************************************************
+ The new file is written under the temporary name and
+ renamed over the old one, so the processes that have
+ the old file mapped are not affected.
+ ************************************************/
+void XdgDesktopFileCacheFile::save()
+{
+    QMutexLocker locker(&mMutex);
+    if (mDirtyData.isEmpty())
+        return;
+
+    if (!mOpened)
+        open();
+
+    QByteArray index;
+    QByteArray records;
+    quint32 count = 0;
+    {
+        QDataStream stream(&index, QIODevice::WriteOnly);
+        stream.setVersion(QDataStream::Qt_4_6);
+
+        // Freshly parsed entries ...............
+        QHashIterator<QString, Record> i(mDirtyIndex);
+        while (i.hasNext())
+        {
+            i.next();
+            Record rec = i.value();
+            rec.offset = records.size();
+            records.append(mDirtyData.value(i.key()));
+
+            stream << i.key() << rec.mtime << rec.mtimeNsec << rec.size << rec.inode << rec.offset << rec.length;
+            ++count;
+        }
+
+        // Still actual entries from the old file
+        QHashIterator<QString, Record> j(mIndex);
+        while (j.hasNext())
+        {
+            j.next();
+            if (mDirtyIndex.contains(j.key()))
+                continue;
+
+            Record rec = j.value();
+            Record cur;
+            if (!fileStat(j.key(), &cur) ||
+                !cur.sameFile(rec) ||
+                mDataStart + rec.offset + rec.length > mMapSize)
+            {
+                continue;
+            }
+
+            const char* src = (const char*)mMap + mDataStart + rec.offset;
+            rec.offset = records.size();
+            records.append(src, rec.length);
+
+            stream << j.key() << rec.mtime << rec.mtimeNsec << rec.size << rec.inode << rec.offset << rec.length;
+            ++count;
+        }
+    }
+
+    QDir().mkpath(QFileInfo(mFileName).absolutePath());
+    QString tmpName = QString("%1.%2").arg(mFileName).arg(getpid());
+    QFile file(tmpName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        qWarning() << QString("XdgDesktopFileCacheFile: can't write %1: %2").arg(tmpName, file.errorString());
+        return;
+    }
+
+    {
+        QDataStream stream(&file);
+        stream.setVersion(QDataStream::Qt_4_6);
+        stream << (quint32)CACHE_FILE_MAGIC << (quint32)CACHE_FILE_VERSION;
+        stream << XdgDesktopFile::localeNames() << count;
+    }
+    file.write(index);
+    file.write(records);
+    file.close();
+
+    if (::rename(QFile::encodeName(tmpName).constData(), QFile::encodeName(mFileName).constData()) != 0)
+    {
+        qWarning() << "XdgDesktopFileCacheFile: can't rename" << tmpName << "to" << mFileName;
+        QFile::remove(tmpName);
+        return;
+    }
+
+    mDirtyIndex.clear();
+    mDirtyData.clear();
+}
+
+
+/************************************************
+
+ ************************************************/
+XdgDesktopFileIndex::XdgDesktopFileIndex():
+    QObject(),
+    mDirty(true)
+{
+    mWatcher = new QFileSystemWatcher(this);
+    connect(mWatcher, SIGNAL(directoryChanged(QString)), this, SLOT(directoryChanged(QString)));
+
+    QStringList dataDirs = XdgDirs::dataDirs();
+    dataDirs.prepend(XdgDirs::dataHome(false));
+
+    foreach (QString dirName, dataDirs)
+        mRoots << QDir::cleanPath(dirName + "/applications");
+
+    for (int i=0; i<mRoots.count(); ++i)
+        scanRoot(i);
+}
+
+
+/************************************************
+
+ ************************************************/
+XdgDesktopFileIndex* XdgDesktopFileIndex::instance()
+{
+    static XdgDesktopFileIndex* inst = 0;
+    QMutexLocker locker(instanceMutex());
+    if (!inst)
+    {
+        inst = new XdgDesktopFileIndex();
+        moveToMainThread(inst);
+    }
+
+    return inst;
+}
+
+
+/************************************************
+
+ ************************************************/
+void XdgDesktopFileIndex::scanRoot(int root)
+{
+    QFileInfo fi(mRoots.at(root));
+    if (fi.isDir())
+    {
+        scanDir(fi.canonicalFilePath(), root, "");
+        return;
+    }
+
+    // The directory doesn't exist yet, wait for it in the parent directory.
+    QString parent = fi.absolutePath();
+    if (QFileInfo(parent).isDir() && !mPendingRoots.contains(parent))
+    {
+        mPendingRoots.insert(parent, root);
+        mWatcher->addPath(parent);
+    }
+}
+
+
+/************************************************
+
+ ************************************************/
+void XdgDesktopFileIndex::scanDir(const QString& dirName, int root, const QString& prefix)
+{
+    if (mDirs.contains(dirName))
+        return;
+
+    Dir dir;
+    dir.root = root;
+    dir.prefix = prefix;
+    readDir(dirName, &dir);
+
+    mDirs.insert(dirName, dir);
+    mWatcher->addPath(dirName);
+    mDirty = true;
+
+    for (int i=0; i<dir.subDirs.count(); ++i)
+        scanDir(dir.subDirs.at(i), root, prefix + dir.subDirNames.at(i) + "-");
+}
+
+
+/************************************************
+
+ ************************************************/
+void XdgDesktopFileIndex::readDir(const QString& dirName, Dir* dir)
+{
+    QDir d(dirName);
+    dir->files = d.entryList(QStringList("*.desktop"), QDir::Files);
+    dir->subDirs.clear();
+    dir->subDirNames.clear();
+
+    QFileInfoList dirs = d.entryInfoList(QStringList(), QDir::Dirs | QDir::NoDotAndDotDot);
+    foreach (QFileInfo fi, dirs)
+    {
+        QString cn = fi.canonicalFilePath();
+        if (cn != dirName)
+        {
+            dir->subDirs << cn;
+            dir->subDirNames << fi.fileName();
+        }
+    }
+}
+
+
+/************************************************
+
+ ************************************************/
+void XdgDesktopFileIndex::removeDir(const QString& dirName)
+{
+    QHash<QString, Dir>::Iterator i = mDirs.find(dirName);
+    if (i == mDirs.end())
+        return;
+
+    int root = i->root;
+    QStringList subDirs = i->subDirs;
+    mDirs.erase(i);
+    mWatcher->removePath(dirName);
+    mDirty = true;
+
+    foreach (QString subDir, subDirs)
+    {
+        if (mDirs.contains(subDir) && mDirs.value(subDir).root == root)
+            removeDir(subDir);
+    }
+}
+
+
+/************************************************
+ Only the changed directory is read again, the
+ new subdirectories are scanned recursively.
+ ************************************************/
+void XdgDesktopFileIndex::directoryChanged(const QString& dirName)
+{
+    QMutexLocker locker(&mMutex);
+
+    // The applications directory was created ......
+    if (mPendingRoots.contains(dirName))
+    {
+        int root = mPendingRoots.value(dirName);
+        if (QFileInfo(mRoots.at(root)).isDir())
+        {
+            mPendingRoots.remove(dirName);
+            mWatcher->removePath(dirName);
+            scanRoot(root);
+        }
+    }
+
+    if (!mDirs.contains(dirName))
+        return;
+
+    Dir dir = mDirs.value(dirName);
+    if (!QFileInfo(dirName).isDir())
+    {
+        removeDir(dirName);
+        if (dir.prefix.isEmpty())
+            scanRoot(dir.root);
+
+        return;
+    }
+
+    QStringList oldSubDirs = dir.subDirs;
+    readDir(dirName, &dir);
+    mDirs.insert(dirName, dir);
+    mDirty = true;
+
+    foreach (QString subDir, oldSubDirs)
+    {
+        if (!dir.subDirs.contains(subDir))
+            removeDir(subDir);
+    }
+
+    for (int i=0; i<dir.subDirs.count(); ++i)
+        scanDir(dir.subDirs.at(i), dir.root, dir.prefix + dir.subDirNames.at(i) + "-");
+}
+
+
+/************************************************
+ The roots and the subdirectories are walked in the
+ same order as the files are looked up, so the first
+ found file wins.
+ ************************************************/
+void XdgDesktopFileIndex::rebuild()
+{
+    mIds.clear();
+    mFileNames.clear();
+
+    QSet<QString> visited;
+    for (int i=0; i<mRoots.count(); ++i)
+    {
+        QFileInfo fi(mRoots.at(i));
+        if (fi.isDir())
+            addFiles(fi.canonicalFilePath(), &visited);
+    }
+
+    mDirty = false;
+}
+
+
+/************************************************
+
+ ************************************************/
+void XdgDesktopFileIndex::addFiles(const QString& dirName, QSet<QString>* visited)
+{
+    if (visited->contains(dirName))
+        return;
+
+    visited->insert(dirName);
+
+    QHash<QString, Dir>::ConstIterator i = mDirs.constFind(dirName);
+    if (i == mDirs.constEnd())
+        return;
+
+    foreach (QString file, i->files)
+    {
+        QString path = dirName + "/" + file;
+        QString id = i->prefix + file;
+
+        if (!mIds.contains(id))
+            mIds.insert(id, path);
+
+        if (!mFileNames.contains(file))
+            mFileNames.insert(file, path);
+    }
+
+    foreach (QString subDir, i->subDirs)
+        addFiles(subDir, visited);
+}
+
+
+/************************************************
+
+ ************************************************/
+QString XdgDesktopFileIndex::find(const QString& desktopName)
+{
+    QMutexLocker locker(&mMutex);
+    if (mDirty)
+        rebuild();
+
+    QString id = desktopName;
+    id.replace('/', '-');
+
+    QHash<QString, QString>::ConstIterator i = mIds.constFind(id);
+    if (i != mIds.constEnd())
+        return i.value();
+
+    return mFileNames.value(desktopName);
+}
+
+
+
+
+/************************************************
+ Loads the file from the binary cache, if it's possible.
+ Otherwise parses the file and puts it into the cache.
+ ************************************************/
+XdgDesktopFile XdgDesktopFileCache::load(const QString& fileName)
+{
+    XdgDesktopFileCacheFile* cacheFile = XdgDesktopFileCacheFile::instance();
+    XdgDesktopFile desktopFile;
+    XdgDesktopFileData* data = desktopFile.d.data();
+
+    if (cacheFile->read(fileName, data))
+    {
+        data->mType = data->detectType(&desktopFile);
+        data->decode(desktopFile.prefix());
+    }
+    else
+    {
+        // Only the best translations are stored, the others
+        // are read from the file when they are asked for.
+        data->mKeepTranslations = false;
+        desktopFile.load(fileName);
+        cacheFile->write(data);
+    }
+
+    return desktopFile;
+}
+
+
+/************************************************
+
+ ************************************************/
+XdgDesktopFileCachePrivate::XdgDesktopFileCachePrivate():
+    QObject(),
+    mMaxEntries(0),
+    mClock(0),
+    mPurgeScheduled(false)
+{
+    memset(&mStatistics, 0, sizeof(mStatistics));
+
+    mWatcher = new QFileSystemWatcher(this);
+    connect(mWatcher, SIGNAL(directoryChanged(QString)), this, SLOT(directoryChanged(QString)));
+}
+
+
+/************************************************
+
+ ************************************************/
+XdgDesktopFileCachePrivate* XdgDesktopFileCachePrivate::instance()
+{
+    static XdgDesktopFileCachePrivate* inst = 0;
+    QMutexLocker locker(instanceMutex());
+    if (!inst)
+    {
+        inst = new XdgDesktopFileCachePrivate();
+        moveToMainThread(inst);
+    }
+
+    return inst;
+}
+
+
+/************************************************
+
+ ************************************************/
+QString XdgDesktopFileCachePrivate::resolve(const QString& fileName)
+{
+    if (fileName.startsWith(QDir::separator()))
+        return fileName;
+
+    return XdgDesktopFileIndex::instance()->find(fileName);
+}
+
+
+/************************************************
+ The file is loaded without the lock, so several
+ threads can load the different files at once.
+ The stamp is taken before the file is read, if
+ the file is changed meanwhile, the stamp doesn't
+ match and the entry is reloaded.
+ ************************************************/
+XdgDesktopFile XdgDesktopFileCachePrivate::find(const QString& path, XdgDesktopFileCacheFile::Record* stamp, bool* exists)
+{
+    {
+        QMutexLocker locker(&mMutex);
+        QHash<QString, Entry>::Iterator i = mEntries.find(path);
+        if (i != mEntries.end())
+        {
+            ++mStatistics.hits;
+            i->lastUse = ++mClock;
+            if (stamp)
+                *stamp = i->stamp;
+            if (exists)
+                *exists = i->exists;
+            return i->file;
+        }
+    }
+
+    XdgDesktopFileCacheFile::Record rec;
+    bool recExists = XdgDesktopFileCacheFile::fileStat(path, &rec);
+    return insertEntry(path, XdgDesktopFileCache::load(path), rec, recExists, stamp, exists);
+}
+
+
+/************************************************
+
+ ************************************************/
+XdgDesktopFile XdgDesktopFileCachePrivate::snapshot(const QString& fileName)
+{
+    return find(resolve(fileName));
+}
+
+
+/************************************************
+
+ ************************************************/
+XdgDesktopFile XdgDesktopFileCachePrivate::snapshot(const QString& fileName, XdgDesktopFileCacheFile::Record* stamp, bool* exists)
+{
+    return find(resolve(fileName), stamp, exists);
+}
+
+
+/************************************************
+ The handle is replaced only when the entry was
+ reloaded, the old one is left to its users.
+ ************************************************/
+XdgDesktopFile* XdgDesktopFileCachePrivate::getFile(const QString& fileName)
+{
+    QString path = resolve(fileName);
+    XdgDesktopFile desktopFile = find(path);
+
+    QMutexLocker locker(&mMutex);
+    XdgDesktopFile*& handle = mHandles[path];
+    if (!handle || !(handle->d == desktopFile.d))
+        handle = new XdgDesktopFile(desktopFile);
+
+    return handle;
+}
+
+
+/************************************************
+ If other thread has already loaded the same file,
+ its snapshot is returned.
+ ************************************************/
+XdgDesktopFile XdgDesktopFileCachePrivate::insertEntry(const QString& path, const XdgDesktopFile& desktopFile,
+                                                       const XdgDesktopFileCacheFile::Record& stamp, bool exists,
+                                                       XdgDesktopFileCacheFile::Record* entryStamp, bool* entryExists)
+{
+    Entry entry;
+    entry.file = desktopFile;
+    entry.stamp = stamp;
+    entry.exists = exists;
+    entry.bytes = desktopFile.d.constData()->approximateSize();
+
+    QMutexLocker locker(&mMutex);
+    QHash<QString, Entry>::Iterator i = mEntries.find(path);
+    if (i != mEntries.end())
+    {
+        ++mStatistics.hits;
+        i->lastUse = ++mClock;
+        if (entryStamp)
+            *entryStamp = i->stamp;
+        if (entryExists)
+            *entryExists = i->exists;
+        return i->file;
+    }
+
+    ++mStatistics.misses;
+    entry.lastUse = ++mClock;
+    mStatistics.bytes += entry.bytes;
+    mEntries.insert(path, entry);
+    watch(path);
+
+    if (mMaxEntries > 0 && mEntries.count() > mMaxEntries)
+        schedulePurge();
+
+    if (entryStamp)
+        *entryStamp = stamp;
+    if (entryExists)
+        *entryExists = exists;
+    return desktopFile;
+}
+
+
+/************************************************
+
+ ************************************************/
+void XdgDesktopFileCachePrivate::preload(const QStringList& fileNames)
+{
+    QStringList missed;
+    {
+        QMutexLocker locker(&mMutex);
+        foreach (QString fileName, fileNames)
+        {
+            if (!mEntries.contains(fileName))
+                missed << fileName;
+        }
+    }
+
+    if (missed.isEmpty())
+        return;
+
+    QVector<XdgDesktopFileCacheFile::Record> stamps(missed.count());
+    QVector<bool> exists(missed.count());
+    for (int i=0; i<missed.count(); ++i)
+        exists[i] = XdgDesktopFileCacheFile::fileStat(missed.at(i), &stamps[i]);
+
+    QList<XdgDesktopFile> files = QtConcurrent::blockingMapped<QList<XdgDesktopFile> >(missed, XdgDesktopFileCache::load);
+    for (int i=0; i<files.count(); ++i)
+        insertEntry(missed.at(i), files.at(i), stamps.at(i), exists.at(i));
+}
+
+
+/************************************************
+ The directories are watched instead of the files, it
+ takes less inotify watches and also catches the files
+ replaced by rename.
+ ************************************************/
+void XdgDesktopFileCachePrivate::watch(const QString& fileName)
+{
+    if (fileName.isEmpty())
+        return;
+
+    QString dirName = QFileInfo(fileName).absolutePath();
+    QSet<QString>& files = mDirFiles[dirName];
+    if (files.isEmpty() && QFileInfo(dirName).isDir())
+    {
+        if (QThread::currentThread() == thread())
+            mWatcher->addPath(dirName);
+        else
+            QMetaObject::invokeMethod(this, "addWatchPath", Qt::QueuedConnection, Q_ARG(QString, dirName));
+    }
+
+    files.insert(fileName);
+}
+
+
+/************************************************
+
+ ************************************************/
+void XdgDesktopFileCachePrivate::addWatchPath(const QString& dirName)
+{
+    mWatcher->addPath(dirName);
+}
+
+
+/************************************************
+
+ ************************************************/
+void XdgDesktopFileCachePrivate::removeEntry(const QString& fileName)
+{
+    Entry entry = mEntries.take(fileName);
+    mStatistics.bytes -= entry.bytes;
+
+    QString dirName = QFileInfo(fileName).absolutePath();
+    QHash<QString, QSet<QString> >::Iterator i = mDirFiles.find(dirName);
+    if (i != mDirFiles.end())
+    {
+        i->remove(fileName);
+        if (i->isEmpty())
+        {
+            mWatcher->removePath(dirName);
+            mDirFiles.erase(i);
+        }
+    }
+}
+
+
+/************************************************
+ Checks the cached files from the directory. The
+ changed files are loaded into new snapshots, the
+ old ones are never touched.
+ ************************************************/
+void XdgDesktopFileCachePrivate::directoryChanged(const QString& dirName)
+{
+    QMutexLocker locker(&mMutex);
+    QSet<QString> files = mDirFiles.value(dirName);
+    foreach (QString fileName, files)
+    {
+        QHash<QString, Entry>::Iterator i = mEntries.find(fileName);
+        if (i == mEntries.end())
+            continue;
+
+        XdgDesktopFileCacheFile::Record stamp;
+        if (!XdgDesktopFileCacheFile::fileStat(fileName, &stamp))
+        {
+            removeEntry(fileName);
+            continue;
+        }
+
+        if (i->exists && i->stamp.sameFile(stamp))
+            continue;
+
+        i->file = XdgDesktopFileCache::load(fileName);
+
+        qint64 bytes = i->file.d.constData()->approximateSize();
+        mStatistics.bytes += bytes - i->bytes;
+        ++mStatistics.reloads;
+
+        i->bytes = bytes;
+        i->stamp = stamp;
+        i->exists = true;
+    }
+}
+
+
+/************************************************
+
+ ************************************************/
+void XdgDesktopFileCachePrivate::schedulePurge()
+{
+    if (mPurgeScheduled)
+        return;
+
+    mPurgeScheduled = true;
+    QMetaObject::invokeMethod(this, "purge", Qt::QueuedConnection);
+}
+
+
+/************************************************
+ Drops the least recently used entries above the
+ limit. The entries held by the getFile() objects
+ are kept, dropping them doesn't free the memory.
+ ************************************************/
+void XdgDesktopFileCachePrivate::purge()
+{
+    QMutexLocker locker(&mMutex);
+    mPurgeScheduled = false;
+
+    if (mMaxEntries > 0 && mEntries.count() > mMaxEntries)
+    {
+        QMap<quint64, QString> byUse;
+        QHashIterator<QString, Entry> i(mEntries);
+        while (i.hasNext())
+        {
+            i.next();
+            XdgDesktopFile* handle = mHandles.value(i.key());
+            if (handle && handle->d == i.value().file.d)
+                continue;
+
+            byUse.insert(i.value().lastUse, i.key());
+        }
+
+        int count = mEntries.count() - mMaxEntries;
+        QMapIterator<quint64, QString> j(byUse);
+        while (j.hasNext() && count > 0)
+        {
+            j.next();
+            removeEntry(j.value());
+            ++mStatistics.evictions;
+            --count;
+        }
+    }
+}
+
+
+/************************************************
+
+ ************************************************/
+void XdgDesktopFileCachePrivate::setMaxEntries(int count)
+{
+    QMutexLocker locker(&mMutex);
+    mMaxEntries = qMax(0, count);
+    if (mMaxEntries > 0 && mEntries.count() > mMaxEntries)
+        schedulePurge();
+}
+
+
+/************************************************
+
+ ************************************************/
+XdgDesktopFileCacheStatistics XdgDesktopFileCachePrivate::statistics()
+{
+    QMutexLocker locker(&mMutex);
+    XdgDesktopFileCacheStatistics res = mStatistics;
+    res.entries = mEntries.count();
+    return res;
+}
+
+
+/************************************************
+
+ ************************************************/
+XdgDesktopFile* XdgDesktopFileCache::getFile(const QString& fileName)
+{
+    return XdgDesktopFileCachePrivate::instance()->getFile(fileName);
+}
+
+
+/************************************************
+
+ ************************************************/
+XdgDesktopFile XdgDesktopFileCache::snapshot(const QString& fileName)
+{
+    return XdgDesktopFileCachePrivate::instance()->snapshot(fileName);
+}
+
+
+/************************************************
+
+ ************************************************/
+void XdgDesktopFileCache::preload(const QStringList& fileNames)
+{
+    XdgDesktopFileCachePrivate::instance()->preload(fileNames);
+}
+
+
+/************************************************
+
+ ************************************************/
+int XdgDesktopFileCache::maxEntries()
+{
+    return XdgDesktopFileCachePrivate::instance()->maxEntries();
+}
+
+
+/************************************************
+
+ ************************************************/
+void XdgDesktopFileCache::setMaxEntries(int count)
+{
+    XdgDesktopFileCachePrivate::instance()->setMaxEntries(count);
+}
+
+
+/************************************************
+
+ ************************************************/
+XdgDesktopFileCacheStatistics XdgDesktopFileCache::statistics()
+{
+    return XdgDesktopFileCachePrivate::instance()->statistics();
+}
+
+
+/************************************************
+
+ ************************************************/
+static void collectFiles(const QString& dirName, QStringList* fileNames)
+{
+    QDir dir(dirName);
+
+    // Working recursively ............
+    QFileInfoList files = dir.entryInfoList(QStringList(), QDir::Files | QDir::Dirs | QDir::NoDotAndDotDot);
+    foreach (QFileInfo f, files)
+    {
+        if (f.isDir())
+            collectFiles(f.absoluteFilePath(), fileNames);
+        else
+            (*fileNames) << f.absoluteFilePath();
+    }
+}
+
+
+/************************************************
+ Fills the cache by the MimeType keys of all desktop
+ files, it is used when there is no mimeinfo.cache.
+ The files are parsed in parallel.
+ ************************************************/
+void loadMimeCacheDir(const QString& dirName, QHash<QString, QStringList>* cache)
+{
+    QStringList fileNames;
+    collectFiles(dirName, &fileNames);
+    XdgDesktopFileCache::preload(fileNames);
+
+    foreach (QString fileName, fileNames)
+    {
+        XdgDesktopFile df = XdgDesktopFileCache::snapshot(fileName);
+        QStringList mimes = df.value("MimeType").toString().split(';', QString::SkipEmptyParts);
+        foreach (QString m, mimes)
+            (*cache)[m] << fileName;
+    }
+}
+
+
+/************************************************
+
+ ************************************************/
+XdgMimeAppsResolver::XdgMimeAppsResolver():
+    QObject(),
+    mLoaded(false),
+    mHasMimeCache(false)
+{
+    mWatcher = new QFileSystemWatcher(this);
+    connect(mWatcher, SIGNAL(directoryChanged(QString)), this, SLOT(directoryChanged(QString)));
+
+    QStringList configDirs = XdgDirs::configDirs();
+    configDirs.prepend(XdgDirs::configHome(false));
+
+    QStringList appDirs;
+    appDirs << XdgDirs::dataHome(false);
+    appDirs << XdgDirs::dataDirs();
+    for (int i=0; i<appDirs.count(); ++i)
+        appDirs[i] = QDir::cleanPath(appDirs.at(i) + "/applications");
+
+    // The files in order of precedence .........
+    foreach (QString dirName, configDirs)
+        mListFiles << QDir::cleanPath(dirName + "/mimeapps.list");
+
+    foreach (QString dirName, appDirs)
+        mListFiles << dirName + "/mimeapps.list";
+
+    foreach (QString dirName, appDirs)
+        mListFiles << dirName + "/defaults.list";
+
+    foreach (QString dirName, appDirs)
+        mCacheFiles << dirName + "/mimeinfo.cache";
+
+    QStringList watched;
+    foreach (QString fileName, mListFiles + mCacheFiles)
+    {
+        Source source;
+        source.fileName = fileName;
+        source.exists = XdgDesktopFileCacheFile::fileStat(fileName, &source.stamp);
+        mSources << source;
+
+        QString dirName = QFileInfo(fileName).absolutePath();
+        if (!watched.contains(dirName) && QFileInfo(dirName).isDir())
+            watched << dirName;
+    }
+
+    if (!watched.isEmpty())
+        mWatcher->addPaths(watched);
+}
+
+
+/************************************************
+
+ ************************************************/
+XdgMimeAppsResolver* XdgMimeAppsResolver::instance()
+{
+    static XdgMimeAppsResolver* inst = 0;
+    QMutexLocker locker(instanceMutex());
+    if (!inst)
+    {
+        inst = new XdgMimeAppsResolver();
+        moveToMainThread(inst);
+    }
+
+    return inst;
+}
+
+
+/************************************************
+ The results are dropped only if one of the files
+ was really changed, the watched directories contain
+ other files too.
+ ************************************************/
+void XdgMimeAppsResolver::directoryChanged(const QString& dirName)
+{
+    QMutexLocker locker(&mMutex);
+    bool changed = false;
+    for (int i=0; i<mSources.count(); ++i)
+    {
+        Source& source = mSources[i];
+        if (QFileInfo(source.fileName).absolutePath() != dirName)
+            continue;
+
+        XdgDesktopFileCacheFile::Record stamp;
+        bool exists = XdgDesktopFileCacheFile::fileStat(source.fileName, &stamp);
+        if (exists != source.exists || (exists && !stamp.sameFile(source.stamp)))
+        {
+            changed = true;
+        }
+
+        source.exists = exists;
+        source.stamp = stamp;
+    }
+
+    if (!changed)
+        return;
+
+    mLoaded = false;
+    mDefaults.clear();
+    mAdded.clear();
+    mRemoved.clear();
+    mCandidates.clear();
+    mResults.clear();
+}
+
+
+/************************************************
+
+ ************************************************/
+void XdgMimeAppsResolver::load()
+{
+    mLoaded = true;
+
+    foreach (QString fileName, mListFiles)
+        readList(fileName);
+
+    mHasMimeCache = false;
+    foreach (QString fileName, mCacheFiles)
+        readCache(fileName);
+
+    if (!mHasMimeCache)
+    {
+        QStringList dataDirs = XdgDirs::dataDirs();
+        dataDirs.prepend(XdgDirs::dataHome(false));
+
+        foreach (QString dirName, dataDirs)
+            loadMimeCacheDir(dirName + "/applications", &mCandidates);
+    }
+}
+
+
+/************************************************
+ Reads the [Default Applications], [Added Associations]
+ and [Removed Associations] groups of mimeapps.list.
+ The defaults.list has only the first group.
+ ************************************************/
+void XdgMimeAppsResolver::readList(const QString& fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return;
+
+    QHash<QString, QStringList>* section = 0;
+    bool removed = false;
+
+    while (!file.atEnd())
+    {
+        QString line = QString::fromUtf8(file.readLine()).trimmed();
+        if (line.isEmpty() || line.startsWith('#'))
+            continue;
+
+        if (line.startsWith('[') && line.endsWith(']'))
+        {
+            QString name = line.mid(1, line.length() - 2);
+            removed = (name == "Removed Associations");
+            if (name == "Default Applications")
+                section = &mDefaults;
+            else if (name == "Added Associations")
+                section = &mAdded;
+            else
+                section = 0;
+
+            continue;
+        }
+
+        int n = line.indexOf('=');
+        if (n < 1 || (!section && !removed))
+            continue;
+
+        QString mimeType = line.left(n).trimmed();
+        QStringList ids = line.mid(n + 1).split(';', QString::SkipEmptyParts);
+
+        if (removed)
+        {
+            foreach (QString id, ids)
+                mRemoved[mimeType].insert(id.trimmed());
+        }
+        else
+        {
+            QStringList& list = (*section)[mimeType];
+            foreach (QString id, ids)
+            {
+                id = id.trimmed();
+                if (!list.contains(id))
+                    list << id;
+            }
+        }
+    }
+}
+
+
+/************************************************
+ The [MIME Cache] group of the mimeinfo.cache.
+ ************************************************/
+void XdgMimeAppsResolver::readCache(const QString& fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return;
+
+    mHasMimeCache = true;
+    while (!file.atEnd())
+    {
+        QString line = QString::fromUtf8(file.readLine()).trimmed();
+        int n = line.indexOf('=');
+        if (n < 1 || line.startsWith('#') || line.startsWith('['))
+            continue;
+
+        QStringList& list = mCandidates[line.left(n)];
+        foreach (QString id, line.mid(n + 1).split(';', QString::SkipEmptyParts))
+        {
+            if (!list.contains(id))
+                list << id;
+        }
+    }
+}
+
+
+/************************************************
+
+ ************************************************/
+bool XdgMimeAppsResolver::candidate(const QString& desktopName, XdgDesktopFile* desktopFile)
+{
+    QString fileName = desktopName;
+    if (!fileName.startsWith(QDir::separator()))
+        fileName = XdgDesktopFileIndex::instance()->find(desktopName);
+
+    if (fileName.isEmpty())
+        return false;
+
+    *desktopFile = XdgDesktopFileCache::snapshot(fileName);
+    return desktopFile->isValid() && desktopFile->type() == XdgDesktopFile::ApplicationType;
+}
+
+
+/************************************************
+ Returns the file name of the default application.
+ The user's choice is used first, then the application
+ with the highest InitialPreference.
+ ************************************************/
+QString XdgMimeAppsResolver::find(const QString& mimeType)
+{
+    // Directories have the type "application/x-directory", but in the desktop file
+    // are shown as "inode/directory".
+    QStringList mimeTypes(mimeType);
+    if (mimeType == "application/x-directory")
+        mimeTypes << "inode/directory";
+
+    foreach (QString mime, mimeTypes)
+    {
+        QSet<QString> removed = mRemoved.value(mime);
+
+        // Default Applications ..............
+        foreach (QString id, mDefaults.value(mime))
+        {
+            XdgDesktopFile desktopFile;
+            if (!removed.contains(id) && candidate(id, &desktopFile))
+                return desktopFile.fileName();
+        }
+
+        // Added Associations & mimeinfo.cache
+        QString res;
+        int pref = 0;
+        foreach (QString id, mAdded.value(mime) + mCandidates.value(mime))
+        {
+            if (removed.contains(id))
+                continue;
+
+            XdgDesktopFile desktopFile;
+            if (!candidate(id, &desktopFile))
+                continue;
+
+            int newPref = desktopFile.value("InitialPreference", 0).toInt();
+            if (res.isEmpty() || pref < newPref)
+            {
+                res = desktopFile.fileName();
+                pref = newPref;
+            }
+        }
+
+        if (!res.isEmpty())
+            return res;
+    }
+
+    return QString();
+}
+
+
+/************************************************
+
+ ************************************************/
+XdgDesktopFile* XdgMimeAppsResolver::defaultApp(const QString& mimeType)
+{
+    QMutexLocker locker(&mMutex);
+    if (!mLoaded)
+        load();
+
+    QHash<QString, QString>::ConstIterator i = mResults.constFind(mimeType);
+    if (i == mResults.constEnd())
+        i = mResults.insert(mimeType, find(mimeType));
+
+    if (i.value().isEmpty())
+        return 0;
+
+    return XdgDesktopFileCache::getFile(i.value());
+}
+
+
+/************************************************
+
+ ************************************************/
+XdgDesktopFile* XdgDesktopFileCache::getDefaultApp(const QString& mimeType)
+{
+    return XdgMimeAppsResolver::instance()->defaultApp(mimeType);
+}
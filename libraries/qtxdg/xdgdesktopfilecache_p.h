@@ -0,0 +1,276 @@
+/* BEGIN_COMMON_COPYRIGHT_HEADER
+ * (c)LGPL2+
+ *
+ * Razor - a lightweight, Qt based, desktop toolset
+ * http://razor-qt.org
+ *
+ * Copyright: 2010-2012 Razor team
+ * Authors:
+ *   Alexander Sokoloff <sokoloff.a@gmail.com>
+ *
+ * This program or library is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA
+ *
+ * END_COMMON_COPYRIGHT_HEADER */
+
+#ifndef QTXDG_XDGDESKTOPFILECACHE_P_H
+#define QTXDG_XDGDESKTOPFILECACHE_P_H
+
+#include "xdgdesktopfile.h"
+#include <QtCore/QObject>
+#include <QtCore/QString>
+#include <QtCore/QHash>
+#include <QtCore/QSet>
+#include <QtCore/QStringList>
+#include <QtCore/QByteArray>
+#include <QtCore/QFile>
+#include <QtCore/QMutex>
+
+class XdgDesktopFileData;
+class QFileSystemWatcher;
+
+/*! The XdgDesktopFileCacheFile class keeps the already parsed desktop entries
+    between the runs of the program. The entries are stored in the binary
+    $XDG_CACHE_HOME/qtxdg/desktop-entries.cache file, this file is shared by
+    all processes and is mapped into memory on the first access.
+
+    Every record is keyed by the file path and checked against the mtime (with
+    the nanoseconds), the size and the inode of the file, so the outdated records are revalidated lazily on
+    the first access to them.
+ */
+class XdgDesktopFileCacheFile
+{
+public:
+    XdgDesktopFileCacheFile();
+    ~XdgDesktopFileCacheFile();
+
+    static XdgDesktopFileCacheFile* instance();
+
+    /*! Fills the data from the cached record. Returns false if the record
+        doesn't exist or if the file was changed since it was cached. */
+    bool read(const QString& fileName, XdgDesktopFileData* data);
+
+    //! Stores the freshly parsed data, it will be written by the save().
+    void write(const XdgDesktopFileData* data);
+
+    //! Writes the cache file if it has been changed.
+    void save();
+
+    QString fileName() const { return mFileName; }
+
+    struct Record
+    {
+        qint64 mtime;
+        qint64 mtimeNsec;
+        qint64 size;
+        qint64 inode;
+        quint32 offset;
+        quint32 length;
+
+        //! Compares the stamps of the file, the offset and the length are ignored.
+        bool sameFile(const Record& other) const
+        {
+            return mtime     == other.mtime     &&
+                   mtimeNsec == other.mtimeNsec &&
+                   size      == other.size      &&
+                   inode     == other.inode;
+        }
+    };
+
+    //! Fills the mtime, size and inode of the file. Returns false if the file doesn't exist.
+    static bool fileStat(const QString& fileName, Record* rec);
+
+private:
+    void open();
+    void close();
+
+    QString mFileName;
+    QFile mFile;
+    const uchar* mMap;
+    qint64 mMapSize;
+    qint64 mDataStart;
+    bool mOpened;
+    QHash<QString, Record> mIndex;
+    QHash<QString, Record> mDirtyIndex;
+    QHash<QString, QByteArray> mDirtyData;
+    QMutex mMutex;
+};
+
+
+/*! The XdgDesktopFileIndex class maps the desktop-file ids to the file paths for all
+    $XDG_DATA_DIRS/applications directories. The desktop-file id is the path relative
+    to the applications directory with '/' replaced by '-', e.g. kde4/kate.desktop has
+    the id kde4-kate.desktop. If two files have the same id, the file from the earlier
+    directory is used.
+
+    The directories are scanned once and watched, on changes only the changed
+    directory is read again.
+ */
+class XdgDesktopFileIndex: public QObject
+{
+    Q_OBJECT
+public:
+    static XdgDesktopFileIndex* instance();
+
+    /*! Returns the path of the desktop file. The desktopName can be the desktop-file id,
+        the path relative to the applications directory or the file name only. */
+    QString find(const QString& desktopName);
+
+private slots:
+    void directoryChanged(const QString& dirName);
+
+private:
+    struct Dir
+    {
+        int root;
+        QString prefix;
+        QStringList files;
+        QStringList subDirs;      // Canonical paths
+        QStringList subDirNames;
+    };
+
+    XdgDesktopFileIndex();
+    void scanRoot(int root);
+    void scanDir(const QString& dirName, int root, const QString& prefix);
+    void readDir(const QString& dirName, Dir* dir);
+    void removeDir(const QString& dirName);
+    void addFiles(const QString& dirName, QSet<QString>* visited);
+    void rebuild();
+
+    QStringList mRoots;
+    QHash<QString, int> mPendingRoots;
+    QHash<QString, Dir> mDirs;
+    QHash<QString, QString> mIds;
+    QHash<QString, QString> mFileNames;
+    bool mDirty;
+    QFileSystemWatcher* mWatcher;
+    QMutex mMutex;
+};
+
+
+/*! The XdgMimeAppsResolver class finds the default application for the mime type. It
+    reads the mimeapps.list and defaults.list files and the mimeinfo.cache files made by
+    update-desktop-database, so only the candidate desktop files are loaded. If there is
+    no mimeinfo.cache, all desktop files are scanned once.
+
+    The directories of these files are watched, the results are dropped when one of
+    the files is changed.
+ */
+class XdgMimeAppsResolver: public QObject
+{
+    Q_OBJECT
+public:
+    static XdgMimeAppsResolver* instance();
+
+    XdgDesktopFile* defaultApp(const QString& mimeType);
+
+private slots:
+    void directoryChanged(const QString& dirName);
+
+private:
+    struct Source
+    {
+        QString fileName;
+        XdgDesktopFileCacheFile::Record stamp;
+        bool exists;
+    };
+
+    XdgMimeAppsResolver();
+    void load();
+    void readList(const QString& fileName);
+    void readCache(const QString& fileName);
+    QString find(const QString& mimeType);
+    bool candidate(const QString& desktopName, XdgDesktopFile* desktopFile);
+
+    QList<Source> mSources;
+    QStringList mListFiles;
+    QStringList mCacheFiles;
+    bool mLoaded;
+    bool mHasMimeCache;
+    QHash<QString, QStringList> mDefaults;
+    QHash<QString, QStringList> mAdded;
+    QHash<QString, QSet<QString> > mRemoved;
+    QHash<QString, QStringList> mCandidates;
+    QHash<QString, QString> mResults;
+    QFileSystemWatcher* mWatcher;
+    QMutex mMutex;
+};
+
+
+/*! The XdgDesktopFileCachePrivate class keeps the XdgDesktopFile objects shared by
+    XdgDesktopFileCache. The entries are implicitly shared snapshots, they are never
+    modified after the loading. The directories of the loaded files are watched; a
+    changed file is loaded into a new snapshot which replaces the entry, the copies
+    already handed out keep the old data.
+
+    The objects returned by getFile() are never deleted. A new object is created only
+    when the file was reloaded, so the old pointers stay valid and unchanged.
+ */
+class XdgDesktopFileCachePrivate: public QObject
+{
+    Q_OBJECT
+public:
+    static XdgDesktopFileCachePrivate* instance();
+
+    XdgDesktopFile* getFile(const QString& fileName);
+    XdgDesktopFile snapshot(const QString& fileName);
+    /*! Returns the snapshot together with the stamp of the file taken before it was read.
+        The exists is false if the file didn't exist. */
+    XdgDesktopFile snapshot(const QString& fileName, XdgDesktopFileCacheFile::Record* stamp, bool* exists);
+    void preload(const QStringList& fileNames);
+
+    int maxEntries() const { return mMaxEntries; }
+    void setMaxEntries(int count);
+
+    XdgDesktopFileCacheStatistics statistics();
+
+private slots:
+    void directoryChanged(const QString& dirName);
+    void addWatchPath(const QString& dirName);
+    void purge();
+
+private:
+    struct Entry
+    {
+        XdgDesktopFile file;
+        XdgDesktopFileCacheFile::Record stamp;
+        bool exists;
+        quint64 lastUse;
+        qint64 bytes;
+    };
+
+    XdgDesktopFileCachePrivate();
+    static QString resolve(const QString& fileName);
+    XdgDesktopFile find(const QString& path, XdgDesktopFileCacheFile::Record* stamp = 0, bool* exists = 0);
+    XdgDesktopFile insertEntry(const QString& path, const XdgDesktopFile& desktopFile,
+                               const XdgDesktopFileCacheFile::Record& stamp, bool exists,
+                               XdgDesktopFileCacheFile::Record* entryStamp = 0, bool* entryExists = 0);
+    void watch(const QString& fileName);
+    void removeEntry(const QString& fileName);
+    void schedulePurge();
+
+    QHash<QString, Entry> mEntries;
+    QHash<QString, QSet<QString> > mDirFiles;
+    QFileSystemWatcher* mWatcher;
+    // The objects returned by getFile(), never deleted.
+    QHash<QString, XdgDesktopFile*> mHandles;
+    int mMaxEntries;
+    quint64 mClock;
+    bool mPurgeScheduled;
+    XdgDesktopFileCacheStatistics mStatistics;
+    QMutex mMutex;
+};
+
+#endif // QTXDG_XDGDESKTOPFILECACHE_P_H
@@ -35,6 +35,7 @@
 #include <QtCore/QStringList>
 #include <QtCore/QFileInfo>
 #include <QtCore/QCache>
+#include <QtCore/QHash>
 #include "qiconfix/qiconloader_p.h"
 #include <QtCore/QCoreApplication>
 
@@ -53,6 +54,37 @@ static void qt_cleanup_icon_cache()
 }
 
 
+/************************************************
+ Remembers whether the theme has the icon and which
+ name of a fallback chain was found, so the repeated
+ lookups don't search the theme. Both are valid only
+ for the theme key they were filled with, the key
+ also changes when an index of the theme is rebuilt.
+ ************************************************/
+struct XdgIconLookupCache
+{
+    XdgIconLookupCache(): themeKey(0) {}
+
+    void validate()
+    {
+        QIconLoader::instance()->checkIndexes();
+        uint key = QIconLoader::instance()->themeKey();
+        if (key != themeKey)
+        {
+            found.clear();
+            chains.clear();
+            themeKey = key;
+        }
+    }
+
+    QHash<QString, bool> found;
+    QHash<QString, QString> chains;
+    uint themeKey;
+};
+
+Q_GLOBAL_STATIC(XdgIconLookupCache, iconLookupCache)
+
+
 
 /************************************************
 
@@ -86,6 +118,11 @@ void XdgIcon::setThemeName(const QString& themeName)
 {
     QIcon::setThemeName(themeName);
     QIconLoader::instance()->updateSystemTheme();
+
+    // The key isn't changed if the theme was set to the same name,
+    // the caches are cleared anyway to pick up the changed files.
+    iconLookupCache()->found.clear();
+    iconLookupCache()->chains.clear();
 }
 
 
@@ -108,6 +145,22 @@ QIcon XdgIcon::fromTheme(const QString& iconName, const QIcon& fallback)
         name.truncate(name.length() - 4);
     }
 
+    // Note the qapp check is to allow lazy loading of static icons
+    // Supporting fallbacks will not work for this case.
+    bool checkSizes = qApp && !isAbsolute;
+    XdgIconLookupCache* lookupCache = iconLookupCache();
+    if (checkSizes)
+    {
+        lookupCache->validate();
+        QHash<QString, bool>::const_iterator it = lookupCache->found.constFind(name);
+        if (it != lookupCache->found.constEnd())
+        {
+            if (!it.value())
+                return fallback;
+            checkSizes = false;
+        }
+    }
+
     QIcon icon;
 
     if (qtIconCache()->contains(name)) {
@@ -122,11 +175,12 @@ QIcon XdgIcon::fromTheme(const QString& iconName, const QIcon& fallback)
         icon = *cachedIcon;
     }
 
-    // Note the qapp check is to allow lazy loading of static icons
-    // Supporting fallbacks will not work for this case.
-    if (qApp && !isAbsolute && icon.availableSizes().isEmpty())
+    if (checkSizes)
     {
-        return fallback;
+        bool found = !icon.availableSizes().isEmpty();
+        lookupCache->found.insert(name, found);
+        if (!found)
+            return fallback;
     }
     return icon;
 }
@@ -138,13 +192,27 @@ QIcon XdgIcon::fromTheme(const QString& iconName, const QIcon& fallback)
  ************************************************/
 QIcon XdgIcon::fromTheme(const QStringList& iconNames, const QIcon& fallback)
 {
+    XdgIconLookupCache* lookupCache = iconLookupCache();
+    lookupCache->validate();
+
+    QString key = iconNames.join("\n");
+    QHash<QString, QString>::const_iterator it = lookupCache->chains.constFind(key);
+    if (it != lookupCache->chains.constEnd())
+        return it.value().isEmpty() ? fallback : fromTheme(it.value());
+
     foreach (QString iconName, iconNames)
     {
         QIcon icon = fromTheme(iconName);
         if (!icon.isNull())
+        {
+            lookupCache->chains.insert(key, iconName);
             return icon;
+        }
     }
 
+    if (qApp)
+        lookupCache->chains.insert(key, QString());
+
     return fallback;
 }
 
@@ -184,3 +252,21 @@ QString XdgIcon::defaultApplicationIconName()
 {
     return DEFAULT_APP_ICON;
 }
+
+
+/************************************************
+
+ ************************************************/
+XdgIconAsyncPaint::XdgIconAsyncPaint(QWidget* widget)
+{
+    mPrevWidget = QIconLoaderAsync::instance()->setWidget(widget);
+}
+
+
+/************************************************
+
+ ************************************************/
+XdgIconAsyncPaint::~XdgIconAsyncPaint()
+{
+    QIconLoaderAsync::instance()->setWidget(mPrevWidget);
+}
@@ -34,6 +34,8 @@
 #include <QtCore/QString>
 #include <QtCore/QStringList>
 
+class QWidget;
+
 class XdgIcon
 {
 public:
@@ -58,4 +60,30 @@ private:
 
 };
 
+
+/*! @brief While an object of the XdgIconAsyncPaint class exists, the theme icons painted by
+ the widget are decoded and scaled on a worker thread.
+
+ A transparent placeholder is painted until the icon is ready, then the widget is updated.
+ The finished icons are delivered in batches, so one slow icon doesn't delay the others.
+ Create the object on the stack in the paint code of the view:
+ @code
+    void MyMenu::paintEvent(QPaintEvent* event)
+    {
+        XdgIconAsyncPaint async(this);
+        QMenu::paintEvent(event);
+    }
+ @endcode
+ */
+class XdgIconAsyncPaint
+{
+public:
+    explicit XdgIconAsyncPaint(QWidget* widget);
+    ~XdgIconAsyncPaint();
+
+private:
+    Q_DISABLE_COPY(XdgIconAsyncPaint)
+    QWidget* mPrevWidget;
+};
+
 #endif // QTXDG_XDGICON_H
@@ -35,10 +35,12 @@
 #include "xdgmenuapplinkprocessor.h"
 #include "xdgdirs.h"
 #include "xdgmenulayoutprocessor.h"
+#include "xdgdesktopfile.h"
+#include "xdgmenucache_p.h"
+#include "xdgmenuelement_p.h"
 
 #include <QtCore/QDebug>
 #include <QtXml/QDomElement>
-#include <QtXml/QDomNamedNodeMap>
 #include <QtCore/QFile>
 #include <QtCore/QSettings>
 #include <QtCore/QFileInfo>
@@ -48,12 +50,21 @@
 #include <QtCore/QFileSystemWatcher>
 #include <QtCore/QTranslator>
 #include <QtCore/QCoreApplication>
-#include <QtCore/QCryptographicHash>
+#include <QtCore/QTextStream>
+#include <QtCore/QtConcurrentRun>
+#include <QtCore/QMutex>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
 
 void installTranslation(const QString &name)
 {
+    // The XdgMenu objects can be created on any thread.
+    static QMutex mutex;
     static bool alreadyLoaded = false;
 
+    QMutexLocker locker(&mutex);
     if (alreadyLoaded)
         return;
 
@@ -91,18 +102,43 @@ XdgMenu::~XdgMenu()
 
  ************************************************/
 XdgMenuPrivate::XdgMenuPrivate(XdgMenu *parent):
+    mFingerprint(0),
     mOutDated(true),
+    mAsync(false),
+    mEmitReady(false),
+    mBuildPending(false),
+    mPendingFull(false),
+    mShared(true),
+    mClient(false),
+    mLockFd(-1),
     q_ptr(parent)
 {
     mRebuildDelayTimer.setSingleShot(true);
     mRebuildDelayTimer.setInterval(REBUILD_DELAY);
+    mTakeoverTimer.setInterval(TAKEOVER_INTERVAL);
+
+    qRegisterMetaType<XdgMenuDiff>("XdgMenuDiff");
+
+    connect(&mTakeoverTimer, SIGNAL(timeout()), this, SLOT(takeover()));
 
     connect(&mRebuildDelayTimer, SIGNAL(timeout()), this, SLOT(rebuild()));
-    connect(&mWatcher, SIGNAL(fileChanged(QString)), &mRebuildDelayTimer, SLOT(start()));
-    connect(&mWatcher, SIGNAL(directoryChanged(QString)), &mRebuildDelayTimer, SLOT(start()));
+    connect(&mWatcher, SIGNAL(fileChanged(QString)), this, SLOT(pathChanged(QString)));
+    connect(&mWatcher, SIGNAL(directoryChanged(QString)), this, SLOT(pathChanged(QString)));
 
 
     connect(this, SIGNAL(changed()), q_ptr, SIGNAL(changed()));
+    connect(this, SIGNAL(menuChanged(XdgMenuDiff)), q_ptr, SIGNAL(menuChanged(XdgMenuDiff)));
+    connect(this, SIGNAL(ready(bool)), q_ptr, SIGNAL(ready(bool)));
+    connect(&mBuildWatcher, SIGNAL(finished()), this, SLOT(buildFinished()));
+}
+
+
+/************************************************
+
+ ************************************************/
+XdgMenuPrivate::~XdgMenuPrivate()
+{
+    unlockShared();
 }
 
 
@@ -132,7 +168,20 @@ void XdgMenu::setLogDir(const QString& directory)
 const QDomDocument XdgMenu::xml() const
 {
     Q_D(const XdgMenu);
-    return d->mXml;
+    return d->document();
+}
+
+
+/************************************************
+
+ ************************************************/
+XdgMenuNode XdgMenu::rootNode() const
+{
+    Q_D(const XdgMenu);
+    if (!d->mTree || d->mTree->mItems.isEmpty())
+        return XdgMenuNode();
+
+    return XdgMenuNode(d->mTree.data(), 0);
 }
 
 
@@ -184,58 +233,342 @@ bool XdgMenu::read(const QString& menuFileName)
 
     d->mMenuFileName = menuFileName;
 
+    if (d->readShared())
+    {
+        d->mErrorString.clear();
+        d->mOutDated = false;
+        return true;
+    }
+
     d->clearWatcher();
+    d->mStructure = 0;
 
-    XdgMenuReader reader(this);
-    if (!reader.load(d->mMenuFileName))
+    // The log of the stages is wanted, so the cache is not used.
+    if (d->mLogDir.isEmpty() && d->loadCache())
     {
-        qWarning() << reader.errorString();
-        d->mErrorString = reader.errorString();
+        d->mErrorString.clear();
+        d->mOutDated = false;
+        return true;
+    }
+
+    XdgMenuBuildResult res = XdgMenuPrivate::build(d->buildRequest(true));
+    if (!res.ok)
+    {
+        qWarning() << res.errorString;
+        d->mErrorString = res.errorString;
+        // The broken file is watched too, the menu is read again when it's fixed.
+        d->setInputs(res.inputs);
         return false;
     }
 
-    d->mXml = reader.xml();
-    QDomElement root = d->mXml.documentElement();
-    d->saveLog("00-reader.xml");
+    d->setResult(res);
+    d->mOutDated = false;
+    return true;
+}
 
-    d->simplify(root);
-    d->saveLog("01-simplify.xml");
 
-    d->mergeMenus(root);
-    d->saveLog("02-mergeMenus.xml");
+/************************************************
 
-    d->moveMenus(root);
-    d->saveLog("03-moveMenus.xml");
+ ************************************************/
+void XdgMenu::readAsync(const QString& menuFileName)
+{
+    Q_D(XdgMenu);
+    d->mMenuFileName = menuFileName;
+    d->mAsync = true;
 
-    d->mergeMenus(root);
-    d->saveLog("04-mergeMenus.xml");
+    // Loading the published menu is cheap, only ready() is delayed
+    // like it's done for the build.
+    if (d->readShared())
+    {
+        d->mErrorString.clear();
+        d->mOutDated = false;
+        QMetaObject::invokeMethod(d, "emitReady", Qt::QueuedConnection);
+        return;
+    }
 
-    d->deleteDeletedMenus(root);
-    d->saveLog("05-deleteDeletedMenus.xml");
+    d->mEmitReady = true;
+    d->startBuild(true);
+}
 
-    d->processDirectoryEntries(root, QStringList());
-    d->saveLog("06-processDirectoryEntries.xml");
 
-    d->processApps(root);
-    d->saveLog("07-processApps.xml");
+/************************************************
 
-    d->processLayouts(root);
-    d->saveLog("08-processLayouts.xml");
+ ************************************************/
+void XdgMenuPrivate::emitReady()
+{
+    emit ready(true);
+}
 
-    d->deleteEmpty(root);
-    d->saveLog("09-deleteEmpty.xml");
 
-    d->fixSeparators(root);
-    d->saveLog("10-fixSeparators.xml");
+/************************************************
+ The environments and the log dir are copied, so
+ they can be changed while the build is running.
+ The structure is never changed, the worker makes
+ its own copy.
+ ************************************************/
+void XdgMenuPrivate::startBuild(bool full)
+{
+    if (mBuildWatcher.isRunning())
+    {
+        mBuildPending = true;
+        mPendingFull = mPendingFull || full;
+        return;
+    }
 
+    mBuildWatcher.setFuture(QtConcurrent::run(&XdgMenuPrivate::build, buildRequest(full)));
+}
 
-    d->mOutDated = false;
-    d->mHash = QCryptographicHash::hash(d->mXml.toByteArray(), QCryptographicHash::Md5);
 
+/************************************************
+
+ ************************************************/
+XdgMenuBuildRequest XdgMenuPrivate::buildRequest(bool full) const
+{
+    XdgMenuBuildRequest request;
+    request.menuFileName = mMenuFileName;
+    request.environments = mEnvironments;
+    request.logDir = mLogDir;
+    if (!full)
+    {
+        request.structure = mStructure;
+        request.structureInputs = mStructureInputs;
+    }
+    request.saveCache = !mClient;
+    return request;
+}
+
+
+/************************************************
+ Runs on the worker thread for readAsync(), the
+ builder doesn't touch the XdgMenu objects.
+ ************************************************/
+XdgMenuBuildResult XdgMenuPrivate::build(const XdgMenuBuildRequest& request)
+{
+    XdgMenuBuilder builder(request.menuFileName, request.environments, request.logDir);
+    builder.mSaveCache = request.saveCache;
+
+    XdgMenuBuildResult res;
+    if (!request.structure)
+    {
+        res.ok = builder.read();
+    }
+    else
+    {
+        builder.rebuildApps(request.structure, request.structureInputs);
+        res.ok = true;
+    }
+
+    res.errorString = builder.mErrorString;
+    res.tree = builder.mTree;
+    res.fingerprint = builder.mTree ? builder.mTree->mFingerprint : 0;
+    res.inputs = builder.mInputs.keys().toSet();
+    res.structure = builder.mStructure;
+    res.structureInputs = builder.mStructureInputs;
+    return res;
+}
+
+
+/************************************************
+ Publishes the result of the worker in one step,
+ until now the consumers used the previous tree.
+ ************************************************/
+void XdgMenuPrivate::buildFinished()
+{
+    // The result is already outdated, build again.
+    if (mBuildPending)
+    {
+        mBuildPending = false;
+        bool full = mPendingFull;
+        mPendingFull = false;
+        startBuild(full);
+        return;
+    }
+
+    XdgMenuBuildResult res = mBuildWatcher.result();
+    if (!res.ok)
+    {
+        mErrorString = res.errorString;
+        if (mEmitReady)
+        {
+            mEmitReady = false;
+            emit ready(false);
+        }
+        return;
+    }
+
+    quint64 prevFingerprint = mFingerprint;
+    QExplicitlySharedDataPointer<XdgMenuTree> prevTree = mTree;
+
+    setResult(res);
+
+    if (mEmitReady)
+    {
+        mEmitReady = false;
+        mOutDated = false;
+        emit ready(true);
+    }
+    else if (prevFingerprint != mFingerprint)
+    {
+        mOutDated = true;
+        emit changed();
+        emit menuChanged(XdgMenuTree::diff(prevTree.data(), mTree.data()));
+    }
+}
+
+
+/************************************************
+
+ ************************************************/
+void XdgMenuPrivate::setResult(const XdgMenuBuildResult& result)
+{
+    setInputs(result.inputs);
+    if (mClient)
+        watchShared();
+
+    mTree = result.tree;
+    mFingerprint = result.fingerprint;
+    mStructure = result.structure;
+    mStructureInputs = result.structureInputs;
+    mErrorString.clear();
+}
+
+
+/************************************************
+
+ ************************************************/
+void XdgMenuPrivate::setInputs(const QSet<QString>& inputs)
+{
+    Q_Q(XdgMenu);
+    clearWatcher();
+    foreach (QString path, inputs)
+        q->addWatchPath(path);
+}
+
+
+/************************************************
+
+ ************************************************/
+XdgMenuBuilder::XdgMenuBuilder(const QString& menuFileName, const QStringList& environments, const QString& logDir):
+    mMenuFileName(menuFileName),
+    mEnvironments(environments),
+    mLogDir(logDir),
+    mSaveCache(true)
+{
+}
+
+
+/************************************************
+
+ ************************************************/
+void XdgMenuBuilder::addInput(const QString& path)
+{
+    if (!mInputs.contains(path))
+        mInputs.insert(path, XdgMenuCacheStamp::current(path));
+}
+
+
+/************************************************
+
+ ************************************************/
+bool XdgMenuBuilder::read()
+{
+    mTimings.clear();
+    mStageTime.start();
+
+    mDocument = new XdgMenuDocument();
+    XdgMenuReader reader(this, mDocument.data());
+    if (!reader.load(mMenuFileName))
+    {
+        mErrorString = reader.errorString();
+        return false;
+    }
+
+    XdgMenuElement* root = reader.root();
+    mDocument->setRoot(root);
+    saveLog("00-reader.xml");
+
+    simplify(root);
+    saveLog("01-simplify.xml");
+
+    mergeMenus(root);
+    saveLog("02-mergeMenus.xml");
+
+    moveMenus(root);
+    saveLog("03-moveMenus.xml");
+
+    mergeMenus(root);
+    saveLog("04-mergeMenus.xml");
+
+    deleteDeletedMenus(root);
+    saveLog("05-deleteDeletedMenus.xml");
+
+    processDirectoryEntries(root, QStringList());
+    saveLog("06-processDirectoryEntries.xml");
+
+    // Up to here the menu depends only on the .menu and .directory files.
+    mStructure = mDocument->clone();
+    mStructureInputs = mInputs;
+
+    buildApps();
     return true;
 }
 
 
+/************************************************
+ Only the application dirs were changed, so the
+ menu structure is reused and only the applications
+ are distributed again. The changed desktop files
+ are already reloaded by the XdgDesktopFileCache.
+ ************************************************/
+void XdgMenuBuilder::rebuildApps(const QExplicitlySharedDataPointer<XdgMenuDocument>& structure, const XdgMenuCacheStamps& structureInputs)
+{
+    mStructure = structure;
+    mStructureInputs = structureInputs;
+    mInputs = structureInputs;
+
+    mTimings.clear();
+    mStageTime.start();
+
+    mDocument = mStructure->clone();
+    saveLog("06-processDirectoryEntries.xml");
+
+    buildApps();
+}
+
+
+/************************************************
+ The stages which depend on the desktop files.
+ ************************************************/
+void XdgMenuBuilder::buildApps()
+{
+    XdgMenuElement* root = mDocument->root();
+
+    processApps(root);
+    saveLog("07-processApps.xml");
+
+    processLayouts(root);
+    saveLog("08-processLayouts.xml");
+
+    deleteEmpty(root);
+    saveLog("09-deleteEmpty.xml");
+
+    fixSeparators(root);
+    saveLog("10-fixSeparators.xml");
+    saveTimings();
+
+    // The consumers walk the compact tree, the document is only needed while building.
+    // The fingerprint of the tree is computed while it's filled.
+    mTree = XdgMenuTree::fromElement(root);
+    mDocument = 0;
+
+    if (mSaveCache)
+    {
+        XdgMenuCache cache(mMenuFileName, mEnvironments);
+        cache.save(*mTree, mInputs, mFiles);
+    }
+}
+
+
 /************************************************
 
  ************************************************/
@@ -253,132 +586,164 @@ void XdgMenu::save(const QString& fileName)
     }
 
     QTextStream ts(&file);
-    d->mXml.save(ts, 2);
+    d->document().save(ts, 2);
 
     file.close();
 }
 
 
 /************************************************
- For debug only
+ The document is created from the tree.
  ************************************************/
-void XdgMenuPrivate::load(const QString& fileName)
+QDomDocument XdgMenuPrivate::document() const
 {
-    QFile file(fileName);
-    if (!file.open(QFile::ReadOnly | QFile::Text))
-    {
-        qWarning() << QString("%1 not loading: %2").arg(fileName).arg(file.errorString());
-        return;
-    }
-    mXml.setContent(&file, true);
+    if (!mTree)
+        return QDomDocument();
+
+    return mTree->toDom();
 }
 
 
 /************************************************
 
  ************************************************/
-void XdgMenuPrivate::saveLog(const QString& logFileName)
+void XdgMenuBuilder::saveLog(const QString& logFileName)
 {
-    Q_Q(XdgMenu);
-    if (!mLogDir.isEmpty())
-        q->save(mLogDir + "/" + logFileName);
+    if (mLogDir.isEmpty())
+        return;
+
+    // The time of the stage, the saving of the log is not counted.
+    mTimings << QString("%1\t%2").arg(QFileInfo(logFileName).completeBaseName()).arg(mStageTime.elapsed());
+
+    QString fileName = mLogDir + "/" + logFileName;
+    QFile file(fileName);
+    if (file.open(QFile::WriteOnly | QFile::Text))
+    {
+        mDocument->save(&file);
+        file.close();
+    }
+    else
+    {
+        qWarning() << QString("Cannot write file %1:\n%2.").arg(fileName, file.errorString());
+    }
+
+    mStageTime.restart();
 }
 
 
 /************************************************
-
+ For debug only. Writes the time of every stage and
+ the desktop file cache counters as tab separated
+ "name value" lines, so the results of the different
+ builds can be compared by scripts.
  ************************************************/
-void XdgMenuPrivate::mergeMenus(QDomElement& element)
+void XdgMenuBuilder::saveTimings()
 {
-    QHash<QString, QDomElement> menus;
-
-    MutableDomElementIterator it(element, "Menu");
+    if (mLogDir.isEmpty())
+        return;
 
-    it.toFront();
-    while(it.hasNext())
+    QString fileName = mLogDir + "/timings.tsv";
+    QFile file(fileName);
+    if (!file.open(QFile::WriteOnly | QFile::Text))
     {
-        it.next();
-        menus[it.current().attribute("name")] = it.current();
+        qWarning() << QString("Cannot write file %1:\n%2.").arg(fileName, file.errorString());
+        return;
     }
 
+    XdgDesktopFileCacheStatistics stat = XdgDesktopFileCache::statistics();
 
-    it.toBack();
-    while (it.hasPrevious())
+    QTextStream ts(&file);
+    foreach (QString line, mTimings)
+        ts << line << "\n";
+
+    ts << "cache-hits\t"      << stat.hits      << "\n";
+    ts << "cache-misses\t"    << stat.misses    << "\n";
+    ts << "cache-reloads\t"   << stat.reloads   << "\n";
+    ts << "cache-evictions\t" << stat.evictions << "\n";
+    ts << "cache-entries\t"   << stat.entries   << "\n";
+    ts << "cache-bytes\t"     << stat.bytes     << "\n";
+}
+
+
+/************************************************
+ The childs of the menus with the same name are
+ moved to the last of them.
+ ************************************************/
+void XdgMenuBuilder::mergeMenus(XdgMenuElement* element)
+{
+    QHash<QString, XdgMenuElement*> menus;
+    QList<XdgMenuElement*> childMenus = element->children("Menu");
+
+    foreach (XdgMenuElement* e, childMenus)
+        menus[e->attribute("name")] = e;
+
+
+    for (int i=childMenus.count()-1; i>=0; --i)
     {
-        QDomElement src = it.previous();
-        QDomElement dest = menus[src.attribute("name")];
+        XdgMenuElement* src = childMenus.at(i);
+        XdgMenuElement* dest = menus.value(src->attribute("name"));
         if (dest != src)
         {
             prependChilds(src, dest);
-            element.removeChild(src);
+            element->removeChild(src);
         }
     }
 
 
-    QDomElement n = element.firstChildElement("Menu");
-    while (!n.isNull())
-    {
-        mergeMenus(n);
-        n = n.nextSiblingElement("Menu");
-    }
-
-    it.toFront();
-    while(it.hasNext())
-        mergeMenus(it.next());
+    foreach (XdgMenuElement* e, element->children("Menu"))
+        mergeMenus(e);
 }
 
 
 /************************************************
 
  ************************************************/
-void XdgMenuPrivate::simplify(QDomElement& element)
+void XdgMenuBuilder::simplify(XdgMenuElement* element)
 {
-    MutableDomElementIterator it(element);
-    //it.toFront();
-    while(it.hasNext())
+    foreach (XdgMenuElement* n, element->children())
     {
-        QDomElement n = it.next();
+        const QString& tagName = n->tagName();
 
-        if (n.tagName() == "Name")
+        if (tagName == "Name")
         {
             // The <Name> field must not contain the slash character ("/");
             // implementations should discard any name containing a slash.
-            element.setAttribute("name", n.text().remove('/'));
-            n.parentNode().removeChild(n);
+            element->setAttribute("name", QString(n->text()).remove('/'));
+            n->remove();
         }
 
         // ......................................
-        else if(n.tagName() == "Deleted")
+        else if(tagName == "Deleted")
         {
-            element.setAttribute("deleted", true);
-            n.parentNode().removeChild(n);
+            element->setAttribute("deleted", true);
+            n->remove();
         }
-        else if(n.tagName() == "NotDeleted")
+        else if(tagName == "NotDeleted")
         {
-            element.setAttribute("deleted", false);
-            n.parentNode().removeChild(n);
+            element->setAttribute("deleted", false);
+            n->remove();
         }
 
         // ......................................
-        else if(n.tagName() == "OnlyUnallocated")
+        else if(tagName == "OnlyUnallocated")
         {
-            element.setAttribute("onlyUnallocated", true);
-            n.parentNode().removeChild(n);
+            element->setAttribute("onlyUnallocated", true);
+            n->remove();
         }
-        else if(n.tagName() == "NotOnlyUnallocated")
+        else if(tagName == "NotOnlyUnallocated")
         {
-            element.setAttribute("onlyUnallocated", false);
-            n.parentNode().removeChild(n);
+            element->setAttribute("onlyUnallocated", false);
+            n->remove();
         }
 
         // ......................................
-        else if(n.tagName() == "FileInfo")
+        else if(tagName == "FileInfo")
         {
-            n.parentNode().removeChild(n);
+            n->remove();
         }
 
         // ......................................
-        else if(n.tagName() == "Menu")
+        else if(tagName == "Menu")
         {
             simplify(n);
         }
@@ -391,44 +756,37 @@ void XdgMenuPrivate::simplify(QDomElement& element)
 /************************************************
 
  ************************************************/
-void XdgMenuPrivate::prependChilds(QDomElement& srcElement, QDomElement& destElement)
+void XdgMenuBuilder::prependChilds(XdgMenuElement* srcElement, XdgMenuElement* destElement)
 {
-    MutableDomElementIterator it(srcElement);
-
-    it.toBack();
-    while(it.hasPrevious())
-    {
-        QDomElement n = it.previous();
-        destElement.insertBefore(n, destElement.firstChild());
-    }
+    QList<XdgMenuElement*> childs = srcElement->children();
+    for (int i=childs.count()-1; i>=0; --i)
+        destElement->insertBefore(childs.at(i), destElement->firstChild());
 
-    if (srcElement.attributes().contains("deleted") &&
-        !destElement.attributes().contains("deleted")
+    if (srcElement->hasAttribute("deleted") &&
+        !destElement->hasAttribute("deleted")
        )
-        destElement.setAttribute("deleted", srcElement.attribute("deleted"));
+        destElement->setAttribute("deleted", srcElement->attribute("deleted"));
 
-    if (srcElement.attributes().contains("onlyUnallocated") &&
-        !destElement.attributes().contains("onlyUnallocated")
+    if (srcElement->hasAttribute("onlyUnallocated") &&
+        !destElement->hasAttribute("onlyUnallocated")
        )
-        destElement.setAttribute("onlyUnallocated", srcElement.attribute("onlyUnallocated"));
+        destElement->setAttribute("onlyUnallocated", srcElement->attribute("onlyUnallocated"));
 }
 
 
 /************************************************
 
  ************************************************/
-void XdgMenuPrivate::appendChilds(QDomElement& srcElement, QDomElement& destElement)
+void XdgMenuBuilder::appendChilds(XdgMenuElement* srcElement, XdgMenuElement* destElement)
 {
-    MutableDomElementIterator it(srcElement);
+    foreach (XdgMenuElement* e, srcElement->children())
+        destElement->appendChild(e);
 
-    while(it.hasNext())
-        destElement.appendChild(it.next());
-
-    if (srcElement.attributes().contains("deleted"))
-        destElement.setAttribute("deleted", srcElement.attribute("deleted"));
+    if (srcElement->hasAttribute("deleted"))
+        destElement->setAttribute("deleted", srcElement->attribute("deleted"));
 
-    if (srcElement.attributes().contains("onlyUnallocated"))
-        destElement.setAttribute("onlyUnallocated", srcElement.attribute("onlyUnallocated"));
+    if (srcElement->hasAttribute("onlyUnallocated"))
+        destElement->setAttribute("onlyUnallocated", srcElement->attribute("onlyUnallocated"));
 }
 
 
@@ -437,13 +795,60 @@ void XdgMenuPrivate::appendChilds(QDomElement& srcElement, QDomElement& destElem
  found, the behavior depends on a parameter "createNonExisting." If it's true, then
  the missing items will be created, otherwise the function returns 0.
  ************************************************/
+XdgMenuElement* findMenuElement(XdgMenuElement* baseElement, const QString& path, bool createNonExisting)
+{
+    // Absolute path ..................
+    if (path.startsWith('/'))
+    {
+        XdgMenuElement* root = baseElement->document()->root();
+        return findMenuElement(root, path.section('/', 2), createNonExisting);
+    }
+
+    // Relative path ..................
+    if (path.isEmpty())
+        return baseElement;
+
+
+    QString name = path.section('/', 0, 0);
+    foreach (XdgMenuElement* n, baseElement->children())
+    {
+        if (n->attribute("name") == name)
+            return findMenuElement(n, path.section('/', 1), createNonExisting);
+    }
+
+
+
+    // Not found ......................
+    if (!createNonExisting)
+        return 0;
+
+
+    QStringList names = path.split('/', QString::SkipEmptyParts);
+    XdgMenuElement* el = baseElement;
+    foreach (QString name, names)
+    {
+        XdgMenuElement* p = el;
+        el = baseElement->document()->createElement("Menu");
+        p->appendChild(el);
+        el->setAttribute("name", name);
+    }
+    return el;
+
+}
+
+
+/************************************************
+ The public API works with the documents returned
+ by xml(), the builder uses findMenuElement().
+ ************************************************/
 QDomElement XdgMenu::findMenu(QDomElement& baseElement, const QString& path, bool createNonExisting)
 {
-    Q_D(XdgMenu);
+    QDomDocument doc = baseElement.ownerDocument();
+
     // Absolute path ..................
     if (path.startsWith('/'))
     {
-        QDomElement root = d->mXml.documentElement();
+        QDomElement root = doc.documentElement();
         return findMenu(root, path.section('/', 2), createNonExisting);
     }
 
@@ -473,26 +878,23 @@ QDomElement XdgMenu::findMenu(QDomElement& baseElement, const QString& path, boo
     foreach (QString name, names)
     {
         QDomElement p = el;
-        el = d->mXml.createElement("Menu");
+        el = doc.createElement("Menu");
         p.appendChild(el);
         el.setAttribute("name", name);
     }
     return el;
-
 }
 
 
 /************************************************
 
  ************************************************/
-bool isParent(const QDomElement& parent, const QDomElement& child)
+bool isParent(const XdgMenuElement* parent, const XdgMenuElement* child)
 {
-    QDomNode  n = child;
-    while (!n.isNull())
+    for (const XdgMenuElement* n = child; n; n = n->parent())
     {
         if (n == parent)
             return true;
-        n = n.parentNode();
     }
     return false;
 }
@@ -509,39 +911,34 @@ bool isParent(const QDomElement& parent, const QDomElement& child)
  If both paths exist, take the origin <Menu> element, delete its <Name> element, and
  prepend its remaining child elements to the destination <Menu> element.
  ************************************************/
-void XdgMenuPrivate::moveMenus(QDomElement& element)
+void XdgMenuBuilder::moveMenus(XdgMenuElement* element)
 {
-    Q_Q(XdgMenu);
-
-    {
-        MutableDomElementIterator i(element, "Menu");
-        while(i.hasNext())
-            moveMenus(i.next());
-    }
+    foreach (XdgMenuElement* e, element->children("Menu"))
+        moveMenus(e);
 
-    MutableDomElementIterator i(element, "Move");
-    while(i.hasNext())
+    foreach (XdgMenuElement* move, element->children("Move"))
     {
-        i.next();
-        QString oldPath = i.current().lastChildElement("Old").text();
-        QString newPath = i.current().lastChildElement("New").text();
+        XdgMenuElement* oldElement = move->lastChild("Old");
+        XdgMenuElement* newElement = move->lastChild("New");
+        QString oldPath = oldElement ? oldElement->text() : QString();
+        QString newPath = newElement ? newElement->text() : QString();
 
-        element.removeChild(i.current());
+        element->removeChild(move);
 
         if (oldPath.isEmpty() || newPath.isEmpty())
             continue;
 
-        QDomElement oldMenu = q->findMenu(element, oldPath, false);
-        if (oldMenu.isNull())
+        XdgMenuElement* oldMenu = findMenuElement(element, oldPath, false);
+        if (!oldMenu)
             continue;
 
-        QDomElement newMenu = q->findMenu(element, newPath, true);
+        XdgMenuElement* newMenu = findMenuElement(element, newPath, true);
 
         if (isParent(oldMenu, newMenu))
             continue;
 
         appendChilds(oldMenu, newMenu);
-        oldMenu.parentNode().removeChild(oldMenu);
+        oldMenu->remove();
     }
 }
 
@@ -552,16 +949,14 @@ void XdgMenuPrivate::moveMenus(QDomElement& element)
 
  Kmenuedit create .hidden menu entry, delete it too.
  ************************************************/
-void XdgMenuPrivate::deleteDeletedMenus(QDomElement& element)
+void XdgMenuBuilder::deleteDeletedMenus(XdgMenuElement* element)
 {
-    MutableDomElementIterator i(element, "Menu");
-    while(i.hasNext())
+    foreach (XdgMenuElement* e, element->children("Menu"))
     {
-        QDomElement e = i.next();
-        if (e.attribute("deleted") == "1" ||
-            e.attribute("name") == ".hidden"
+        if (e->attribute("deleted") == "1" ||
+            e->attribute("name") == ".hidden"
             )
-            element.removeChild(e);
+            element->removeChild(e);
         else
             deleteDeletedMenus(e);
     }
@@ -572,29 +967,28 @@ void XdgMenuPrivate::deleteDeletedMenus(QDomElement& element)
 /************************************************
 
  ************************************************/
-void XdgMenuPrivate::processDirectoryEntries(QDomElement& element, const QStringList& parentDirs)
+void XdgMenuBuilder::processDirectoryEntries(XdgMenuElement* element, const QStringList& parentDirs)
 {
     QStringList dirs;
     QStringList files;
 
-    element.setAttribute("title", element.attribute("name"));
+    element->setAttribute("title", element->attribute("name"));
 
-    MutableDomElementIterator i(element, "");
-    i.toBack();
-    while(i.hasPrevious())
+    QList<XdgMenuElement*> childs = element->children();
+    for (int i=childs.count()-1; i>=0; --i)
     {
-        QDomElement e = i.previous();
+        XdgMenuElement* e = childs.at(i);
 
-        if (e.tagName() == "Directory")
+        if (e->tagName() == "Directory")
         {
-            files << e.text();
-            element.removeChild(e);
+            files << e->text();
+            element->removeChild(e);
         }
 
-        else if (e.tagName() == "DirectoryDir")
+        else if (e->tagName() == "DirectoryDir")
         {
-            dirs << e.text();
-            element.removeChild(e);
+            dirs << e->text();
+            element->removeChild(e);
         }
     }
 
@@ -616,12 +1010,8 @@ void XdgMenuPrivate::processDirectoryEntries(QDomElement& element, const QString
     }
 
 
-    MutableDomElementIterator it(element, "Menu");
-    while(it.hasNext())
-    {
-        QDomElement e = it.next();
+    foreach (XdgMenuElement* e, element->children("Menu"))
         processDirectoryEntries(e, dirs);
-    }
 
 }
 
@@ -629,8 +1019,12 @@ void XdgMenuPrivate::processDirectoryEntries(QDomElement& element, const QString
 /************************************************
 
  ************************************************/
-bool XdgMenuPrivate::loadDirectoryFile(const QString& fileName, QDomElement& element)
+bool XdgMenuBuilder::loadDirectoryFile(const QString& fileName, XdgMenuElement* element)
 {
+    // The file can be changed in place, so it's watched too.
+    addInput(QFileInfo(fileName).absolutePath());
+    addInput(fileName);
+
     XdgDesktopFile file;
     file.load(fileName);
 
@@ -638,12 +1032,9 @@ bool XdgMenuPrivate::loadDirectoryFile(const QString& fileName, QDomElement& ele
         return false;
 
 
-    element.setAttribute("title", file.localizedValue("Name").toString());
-    element.setAttribute("comment", file.localizedValue("Comment").toString());
-    element.setAttribute("icon", file.value("Icon").toString());
-
-    Q_Q(XdgMenu);
-    q->addWatchPath(QFileInfo(file.fileName()).absolutePath());
+    element->setAttribute("title", file.localizedValue("Name").toString());
+    element->setAttribute("comment", file.localizedValue("Comment").toString());
+    element->setAttribute("icon", file.value("Icon").toString());
     return true;
 }
 
@@ -651,10 +1042,9 @@ bool XdgMenuPrivate::loadDirectoryFile(const QString& fileName, QDomElement& ele
 /************************************************
 
  ************************************************/
-void XdgMenuPrivate::processApps(QDomElement& element)
+void XdgMenuBuilder::processApps(XdgMenuElement* element)
 {
-    Q_Q(XdgMenu);
-    XdgMenuApplinkProcessor processor(element, q);
+    XdgMenuApplinkProcessor processor(element, this);
     processor.run();
 }
 
@@ -662,29 +1052,23 @@ void XdgMenuPrivate::processApps(QDomElement& element)
 /************************************************
 
  ************************************************/
-void XdgMenuPrivate::deleteEmpty(QDomElement& element)
+void XdgMenuBuilder::deleteEmpty(XdgMenuElement* element)
 {
-    MutableDomElementIterator it(element, "Menu");
-    while(it.hasNext())
-        deleteEmpty(it.next());
+    foreach (XdgMenuElement* e, element->children("Menu"))
+        deleteEmpty(e);
 
-    if (element.attribute("keep") == "true")
+    if (element->attribute("keep") == "true")
         return;
 
-    QDomElement childMenu = element.firstChildElement("Menu");
-    QDomElement childApps = element.firstChildElement("AppLink");
-
-    if (childMenu.isNull() && childApps.isNull())
-    {
-        element.parentNode().removeChild(element);
-    }
+    if (!element->firstChild("Menu") && !element->firstChild("AppLink"))
+        element->remove();
 }
 
 
 /************************************************
 
  ************************************************/
-void XdgMenuPrivate::processLayouts(QDomElement& element)
+void XdgMenuBuilder::processLayouts(XdgMenuElement* element)
 {
     XdgMenuLayoutProcessor proc(element);
     proc.run();
@@ -694,30 +1078,28 @@ void XdgMenuPrivate::processLayouts(QDomElement& element)
 /************************************************
 
  ************************************************/
-void XdgMenuPrivate::fixSeparators(QDomElement& element)
+void XdgMenuBuilder::fixSeparators(XdgMenuElement* element)
 {
 
-    MutableDomElementIterator it(element, "Separator");
-    while(it.hasNext())
+    foreach (XdgMenuElement* s, element->children("Separator"))
     {
-        QDomElement s = it.next();
-        if (s.previousSiblingElement().tagName() == "Separator")
-            element.removeChild(s);
+        XdgMenuElement* prev = s->previousSibling();
+        if (prev && prev->tagName() == "Separator")
+            element->removeChild(s);
     }
 
 
-    QDomElement first = element.firstChild().toElement();
-    if (first.tagName() == "Separator")
-        element.removeChild(first);
+    XdgMenuElement* first = element->firstChild();
+    if (first && first->tagName() == "Separator")
+        element->removeChild(first);
 
-    QDomElement last = element.lastChild().toElement();
-    if (last.tagName() == "Separator")
-        element.removeChild(last);
+    XdgMenuElement* last = element->lastChild();
+    if (last && last->tagName() == "Separator")
+        element->removeChild(last);
 
 
-    MutableDomElementIterator mi(element, "Menu");
-    while(mi.hasNext())
-        fixSeparators(mi.next());
+    foreach (XdgMenuElement* e, element->children("Menu"))
+        fixSeparators(e);
 }
 
 
@@ -770,12 +1152,11 @@ void XdgMenu::addWatchPath(const QString &path)
 {
     Q_D(XdgMenu);
 
-    if (d->mWatcher.files().contains(path))
-        return;
-
-    if (d->mWatcher.directories().contains(path))
+    // The watched paths are the inputs of the build, they go to the cache manifest.
+    if (d->mInputs.contains(path))
         return;
 
+    d->mInputs << path;
     d->mWatcher.addPath(path);
 }
 
@@ -790,19 +1171,87 @@ bool XdgMenu::isOutDated() const
 }
 
 
+/************************************************
+
+ ************************************************/
+bool XdgMenu::isShared() const
+{
+    Q_D(const XdgMenu);
+    return d->mShared;
+}
+
+
+/************************************************
+
+ ************************************************/
+void XdgMenu::setShared(bool shared)
+{
+    Q_D(XdgMenu);
+    d->mShared = shared;
+    if (!shared)
+    {
+        d->unlockShared();
+        d->mClient = false;
+        d->mTakeoverTimer.stop();
+    }
+}
+
+
+/************************************************
+
+ ************************************************/
+void XdgMenuPrivate::pathChanged(const QString& path)
+{
+    mChangedPaths << path;
+    mRebuildDelayTimer.start();
+}
+
+
 /************************************************
 
  ************************************************/
 void XdgMenuPrivate::rebuild()
 {
     Q_Q(XdgMenu);
-    QByteArray prevHash = mHash;
-    q->read(mMenuFileName);
+    quint64 prevFingerprint = mFingerprint;
+    QExplicitlySharedDataPointer<XdgMenuTree> prevTree = mTree;
+
+    if (readShared(true))
+    {
+        mChangedPaths.clear();
+        if (prevFingerprint != mFingerprint)
+        {
+            mOutDated = true;
+            emit changed();
+            emit menuChanged(XdgMenuTree::diff(prevTree.data(), mTree.data()));
+        }
+        return;
+    }
 
-    if (prevHash != mHash)
+    bool structureChanged = !mStructure;
+    foreach (QString path, mChangedPaths)
+    {
+        if (mStructureInputs.contains(path))
+            structureChanged = true;
+    }
+    mChangedPaths.clear();
+
+    if (mAsync)
+    {
+        startBuild(structureChanged);
+        return;
+    }
+
+    if (structureChanged)
+        q->read(mMenuFileName);
+    else
+        setResult(build(buildRequest(false)));
+
+    if (prevFingerprint != mFingerprint)
     {
         mOutDated = true;
         emit changed();
+        emit menuChanged(XdgMenuTree::diff(prevTree.data(), mTree.data()));
     }
 }
 
@@ -812,9 +1261,157 @@ void XdgMenuPrivate::rebuild()
  ************************************************/
 void XdgMenuPrivate::clearWatcher()
 {
+    mInputs.clear();
+
     QStringList sl;
     sl << mWatcher.files();
     sl << mWatcher.directories();
     if (sl.length())
         mWatcher.removePaths(sl);
 }
+
+
+/************************************************
+ Uses the menu built by the previous run if none
+ of its inputs was changed since.
+ ************************************************/
+bool XdgMenuPrivate::loadCache()
+{
+    Q_Q(XdgMenu);
+    XdgMenuCache cache(mMenuFileName, mEnvironments);
+
+    QStringList inputs;
+    XdgMenuTree* tree = cache.load(&inputs);
+    if (!tree)
+        return false;
+
+    mTree = tree;
+    mFingerprint = tree->mFingerprint;
+
+    foreach (QString path, inputs)
+        q->addWatchPath(path);
+
+    return true;
+}
+
+
+/************************************************
+ The process holding the lock builds the menu and
+ keeps the cache up to date. The lock is released
+ by the system when the process exits.
+ ************************************************/
+bool XdgMenuPrivate::lockShared(const QString& cacheFileName)
+{
+    QString lockFileName = cacheFileName + ".lock";
+    if (mLockFd > -1 && mLockFileName == lockFileName)
+        return true;
+
+    unlockShared();
+    QDir().mkpath(QFileInfo(lockFileName).absolutePath());
+
+    int fd = ::open(QFile::encodeName(lockFileName).constData(), O_RDWR | O_CREAT, 0600);
+    if (fd < 0)
+        return false;
+
+    if (::flock(fd, LOCK_EX | LOCK_NB) != 0)
+    {
+        ::close(fd);
+        return false;
+    }
+
+    ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+    mLockFd = fd;
+    mLockFileName = lockFileName;
+    return true;
+}
+
+
+/************************************************
+
+ ************************************************/
+void XdgMenuPrivate::unlockShared()
+{
+    if (mLockFd < 0)
+        return;
+
+    ::close(mLockFd);
+    mLockFd = -1;
+    mLockFileName.clear();
+}
+
+
+/************************************************
+ Returns true if the menu published by another
+ process is used. Then only the directory of this
+ menu's cache is watched, the inputs are watched
+ by the owner. If the cache is outdated, the
+ current menu is kept until the owner publishes
+ the new one, if keepCurrent is true. Otherwise
+ the menu is built here, without writing the cache.
+ ************************************************/
+bool XdgMenuPrivate::readShared(bool keepCurrent)
+{
+    if (!mShared || !mLogDir.isEmpty())
+        return false;
+
+    XdgMenuCache cache(mMenuFileName, mEnvironments);
+    if (lockShared(cache.fileName()))
+    {
+        mClient = false;
+        mTakeoverTimer.stop();
+        return false;
+    }
+
+    mClient = true;
+    if (!mTakeoverTimer.isActive())
+        mTakeoverTimer.start();
+
+    QStringList inputs;
+    XdgMenuTree* tree = cache.load(&inputs);
+    if (!tree)
+    {
+        if (!keepCurrent || !mTree)
+            return false;
+
+        watchShared();
+        return true;
+    }
+
+    clearWatcher();
+    mTree = tree;
+    mFingerprint = tree->mFingerprint;
+    mStructure = 0;
+    mStructureInputs.clear();
+
+    watchShared();
+    return true;
+}
+
+
+/************************************************
+
+ ************************************************/
+void XdgMenuPrivate::watchShared()
+{
+    Q_Q(XdgMenu);
+    XdgMenuCache cache(mMenuFileName, mEnvironments);
+    QString dir = QFileInfo(cache.fileName()).absolutePath();
+    QDir().mkpath(dir);
+    q->addWatchPath(dir);
+}
+
+
+/************************************************
+ Takes over the building of the menu if the owner
+ has exited.
+ ************************************************/
+void XdgMenuPrivate::takeover()
+{
+    XdgMenuCache cache(mMenuFileName, mEnvironments);
+    if (!mClient || !lockShared(cache.fileName()))
+        return;
+
+    mClient = false;
+    mTakeoverTimer.stop();
+    mRebuildDelayTimer.start();
+}
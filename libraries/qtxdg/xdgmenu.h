@@ -34,6 +34,7 @@
 #include <QtCore/QString>
 #include <QtCore/QStringList>
 #include <QtXml/QDomDocument>
+#include "xdgmenunode.h"
 
 
 class QDomDocument;
@@ -56,7 +57,7 @@ class XdgMenuPrivate;
         QMessageBox::warning(this, "Parse error", xdgMenu.errorString());
     }
 
-    QDomElement rootElement = xdgMenu.xml().documentElement()
+    XdgMenuNode root = xdgMenu.rootNode();
  @endcode
 
  @sa http://specifications.freedesktop.org/menu-spec/menu-spec-latest.html
@@ -65,17 +66,33 @@ class XdgMenuPrivate;
 class XdgMenu : public QObject
 {
 Q_OBJECT
-    friend class XdgMenuReader;
-    friend class XdgMenuApplinkProcessor;
+    friend class XdgMenuPrivate;
 
 public:
     explicit XdgMenu(QObject *parent = 0);
     virtual ~XdgMenu();
 
     bool read(const QString& menuFileName);
+
+    /*!
+     * Starts reading the menu on a worker thread and returns immediately. The previous
+     * menu stays usable until the new one is published, then ready() is emitted.
+     * The later rebuilds after the changes of the files are made on the worker thread too.
+     */
+    void readAsync(const QString& menuFileName);
     void save(const QString& fileName);
 
+    /*!
+     * Returns the built menu as a XML document. The document is created from the
+     * menu tree on every call, use rootNode() to walk the menu.
+     */
     const QDomDocument xml() const;
+
+    /*!
+     * Returns the root menu of the built menu tree, or a null node if the menu
+     * has not been read yet.
+     */
+    XdgMenuNode rootNode() const;
     QString menuFileName() const;
 
     QDomElement findMenu(QDomElement& baseElement, const QString& path, bool createNonExisting);
@@ -99,6 +116,7 @@ public:
     /*!
      * @brief The name of the directory for the debug XML-files. If a directory is specified,
      * then after you run the XdgMenu::read, you can see and check the results of the each step.
+     * The time of the each step is written to the timings.tsv file in the same directory.
      */
     void setLogDir(const QString& directory);
 
@@ -106,9 +124,27 @@ public:
 
     bool isOutDated() const;
 
+    /*!
+     * The menu is shared by all processes of the session by default. The first process
+     * reading the menu builds and watches it, the others load the menu it publishes in
+     * the cache and watch only the cache file. When the building process exits, another
+     * one takes over. Disable sharing to always build the menu in this process.
+     */
+    bool isShared() const;
+    void setShared(bool shared);
+
 signals:
     void changed();
 
+    /*!
+     * Emitted together with changed(), the diff describes the applications added to,
+     * removed from or modified in each menu, so the consumer can update only them.
+     */
+    void menuChanged(const XdgMenuDiff& diff);
+
+    /// Emitted when the menu started by readAsync() is built, see errorString() on failure.
+    void ready(bool success);
+
 protected:
     void addWatchPath(const QString& path);
 
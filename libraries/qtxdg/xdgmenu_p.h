@@ -27,58 +27,178 @@
 
 
 #include "xdgmenu.h"
+#include "xdgmenunode_p.h"
+#include "xdgmenuelement_p.h"
+#include "xdgmenucache_p.h"
 #include <QtCore/QObject>
 #include <QtCore/QFileSystemWatcher>
 #include <QtCore/QTimer>
+#include <QtCore/QTime>
+#include <QtCore/QSet>
+#include <QtCore/QFutureWatcher>
 
 #define REBUILD_DELAY 3000
+#define TAKEOVER_INTERVAL 60000
 
-class QDomElement;
 class QStringList;
 class QString;
 class QDomDocument;
 
+/*! The XdgMenuBuilder class runs the stages of the menu build. It's a plain object
+    without timers and watchers, so it can be used on any thread: XdgMenu creates one
+    for every build, on the worker thread for readAsync(). The desktop files are the
+    snapshots from the XdgDesktopFileCache. The paths of the read files are only
+    collected as the inputs, they are watched by the XdgMenu.
+    The stages work on the XdgMenuDocument, the result is compacted into the
+    XdgMenuTree. The document after the processDirectoryEntries() stage is kept as
+    the structure, it's never changed, so it's shared with the next builds. */
+class XdgMenuBuilder
+{
+public:
+    XdgMenuBuilder(const QString& menuFileName, const QStringList& environments, const QString& logDir);
+
+    //! Runs all stages.
+    bool read();
+
+    //! Runs only the stages which depend on the desktop files.
+    void rebuildApps(const QExplicitlySharedDataPointer<XdgMenuDocument>& structure, const XdgMenuCacheStamps& structureInputs);
+
+    QString menuFileName() const { return mMenuFileName; }
+    QStringList environments() const { return mEnvironments; }
+    //! The path is stamped when it's added, call it before reading the file.
+    void addInput(const QString& path);
+    //! The desktop files aren't watched, they are only checked by the XdgMenuCache.
+    void addFile(const QString& path, const XdgMenuCacheStamp& stamp) { mFiles.insert(path, stamp); }
+
+    void simplify(XdgMenuElement* element);
+    void mergeMenus(XdgMenuElement* element);
+    void moveMenus(XdgMenuElement* element);
+    void deleteDeletedMenus(XdgMenuElement* element);
+    void processDirectoryEntries(XdgMenuElement* element, const QStringList& parentDirs);
+    void processApps(XdgMenuElement* element);
+    void deleteEmpty(XdgMenuElement* element);
+    void processLayouts(XdgMenuElement* element);
+    void fixSeparators(XdgMenuElement* element);
+
+    void buildApps();
+
+    bool loadDirectoryFile(const QString& fileName, XdgMenuElement* element);
+    void prependChilds(XdgMenuElement* srcElement, XdgMenuElement* destElement);
+    void appendChilds(XdgMenuElement* srcElement, XdgMenuElement* destElement);
+
+    void saveLog(const QString& logFileName);
+    void saveTimings();
+
+    QString mMenuFileName;
+    QStringList mEnvironments;
+    QString mLogDir;
+    QString mErrorString;
+    QTime mStageTime;
+    QStringList mTimings;
+    QExplicitlySharedDataPointer<XdgMenuDocument> mDocument;
+    QExplicitlySharedDataPointer<XdgMenuDocument> mStructure;
+    XdgMenuCacheStamps mStructureInputs;
+    XdgMenuCacheStamps mInputs;
+    XdgMenuCacheStamps mFiles;
+    QExplicitlySharedDataPointer<XdgMenuTree> mTree;
+    bool mSaveCache;
+};
+
+
+/*! The arguments of the menu build, they are copied to the worker thread. The
+    structure is used only for the rebuild of the applications part. The clients
+    of the shared menu never write the cache, it's published by the owner. */
+struct XdgMenuBuildRequest
+{
+    XdgMenuBuildRequest(): saveCache(true) {}
+
+    QString menuFileName;
+    QStringList environments;
+    QString logDir;
+    QExplicitlySharedDataPointer<XdgMenuDocument> structure;
+    XdgMenuCacheStamps structureInputs;
+    bool saveCache;
+};
+
+
+/*! The result of the menu build on the worker thread. The tree and the structure
+    are immutable, so they can be used on any thread. */
+struct XdgMenuBuildResult
+{
+    XdgMenuBuildResult(): ok(false), fingerprint(0) {}
+
+    bool ok;
+    QString errorString;
+    QExplicitlySharedDataPointer<XdgMenuTree> tree;
+    quint64 fingerprint;
+    QSet<QString> inputs;
+    QExplicitlySharedDataPointer<XdgMenuDocument> structure;
+    XdgMenuCacheStamps structureInputs;
+};
+
+
 class XdgMenuPrivate: QObject
 {
 Q_OBJECT
 public:
     XdgMenuPrivate(XdgMenu* parent);
+    ~XdgMenuPrivate();
 
-    void simplify(QDomElement& element);
-    void mergeMenus(QDomElement& element);
-    void moveMenus(QDomElement& element);
-    void deleteDeletedMenus(QDomElement& element);
-    void processDirectoryEntries(QDomElement& element, const QStringList& parentDirs);
-    void processApps(QDomElement& element);
-    void deleteEmpty(QDomElement& element);
-    void processLayouts(QDomElement& element);
-    void fixSeparators(QDomElement& element);
+    QDomDocument document() const;
 
-    bool loadDirectoryFile(const QString& fileName, QDomElement& element);
-    void prependChilds(QDomElement& srcElement, QDomElement& destElement);
-    void appendChilds(QDomElement& srcElement, QDomElement& destElement);
+    bool loadCache();
+    void setResult(const XdgMenuBuildResult& result);
+    void setInputs(const QSet<QString>& inputs);
 
-    void saveLog(const QString& logFileName);
-    void load(const QString& fileName);
+    bool lockShared(const QString& cacheFileName);
+    void unlockShared();
+    bool readShared(bool keepCurrent = false);
+    void watchShared();
 
     void clearWatcher();
 
+    void startBuild(bool full);
+    XdgMenuBuildRequest buildRequest(bool full) const;
+    static XdgMenuBuildResult build(const XdgMenuBuildRequest& request);
+
     QString mErrorString;
     QStringList mEnvironments;
     QString mMenuFileName;
     QString mLogDir;
-    QDomDocument mXml;
-    QByteArray mHash;
+    QExplicitlySharedDataPointer<XdgMenuDocument> mStructure;
+    XdgMenuCacheStamps mStructureInputs;
+    QSet<QString> mChangedPaths;
+    QExplicitlySharedDataPointer<XdgMenuTree> mTree;
+    quint64 mFingerprint;
     QTimer mRebuildDelayTimer;
 
     QFileSystemWatcher mWatcher;
+    QSet<QString> mInputs;
     bool mOutDated;
 
+    QFutureWatcher<XdgMenuBuildResult> mBuildWatcher;
+    bool mAsync;
+    bool mEmitReady;
+    bool mBuildPending;
+    bool mPendingFull;
+
+    bool mShared;
+    bool mClient;
+    int mLockFd;
+    QString mLockFileName;
+    QTimer mTakeoverTimer;
+
 public slots:
     void rebuild();
+    void pathChanged(const QString& path);
+    void buildFinished();
+    void takeover();
+    void emitReady();
 
 signals:
     void changed();
+    void menuChanged(const XdgMenuDiff& diff);
+    void ready(bool success);
 
 
 private:
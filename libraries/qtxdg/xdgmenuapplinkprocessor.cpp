@@ -26,32 +26,31 @@
  * END_COMMON_COPYRIGHT_HEADER */
 
 
-#include "xdgmenu.h"
+#include "xdgmenu_p.h"
 #include "xdgmenuapplinkprocessor.h"
-#include "xmlhelper.h"
+#include "xdgmenuelement_p.h"
 #include "xdgdesktopfile.h"
+#include "xdgpathindex.h"
 
 #include <QDir>
+#include <QSet>
 
 
 /************************************************
 
  ************************************************/
-XdgMenuApplinkProcessor::XdgMenuApplinkProcessor(QDomElement& element,  XdgMenu* menu, XdgMenuApplinkProcessor *parent) :
+XdgMenuApplinkProcessor::XdgMenuApplinkProcessor(XdgMenuElement* element,  XdgMenuBuilder* builder, XdgMenuApplinkProcessor *parent) :
     QObject(parent)
 {
     mElement = element;
     mParent = parent;
-    mMenu = menu;
+    mRoot = parent ? parent->mRoot : this;
+    mBuilder = builder;
 
-    mOnlyUnallocated = element.attribute("onlyUnallocated") == "1";
+    mOnlyUnallocated = element->attribute("onlyUnallocated") == "1";
 
-    MutableDomElementIterator i(element, "Menu");
-    while(i.hasNext())
-    {
-        QDomElement e = i.next();
-        mChilds.append(new XdgMenuApplinkProcessor(e, mMenu, this));
-    }
+    foreach (XdgMenuElement* e, element->children("Menu"))
+        mChilds.append(new XdgMenuApplinkProcessor(e, mBuilder, this));
 
 }
 
@@ -82,25 +81,27 @@ void XdgMenuApplinkProcessor::step1()
     fillAppFileInfoList();
     createRules();
 
-    // Check Include rules & mark as allocated ............
-    XdgMenuAppFileInfoHashIterator i(mAppFileInfoHash);
-    while(i.hasNext())
+    if (mRules.isCompiled())
     {
-        i.next();
-        XdgDesktopFile* file = i.value()->desktopFile();
+        // Check Include rules & mark as allocated ........
+        QBitArray included = evaluate(mRules.includeProgram(), mPool);
+        QBitArray excluded = evaluate(mRules.excludeProgram(), mPool);
 
-        if (mRules.checkInclude(i.key(), *file))
+        for (int n=0; n<included.size(); ++n)
         {
-            if (!mOnlyUnallocated)
-                i.value()->setAllocated(true);
+            if (!included.testBit(n))
+                continue;
 
-            if (!mRules.checkExclude(i.key(), *file))
-            {
-                mSelected.append(i.value());
-            }
+            XdgMenuAppFileInfo* fileInfo = mRoot->mApps.at(n);
+            if (!mOnlyUnallocated)
+                fileInfo->setAllocated(true);
 
+            if (!excluded.testBit(n))
+                mSelected.append(fileInfo);
         }
     }
+    else
+        checkRules();
 
     // Process childs menus ...............................
     foreach (XdgMenuApplinkProcessor* child, mChilds)
@@ -108,28 +109,60 @@ void XdgMenuApplinkProcessor::step1()
 }
 
 
+/************************************************
+ The slow path, the XdgMenuRule objects check
+ the files one by one.
+ ************************************************/
+void XdgMenuApplinkProcessor::checkRules()
+{
+    // Check Include rules & mark as allocated ............
+    for (int n=0; n<mPool.size(); ++n)
+    {
+        if (!mPool.testBit(n))
+            continue;
+
+        XdgMenuAppFileInfo* fileInfo = mRoot->mApps.at(n);
+        const XdgDesktopFile* file = &fileInfo->desktopFile();
+
+        if (mRules.checkInclude(fileInfo->id(), *file))
+        {
+            if (!mOnlyUnallocated)
+                fileInfo->setAllocated(true);
+
+            if (!mRules.checkExclude(fileInfo->id(), *file))
+            {
+                mSelected.append(fileInfo);
+            }
+
+        }
+    }
+}
+
+
 /************************************************
 
  ************************************************/
 void XdgMenuApplinkProcessor::step2()
 {
     // Create AppLinks elements ...........................
-    QDomDocument doc = mElement.ownerDocument();
+    XdgMenuDocument* doc = mElement->document();
+    QStringList environments = mBuilder->environments();
+    quint64 environmentMask = XdgDesktopFile::environmentMask(environments);
 
     foreach (XdgMenuAppFileInfo* fileInfo, mSelected)
     {
         if (mOnlyUnallocated && fileInfo->allocated())
             continue;
 
-        XdgDesktopFile* file = fileInfo->desktopFile();
+        const XdgDesktopFile* file = &fileInfo->desktopFile();
 
         // Means "this application exists, but don't display it in the menus".
-        if (file->value("NoDisplay").toBool())
+        if (file->noDisplay())
             continue;
 
         // Hidden should have been called Deleted. It means the user deleted
         // (at his level) something that was present
-        if (file->value("Hidden").toBool())
+        if (file->isHidden())
             continue;
 
         // File name of a binary on disk used to determine if the program is
@@ -140,58 +173,24 @@ void XdgMenuApplinkProcessor::step2()
 
         // A list of strings identifying the environments that should display/not
         // display a given desktop entry.
-        // OnlyShowIn ........
-        if (file->contains("OnlyShowIn"))
-        {
-            QString s = ";" + file->value("OnlyShowIn").toString() + ";";
-            bool show = false;
-            foreach (QString env, mMenu->environments())
-            {
-                if (s.contains(env))
-                {
-                    show = true;
-                    break;
-                }
-            }
-
-            if (!show)
-                continue;
-        }
-
-        // NotShowIn .........
-        if (file->contains("NotShowIn"))
-        {
-            QString s = ";" + file->value("NotShowIn").toString() + ";";
-            bool show = true;
-            foreach (QString env, mMenu->environments())
-            {
-                if (s.contains(env))
-                {
-                    show = false;
-                    break;
-                }
-            }
-
-            if (!show)
-                continue;
-        }
-
+        if (!file->isShownIn(environments, environmentMask))
+            continue;
 
 
-        QDomElement appLink = doc.createElement("AppLink");
+        XdgMenuElement* appLink = doc->createElement("AppLink");
 
-        appLink.setAttribute("id", fileInfo->id());
-        appLink.setAttribute("title", file->localizedValue("Name").toString());
-        appLink.setAttribute("comment", file->localizedValue("Comment").toString());
-        appLink.setAttribute("genericName", file->localizedValue("GenericName").toString());
-        appLink.setAttribute("exec", file->value("Exec").toString());
-        appLink.setAttribute("terminal", file->value("Terminal").toBool());
-        appLink.setAttribute("startupNotify", file->value("StartupNotify").toBool());
-        appLink.setAttribute("path", file->value("Path").toString());
-        appLink.setAttribute("icon", file->value("Icon").toString());
-        appLink.setAttribute("desktopFile", file->fileName());
+        appLink->setAttribute("id", fileInfo->id());
+        appLink->setAttribute("title", file->localizedValue("Name").toString());
+        appLink->setAttribute("comment", file->localizedValue("Comment").toString());
+        appLink->setAttribute("genericName", file->localizedValue("GenericName").toString());
+        appLink->setAttribute("exec", file->value("Exec").toString());
+        appLink->setAttribute("terminal", file->terminal());
+        appLink->setAttribute("startupNotify", file->value("StartupNotify").toBool());
+        appLink->setAttribute("path", file->value("Path").toString());
+        appLink->setAttribute("icon", file->value("Icon").toString());
+        appLink->setAttribute("desktopFile", file->fileName());
 
-        mElement.appendChild(appLink);
+        mElement->appendChild(appLink);
 
     }
 
@@ -214,45 +213,117 @@ void XdgMenuApplinkProcessor::step2()
 void XdgMenuApplinkProcessor::fillAppFileInfoList()
 {
     // Build a pool by collecting entries found in <AppDir>
+    QList<XdgMenuAppFileInfo*> found;
+    QList<XdgMenuElement*> appDirs = mElement->children("AppDir");
+    for (int i=appDirs.count()-1; i>=0; --i)
     {
-        MutableDomElementIterator i(mElement, "AppDir");
-        i.toBack();
-        while(i.hasPrevious())
-        {
-            QDomElement e = i.previous();
-            findDesktopFiles(e.text(), "");
-            mElement.removeChild(e);
-        }
+        found << appDirFiles(appDirs.at(i)->text());
+        appDirs.at(i)->remove();
     }
 
     // Add the entries for ancestor <Menu> ................
+    // The parent's pool is shared until the own entries are added.
     if (mParent)
+        mPool = mParent->mPool;
+    mPool.resize(mRoot->mAppTable.count());
+
+    // The own entry replaces the entry with the same id, both the
+    // ancestor's one and the one found in another <AppDir>. So every
+    // id is in the pool once and the rules evaluate it once.
+    foreach (XdgMenuAppFileInfo* fileInfo, found)
     {
-        XdgMenuAppFileInfoHashIterator i(mParent->mAppFileInfoHash);
-        while(i.hasNext())
-        {
-            i.next();
-            //if (!mAppFileInfoHash.contains(i.key()))
-                mAppFileInfoHash.insert(i.key(), i.value());
-        }
+        XdgMenuAppFileInfo* prev = findAppFileInfo(fileInfo->id());
+        if (prev)
+            mPool.clearBit(prev->index());
+
+        mAppFileInfoHash.insert(fileInfo->id(), fileInfo);
+        mPool.setBit(fileInfo->index());
     }
+
+#ifndef QT_NO_DEBUG
+    QSet<QString> poolIds;
+    for (int n=0; n<mPool.size(); ++n)
+    {
+        if (!mPool.testBit(n))
+            continue;
+
+        QString id = mRoot->mApps.at(n)->id();
+        Q_ASSERT(!poolIds.contains(id));
+        poolIds << id;
+    }
+#endif
 }
 
 
 /************************************************
+ Returns the entries of the <AppDir>. The same
+ directory is used by many menus, so it's scanned
+ only once per build.
+ ************************************************/
+QList<XdgMenuAppFileInfo*> XdgMenuApplinkProcessor::appDirFiles(const QString& dirName)
+{
+    QHash<QString, QList<XdgMenuAppFileInfo*> >::const_iterator it = mRoot->mAppDirs.constFind(dirName);
+    if (it != mRoot->mAppDirs.constEnd())
+        return it.value();
+
+    QStringList ids;
+    QStringList fileNames;
+    findDesktopFiles(dirName, "", &ids, &fileNames);
+
+    // The files are parsed in parallel, here we only wait for them.
+    XdgDesktopFileCache::preload(fileNames);
+
+    QList<XdgMenuAppFileInfo*> res;
+    for (int n=0; n<fileNames.count(); ++n)
+    {
+        XdgMenuCacheStamp stamp;
+        XdgDesktopFile f = XdgDesktopFileCachePrivate::instance()->snapshot(fileNames.at(n), &stamp.rec, &stamp.exists);
+        mBuilder->addFile(fileNames.at(n), stamp);
+        XdgMenuAppFileInfo* fileInfo = new XdgMenuAppFileInfo(f, ids.at(n), mRoot->mAppTable.add(f), mRoot);
+        mRoot->mApps << fileInfo;
+        res << fileInfo;
+    }
 
+    mRoot->mAppDirs.insert(dirName, res);
+    return res;
+}
+
+
+/************************************************
+ The entries of the child menu hide the entries
+ of the ancestors with the same id.
  ************************************************/
-void XdgMenuApplinkProcessor::findDesktopFiles(const QString& dirName, const QString& prefix)
+XdgMenuAppFileInfo* XdgMenuApplinkProcessor::findAppFileInfo(const QString& id) const
+{
+    for (const XdgMenuApplinkProcessor* p = this; p; p = p->mParent)
+    {
+        XdgMenuAppFileInfo* fileInfo = p->mAppFileInfoHash.value(id);
+        if (fileInfo)
+            return fileInfo;
+    }
+
+    return 0;
+}
+
+
+/************************************************
+ Only the directories are canonicalized, the file
+ names are built from the canonical directory.
+ ************************************************/
+void XdgMenuApplinkProcessor::findDesktopFiles(const QString& dirName, const QString& prefix, QStringList* ids, QStringList* fileNames)
 {
     QDir dir(dirName);
-    mMenu->addWatchPath(dir.absolutePath());
-    QFileInfoList files = dir.entryInfoList(QStringList("*.desktop"), QDir::Files);
+    mBuilder->addInput(dir.absolutePath());
+
+    QString path = dir.canonicalPath();
+    if (path.isEmpty())
+        return;
+    path += '/';
 
-    foreach (QFileInfo file, files)
+    foreach (QString file, dir.entryList(QStringList("*.desktop"), QDir::Files))
     {
-        XdgDesktopFile* f = XdgDesktopFileCache::getFile(file.canonicalFilePath());
-        if (f)
-            mAppFileInfoHash.insert(prefix + file.fileName(), new XdgMenuAppFileInfo(f, prefix + file.fileName(), this));
+        (*ids) << prefix + file;
+        (*fileNames) << path + file;
     }
 
 
@@ -263,7 +334,7 @@ void XdgMenuApplinkProcessor::findDesktopFiles(const QString& dirName, const QSt
         QString dn = d.canonicalFilePath();
         if (dn != dirName)
         {
-            findDesktopFiles(dn, QString("%1%2-").arg(prefix, d.fileName()));
+            findDesktopFiles(dn, QString("%1%2-").arg(prefix, d.fileName()), ids, fileNames);
         }
     }
 }
@@ -274,20 +345,18 @@ void XdgMenuApplinkProcessor::findDesktopFiles(const QString& dirName, const QSt
  ************************************************/
 void XdgMenuApplinkProcessor::createRules()
 {
-    MutableDomElementIterator i(mElement, "");
-    while(i.hasNext())
+    foreach (XdgMenuElement* e, mElement->children())
     {
-        QDomElement e = i.next();
-        if (e.tagName()=="Include")
+        if (e->tagName()=="Include")
         {
             mRules.addInclude(e);
-            mElement.removeChild(e);
+            e->remove();
         }
 
-        else if (e.tagName()=="Exclude")
+        else if (e->tagName()=="Exclude")
         {
             mRules.addExclude(e);
-            mElement.removeChild(e);
+            e->remove();
         }
     }
 
@@ -295,21 +364,28 @@ void XdgMenuApplinkProcessor::createRules()
 
 
 /************************************************
- Check if the program is actually installed.
+ Evaluates the compiled rules over all files of the
+ pool at once.
  ************************************************/
-bool XdgMenuApplinkProcessor::checkTryExec(const QString& progName)
+QBitArray XdgMenuApplinkProcessor::evaluate(const XdgMenuRuleProgram& program, const QBitArray& pool)
 {
-    if (progName.startsWith(QDir::separator()))
-        return QFileInfo(progName).isExecutable();
-
-    QStringList dirs = QString(getenv("PATH")).split(":");
-
-    foreach (QString dir, dirs)
+    QVector<int> fileNameApps;
+    fileNameApps.reserve(program.fileNames().count());
+    foreach (QString id, program.fileNames())
     {
-        if (QFileInfo(QDir(dir), progName).isExecutable())
-            return true;
+        XdgMenuAppFileInfo* fileInfo = findAppFileInfo(id);
+        fileNameApps << (fileInfo ? fileInfo->index() : -1);
     }
 
-    return false;
+    return program.evaluate(mRoot->mAppTable, pool, fileNameApps);
+}
+
+
+/************************************************
+ Check if the program is actually installed.
+ ************************************************/
+bool XdgMenuApplinkProcessor::checkTryExec(const QString& progName)
+{
+    return XdgPathIndex::isExecutable(progName);
 }
 
@@ -30,15 +30,18 @@
 #define QTXDG_XDGMENUAPPLINKPROCESSOR_H
 
 #include "xdgmenurules.h"
+#include "xdgdesktopfile.h"
 #include <QtCore/QObject>
-#include <QtXml/QDomElement>
 #include <QtCore/QLinkedList>
 #include <QtCore/QString>
+#include <QtCore/QStringList>
 #include <QtCore/QHash>
+#include <QtCore/QVector>
+#include <QtCore/QBitArray>
 
-class XdgMenu;
+class XdgMenuBuilder;
+class XdgMenuElement;
 class XdgMenuAppFileInfo;
-class XdgDesktopFile;
 
 typedef QLinkedList<XdgMenuAppFileInfo*> XdgMenuAppFileInfoList;
 
@@ -49,7 +52,7 @@ class XdgMenuApplinkProcessor : public QObject
 {
     Q_OBJECT
 public:
-    explicit XdgMenuApplinkProcessor(QDomElement& element, XdgMenu* menu, XdgMenuApplinkProcessor *parent = 0);
+    explicit XdgMenuApplinkProcessor(XdgMenuElement* element, XdgMenuBuilder* builder, XdgMenuApplinkProcessor *parent = 0);
     virtual ~XdgMenuApplinkProcessor();
     void run();
 
@@ -57,22 +60,35 @@ protected:
     void step1();
     void step2();
     void fillAppFileInfoList();
-    void findDesktopFiles(const QString& dirName, const QString& prefix);
+    QList<XdgMenuAppFileInfo*> appDirFiles(const QString& dirName);
+    XdgMenuAppFileInfo* findAppFileInfo(const QString& id) const;
+    void findDesktopFiles(const QString& dirName, const QString& prefix, QStringList* ids, QStringList* fileNames);
 
-    //bool loadDirectoryFile(const QString& fileName, QDomElement& element);
+    //bool loadDirectoryFile(const QString& fileName, XdgMenuElement* element);
     void createRules();
+    void checkRules();
+    QBitArray evaluate(const XdgMenuRuleProgram& program, const QBitArray& pool);
     bool checkTryExec(const QString& progName);
 
 private:
     XdgMenuApplinkProcessor* mParent;
+    XdgMenuApplinkProcessor* mRoot;
     QLinkedList<XdgMenuApplinkProcessor*> mChilds;
+    // Only the entries of the own <AppDir>s, the entries of the ancestors are
+    // looked up in the parents. The pool has a bit for each visible entry.
     XdgMenuAppFileInfoHash mAppFileInfoHash;
+    QBitArray mPool;
     XdgMenuAppFileInfoList mSelected;
-    QDomElement mElement;
+    XdgMenuElement* mElement;
     bool mOnlyUnallocated;
 
-    XdgMenu* mMenu;
+    XdgMenuBuilder* mBuilder;
     XdgMenuRules mRules;
+
+    // Only the root processor fills them, the indexes are shared by all menus.
+    XdgMenuRuleAppTable mAppTable;
+    QVector<XdgMenuAppFileInfo*> mApps;
+    QHash<QString, QList<XdgMenuAppFileInfo*> > mAppDirs;
 };
 
 
@@ -80,22 +96,27 @@ class XdgMenuAppFileInfo: public QObject
 {
     Q_OBJECT
 public:
-    explicit XdgMenuAppFileInfo(XdgDesktopFile* desktopFile, const QString& id,  QObject *parent)
+    explicit XdgMenuAppFileInfo(const XdgDesktopFile& desktopFile, const QString& id, int index, QObject *parent)
         : QObject(parent)
     {
         mDesktopFile = desktopFile;
         mAllocated = false;
         mId = id;
+        mIndex = index;
     }
 
-    XdgDesktopFile* desktopFile() const { return mDesktopFile; }
+    /// The snapshot of the cached file, it isn't changed by the reloads during the build.
+    const XdgDesktopFile& desktopFile() const { return mDesktopFile; }
     bool allocated() const { return mAllocated; }
     void setAllocated(bool value) { mAllocated = value; }
     QString id() const { return mId; }
+    /// The index in the XdgMenuRuleAppTable of the menu build.
+    int index() const { return mIndex; }
 private:
-    XdgDesktopFile* mDesktopFile;
+    XdgDesktopFile mDesktopFile;
     bool mAllocated;
     QString mId;
+    int mIndex;
 };
 
 
@@ -0,0 +1,214 @@
+/* BEGIN_COMMON_COPYRIGHT_HEADER
+ * (c)LGPL2+
+ *
+ * Razor - a lightweight, Qt based, desktop toolset
+ * http://razor-qt.org
+ *
+ * Copyright: 2010-2012 Razor team
+ * Authors:
+ *   Alexander Sokoloff <sokoloff.a@gmail.com>
+ *
+ * This program or library is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA
+ *
+ * END_COMMON_COPYRIGHT_HEADER */
+
+#include "xdgmenucache_p.h"
+#include "xdgmenunode_p.h"
+#include "xdgdesktopfile.h"
+#include "xdgdesktopfilecache_p.h"
+#include "xdgdirs.h"
+
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QDir>
+#include <QtCore/QDataStream>
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QtAlgorithms>
+#include <QtCore/QDebug>
+#include <QtCore/QThread>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define MENU_CACHE_MAGIC   0x51584d43  // "QXMC"
+#define MENU_CACHE_VERSION 4
+
+
+/************************************************
+ The TryExec keys depend on the PATH, the other
+ variables select the menu and application dirs.
+ Every menu has its own directory, the clients
+ watch it and see only the changes of this menu.
+ ************************************************/
+XdgMenuCache::XdgMenuCache(const QString& menuFileName, const QStringList& environments)
+{
+    // The order of the environments doesn't change the menu.
+    QStringList envs = environments;
+    envs.removeDuplicates();
+    qSort(envs);
+
+    QStringList key;
+    key << QFileInfo(menuFileName).absoluteFilePath();
+    key << envs.join(";");
+    key << XdgDesktopFile::localeNames().join(";");
+
+    const char* vars[] = { "XDG_MENU_PREFIX", "XDG_CONFIG_HOME", "XDG_CONFIG_DIRS",
+                           "XDG_DATA_HOME", "XDG_DATA_DIRS", "PATH", 0 };
+    for (int i=0; vars[i]; ++i)
+        key << QString::fromLocal8Bit(getenv(vars[i]));
+
+    mKey = key.join("\n");
+
+    QByteArray hash = QCryptographicHash::hash(mKey.toUtf8(), QCryptographicHash::Md5);
+    mFileName = QString("%1/qtxdg/menu-%2/menu.cache")
+                    .arg(XdgDirs::cacheHome(false), QString::fromLatin1(hash.toHex()));
+}
+
+
+/************************************************
+ Reads the paths of the manifest, returns false if
+ any of them was changed since the cache was saved.
+ ************************************************/
+static bool readManifest(QDataStream& stream, QStringList* paths)
+{
+    quint32 count;
+    stream >> count;
+    for (quint32 n=0; n<count && stream.status() == QDataStream::Ok; ++n)
+    {
+        QString path;
+        bool exists;
+        XdgDesktopFileCacheFile::Record rec;
+        stream >> path >> exists >> rec.mtime >> rec.mtimeNsec >> rec.size >> rec.inode;
+
+        XdgDesktopFileCacheFile::Record cur;
+        bool curExists = XdgDesktopFileCacheFile::fileStat(path, &cur);
+        if (curExists != exists)
+            return false;
+
+        if (exists && !cur.sameFile(rec))
+            return false;
+
+        if (paths)
+            *paths << path;
+    }
+
+    return stream.status() == QDataStream::Ok;
+}
+
+
+/************************************************
+ The stamps are the ones taken when the build read
+ the paths, not the current ones. If a path was
+ changed during the build, the cache is rejected
+ by the next load.
+ ************************************************/
+static void writeManifest(QDataStream& stream, const XdgMenuCacheStamps& stamps)
+{
+    stream << (quint32)stamps.count();
+    XdgMenuCacheStamps::ConstIterator i;
+    for (i = stamps.constBegin(); i != stamps.constEnd(); ++i)
+    {
+        const XdgDesktopFileCacheFile::Record& rec = i.value().rec;
+        stream << i.key() << i.value().exists << rec.mtime << rec.mtimeNsec << rec.size << rec.inode;
+    }
+}
+
+
+/************************************************
+
+ ************************************************/
+XdgMenuCacheStamp XdgMenuCacheStamp::current(const QString& path)
+{
+    XdgMenuCacheStamp stamp;
+    stamp.exists = XdgDesktopFileCacheFile::fileStat(path, &stamp.rec);
+    if (!stamp.exists)
+        stamp = XdgMenuCacheStamp();
+
+    return stamp;
+}
+
+
+/************************************************
+
+ ************************************************/
+XdgMenuTree* XdgMenuCache::load(QStringList* inputs) const
+{
+    QFile file(mFileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return 0;
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_4_6);
+
+    quint32 magic, version;
+    QString key;
+    stream >> magic >> version;
+    if (magic != MENU_CACHE_MAGIC || version != MENU_CACHE_VERSION)
+        return 0;
+
+    stream >> key;
+    if (key != mKey)
+        return 0;
+
+    // Check the manifest ............................
+    QStringList paths;
+    if (!readManifest(stream, &paths) || !readManifest(stream, 0))
+        return 0;
+
+    XdgMenuTree* tree = XdgMenuTree::load(stream);
+    if (!tree)
+        return 0;
+
+    *inputs = paths;
+    return tree;
+}
+
+
+/************************************************
+ The file is written to the temporary file and
+ renamed, so the other processes never read the
+ partially written cache.
+ ************************************************/
+void XdgMenuCache::save(const XdgMenuTree& tree, const XdgMenuCacheStamps& inputs, const XdgMenuCacheStamps& files) const
+{
+    QDir().mkpath(QFileInfo(mFileName).absolutePath());
+    // Several XdgMenu objects of one process can save at once.
+    QString tmpName = QString("%1.%2.%3").arg(mFileName).arg(getpid())
+                          .arg(quintptr(QThread::currentThreadId()));
+    QFile file(tmpName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        qWarning() << QString("XdgMenuCache: can't write %1: %2").arg(tmpName, file.errorString());
+        return;
+    }
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_4_6);
+    stream << (quint32)MENU_CACHE_MAGIC << (quint32)MENU_CACHE_VERSION << mKey;
+
+    writeManifest(stream, inputs);
+    writeManifest(stream, files);
+
+    tree.save(stream);
+    file.close();
+
+    if (::rename(QFile::encodeName(tmpName).constData(), QFile::encodeName(mFileName).constData()) != 0)
+    {
+        qWarning() << "XdgMenuCache: can't rename" << tmpName << "to" << mFileName;
+        QFile::remove(tmpName);
+    }
+}
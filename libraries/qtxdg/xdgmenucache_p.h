@@ -0,0 +1,87 @@
+/* BEGIN_COMMON_COPYRIGHT_HEADER
+ * (c)LGPL2+
+ *
+ * Razor - a lightweight, Qt based, desktop toolset
+ * http://razor-qt.org
+ *
+ * Copyright: 2010-2012 Razor team
+ * Authors:
+ *   Alexander Sokoloff <sokoloff.a@gmail.com>
+ *
+ * This program or library is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA
+ *
+ * END_COMMON_COPYRIGHT_HEADER */
+
+#ifndef QTXDG_XDGMENUCACHE_P_H
+#define QTXDG_XDGMENUCACHE_P_H
+
+#include "xdgdesktopfilecache_p.h"
+
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+#include <QtCore/QHash>
+
+class XdgMenuTree;
+
+/*! The state of the file when the menu build read it. The stamp is taken before the
+    file is read, so the cache made from the changed file is never accepted. */
+struct XdgMenuCacheStamp
+{
+    XdgMenuCacheStamp(): exists(false)
+    {
+        rec.mtime = rec.mtimeNsec = rec.size = rec.inode = 0;
+        rec.offset = rec.length = 0;
+    }
+
+    //! Stats the file now.
+    static XdgMenuCacheStamp current(const QString& path);
+
+    bool exists;
+    XdgDesktopFileCacheFile::Record rec;
+};
+
+typedef QHash<QString, XdgMenuCacheStamp> XdgMenuCacheStamps;
+
+/*! The XdgMenuCache class keeps the built menu between the runs of the program.
+    The menu tree is stored in the $XDG_CACHE_HOME/qtxdg/menu-<key>/menu.cache file
+    together with the manifest, the list of the all menu, directory and
+    application paths used by the build with their mtimes. The key depends on
+    the menu file, the environments, the locale and the XDG variables.
+
+    The manifest has two parts: the inputs are watched by the XdgMenu, the files
+    are the desktop files of the application dirs, they are only checked here.
+    The cached tree is used only if no path of the manifest was changed.
+ */
+class XdgMenuCache
+{
+public:
+    XdgMenuCache(const QString& menuFileName, const QStringList& environments);
+
+    QString fileName() const { return mFileName; }
+
+    /*! Returns the cached tree, or 0 if the cache doesn't exist or any input
+        or file was changed. The input paths are returned too. */
+    XdgMenuTree* load(QStringList* inputs) const;
+
+    //! The stamps are written to the manifest, see XdgMenuCacheStamp.
+    void save(const XdgMenuTree& tree, const XdgMenuCacheStamps& inputs, const XdgMenuCacheStamps& files) const;
+
+private:
+    QString mKey;
+    QString mFileName;
+};
+
+#endif // QTXDG_XDGMENUCACHE_P_H
@@ -0,0 +1,413 @@
+/* BEGIN_COMMON_COPYRIGHT_HEADER
+ * (c)LGPL2+
+ *
+ * Razor - a lightweight, Qt based, desktop toolset
+ * http://razor-qt.org
+ *
+ * Copyright: 2010-2012 Razor team
+ * Authors:
+ *   Alexander Sokoloff <sokoloff.a@gmail.com>
+ *
+ * This program or library is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA
+ *
+ * END_COMMON_COPYRIGHT_HEADER */
+
+#include "xdgmenuelement_p.h"
+#include "xdgdesktopfile_p.h"
+
+#include <QtCore/QIODevice>
+#include <QtCore/QXmlStreamReader>
+#include <QtCore/QXmlStreamWriter>
+
+
+/************************************************
+
+ ************************************************/
+XdgMenuElement::XdgMenuElement(XdgMenuDocument* document, const QString& tagName):
+    mDocument(document),
+    mParent(0),
+    mTagName(tagName)
+{
+}
+
+
+/************************************************
+ The elements have a few attributes, the linear
+ search is faster than any hash here.
+ ************************************************/
+int XdgMenuElement::findAttribute(const QString& name) const
+{
+    for (int i=0; i<mAttributes.count(); ++i)
+    {
+        if (mAttributes.at(i).first == name)
+            return i;
+    }
+
+    return -1;
+}
+
+
+/************************************************
+
+ ************************************************/
+bool XdgMenuElement::hasAttribute(const QString& name) const
+{
+    return findAttribute(name) > -1;
+}
+
+
+/************************************************
+
+ ************************************************/
+QString XdgMenuElement::attribute(const QString& name, const QString& defaultValue) const
+{
+    int n = findAttribute(name);
+    if (n < 0)
+        return defaultValue;
+
+    return mAttributes.at(n).second;
+}
+
+
+/************************************************
+
+ ************************************************/
+void XdgMenuElement::setAttribute(const QString& name, const QString& value)
+{
+    int n = findAttribute(name);
+    if (n < 0)
+        mAttributes << Attribute(internString(name), value);
+    else
+        mAttributes[n].second = value;
+}
+
+
+/************************************************
+
+ ************************************************/
+void XdgMenuElement::setAttribute(const QString& name, int value)
+{
+    setAttribute(name, QString::number(value));
+}
+
+
+/************************************************
+
+ ************************************************/
+QList<XdgMenuElement*> XdgMenuElement::children(const QString& tagName) const
+{
+    if (tagName.isEmpty())
+        return mChildren;
+
+    QList<XdgMenuElement*> res;
+    foreach (XdgMenuElement* child, mChildren)
+    {
+        if (child->mTagName == tagName)
+            res << child;
+    }
+
+    return res;
+}
+
+
+/************************************************
+
+ ************************************************/
+XdgMenuElement* XdgMenuElement::firstChild(const QString& tagName) const
+{
+    for (int i=0; i<mChildren.count(); ++i)
+    {
+        XdgMenuElement* child = mChildren.at(i);
+        if (tagName.isEmpty() || child->mTagName == tagName)
+            return child;
+    }
+
+    return 0;
+}
+
+
+/************************************************
+
+ ************************************************/
+XdgMenuElement* XdgMenuElement::lastChild(const QString& tagName) const
+{
+    for (int i=mChildren.count()-1; i>=0; --i)
+    {
+        XdgMenuElement* child = mChildren.at(i);
+        if (tagName.isEmpty() || child->mTagName == tagName)
+            return child;
+    }
+
+    return 0;
+}
+
+
+/************************************************
+
+ ************************************************/
+XdgMenuElement* XdgMenuElement::previousSibling() const
+{
+    if (!mParent)
+        return 0;
+
+    int n = mParent->mChildren.indexOf(const_cast<XdgMenuElement*>(this));
+    if (n < 1)
+        return 0;
+
+    return mParent->mChildren.at(n - 1);
+}
+
+
+/************************************************
+ The descendants of the child follow the child in
+ the document order, so they are checked first.
+ ************************************************/
+XdgMenuElement* XdgMenuElement::lastDescendant(const QString& tagName) const
+{
+    for (int i=mChildren.count()-1; i>=0; --i)
+    {
+        XdgMenuElement* child = mChildren.at(i);
+        XdgMenuElement* res = child->lastDescendant(tagName);
+        if (res)
+            return res;
+
+        if (child->mTagName == tagName)
+            return child;
+    }
+
+    return 0;
+}
+
+
+/************************************************
+
+ ************************************************/
+void XdgMenuElement::appendChild(XdgMenuElement* child)
+{
+    child->remove();
+    child->mParent = this;
+    mChildren << child;
+}
+
+
+/************************************************
+
+ ************************************************/
+void XdgMenuElement::insertBefore(XdgMenuElement* child, XdgMenuElement* before)
+{
+    if (child == before)
+        return;
+
+    child->remove();
+    child->mParent = this;
+
+    int n = before ? mChildren.indexOf(before) : -1;
+    if (n < 0)
+        mChildren << child;
+    else
+        mChildren.insert(n, child);
+}
+
+
+/************************************************
+
+ ************************************************/
+void XdgMenuElement::removeChild(XdgMenuElement* child)
+{
+    if (child && child->mParent == this)
+        child->remove();
+}
+
+
+/************************************************
+
+ ************************************************/
+void XdgMenuElement::remove()
+{
+    if (!mParent)
+        return;
+
+    mParent->mChildren.removeOne(this);
+    mParent = 0;
+}
+
+
+/************************************************
+
+ ************************************************/
+void XdgMenuElement::save(QXmlStreamWriter& writer) const
+{
+    writer.writeStartElement(mTagName);
+
+    foreach (const Attribute& attr, mAttributes)
+        writer.writeAttribute(attr.first, attr.second);
+
+    if (!mText.isEmpty())
+        writer.writeCharacters(mText);
+
+    foreach (XdgMenuElement* child, mChildren)
+        child->save(writer);
+
+    writer.writeEndElement();
+}
+
+
+/************************************************
+
+ ************************************************/
+XdgMenuDocument::XdgMenuDocument():
+    mRoot(0)
+{
+}
+
+
+/************************************************
+
+ ************************************************/
+XdgMenuDocument::~XdgMenuDocument()
+{
+    qDeleteAll(mElements);
+}
+
+
+/************************************************
+
+ ************************************************/
+XdgMenuElement* XdgMenuDocument::createElement(const QString& tagName)
+{
+    XdgMenuElement* element = new XdgMenuElement(this, internString(tagName));
+    mElements << element;
+    return element;
+}
+
+
+/************************************************
+
+ ************************************************/
+XdgMenuDocument* XdgMenuDocument::clone() const
+{
+    XdgMenuDocument* doc = new XdgMenuDocument();
+    if (mRoot)
+        doc->mRoot = doc->cloneElement(mRoot);
+
+    return doc;
+}
+
+
+/************************************************
+ The names are already interned.
+ ************************************************/
+XdgMenuElement* XdgMenuDocument::cloneElement(const XdgMenuElement* element)
+{
+    XdgMenuElement* res = new XdgMenuElement(this, element->mTagName);
+    mElements << res;
+
+    res->mText = element->mText;
+    res->mAttributes = element->mAttributes;
+    res->mChildren.reserve(element->mChildren.count());
+
+    foreach (XdgMenuElement* child, element->mChildren)
+    {
+        XdgMenuElement* c = cloneElement(child);
+        c->mParent = res;
+        res->mChildren << c;
+    }
+
+    return res;
+}
+
+
+/************************************************
+ The comments, the processing instructions and
+ the DTD are skipped.
+ ************************************************/
+XdgMenuElement* XdgMenuDocument::parse(QIODevice* device, QString* errorString, int* errorLine, int* errorColumn)
+{
+    QXmlStreamReader reader(device);
+    XdgMenuElement* root = 0;
+    XdgMenuElement* current = 0;
+
+    while (!reader.atEnd())
+    {
+        switch (reader.readNext())
+        {
+        case QXmlStreamReader::StartElement:
+        {
+            XdgMenuElement* element = createElement(reader.name().toString());
+
+            QXmlStreamAttributes attrs = reader.attributes();
+            element->mAttributes.reserve(attrs.count());
+            foreach (const QXmlStreamAttribute& attr, attrs)
+                element->mAttributes << XdgMenuElement::Attribute(internString(attr.name().toString()), attr.value().toString());
+
+            if (current)
+                current->appendChild(element);
+            else
+                root = element;
+
+            current = element;
+            break;
+        }
+
+        case QXmlStreamReader::EndElement:
+            // The whitespace between the child elements is collected
+            // too, the text can be split by the entity references.
+            if (current->mText.trimmed().isEmpty())
+                current->mText.clear();
+
+            current = current->mParent;
+            break;
+
+        case QXmlStreamReader::Characters:
+            if (current)
+                current->mText += reader.text();
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    if (reader.hasError() || !root)
+    {
+        if (errorString)
+            *errorString = reader.hasError() ? reader.errorString() : QString("No root element");
+
+        if (errorLine)
+            *errorLine = reader.lineNumber();
+
+        if (errorColumn)
+            *errorColumn = reader.columnNumber();
+
+        return 0;
+    }
+
+    return root;
+}
+
+
+/************************************************
+
+ ************************************************/
+void XdgMenuDocument::save(QIODevice* device) const
+{
+    QXmlStreamWriter writer(device);
+    writer.setAutoFormatting(true);
+    writer.setAutoFormattingIndent(2);
+
+    if (mRoot)
+        mRoot->save(writer);
+}
@@ -0,0 +1,140 @@
+/* BEGIN_COMMON_COPYRIGHT_HEADER
+ * (c)LGPL2+
+ *
+ * Razor - a lightweight, Qt based, desktop toolset
+ * http://razor-qt.org
+ *
+ * Copyright: 2010-2012 Razor team
+ * Authors:
+ *   Alexander Sokoloff <sokoloff.a@gmail.com>
+ *
+ * This program or library is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA
+ *
+ * END_COMMON_COPYRIGHT_HEADER */
+
+#ifndef QTXDG_XDGMENUELEMENT_P_H
+#define QTXDG_XDGMENUELEMENT_P_H
+
+#include <QtCore/QSharedData>
+#include <QtCore/QString>
+#include <QtCore/QList>
+#include <QtCore/QVector>
+#include <QtCore/QPair>
+
+class QIODevice;
+class QXmlStreamWriter;
+class XdgMenuDocument;
+
+
+/*! The element of the menu while it's being built. The stages of the XdgMenuBuilder
+    work on these elements instead of the QDomDocument: the tag and attribute names
+    are interned, the text is kept as one string and moving the element to another
+    parent only moves the pointer. All elements are owned by the XdgMenuDocument, so
+    like the detached QDomElement, the removed element is valid until the document
+    is deleted. */
+class XdgMenuElement
+{
+public:
+    typedef QPair<QString, QString> Attribute;
+
+    XdgMenuDocument* document() const { return mDocument; }
+    const QString& tagName() const { return mTagName; }
+
+    //! The text inside the element. Like in the QDomDocument, the whitespace only text is dropped.
+    const QString& text() const { return mText; }
+    void setText(const QString& text) { mText = text; }
+
+    bool hasAttribute(const QString& name) const;
+    QString attribute(const QString& name, const QString& defaultValue = QString()) const;
+    void setAttribute(const QString& name, const QString& value);
+    //! Like QDomElement::setAttribute(), the bool is stored as "1" or "0".
+    void setAttribute(const QString& name, int value);
+    const QVector<Attribute>& attributes() const { return mAttributes; }
+
+    XdgMenuElement* parent() const { return mParent; }
+    const QList<XdgMenuElement*>& children() const { return mChildren; }
+
+    /*! Returns the children with the tagName, or all children if it's empty. The list
+        is a copy, so the children can be moved or removed while the list is iterated. */
+    QList<XdgMenuElement*> children(const QString& tagName) const;
+
+    XdgMenuElement* firstChild(const QString& tagName = QString()) const;
+    XdgMenuElement* lastChild(const QString& tagName = QString()) const;
+    XdgMenuElement* previousSibling() const;
+
+    //! The last descendant in the document order, like the last item of QDomElement::elementsByTagName().
+    XdgMenuElement* lastDescendant(const QString& tagName) const;
+
+    //! The child is removed from its previous parent.
+    void appendChild(XdgMenuElement* child);
+    //! Inserts the child before the before element, appends it if before is 0.
+    void insertBefore(XdgMenuElement* child, XdgMenuElement* before);
+    //! Does nothing if the child belongs to another element.
+    void removeChild(XdgMenuElement* child);
+    //! Removes the element from its parent.
+    void remove();
+
+    void save(QXmlStreamWriter& writer) const;
+
+private:
+    friend class XdgMenuDocument;
+    XdgMenuElement(XdgMenuDocument* document, const QString& tagName);
+    int findAttribute(const QString& name) const;
+
+    XdgMenuDocument* mDocument;
+    XdgMenuElement* mParent;
+    QString mTagName;
+    QString mText;
+    QVector<Attribute> mAttributes;
+    QList<XdgMenuElement*> mChildren;
+
+    Q_DISABLE_COPY(XdgMenuElement)
+};
+
+
+/*! The owner of the XdgMenuElement objects. The document is shared between the
+    threads only as the immutable snapshot, see XdgMenuBuilder. */
+class XdgMenuDocument: public QSharedData
+{
+public:
+    XdgMenuDocument();
+    ~XdgMenuDocument();
+
+    XdgMenuElement* createElement(const QString& tagName);
+
+    XdgMenuElement* root() const { return mRoot; }
+    void setRoot(XdgMenuElement* root) { mRoot = root; }
+
+    //! Returns the deep copy, only the root and its descendants are copied.
+    XdgMenuDocument* clone() const;
+
+    /*! Parses the XML into the new element, it's not set as the root. Returns 0 if
+        the XML is not well-formed. */
+    XdgMenuElement* parse(QIODevice* device, QString* errorString, int* errorLine, int* errorColumn);
+
+    //! Writes the XML of the root, for debug only.
+    void save(QIODevice* device) const;
+
+private:
+    XdgMenuElement* cloneElement(const XdgMenuElement* element);
+
+    QVector<XdgMenuElement*> mElements;
+    XdgMenuElement* mRoot;
+
+    Q_DISABLE_COPY(XdgMenuDocument)
+};
+
+#endif // QTXDG_XDGMENUELEMENT_P_H
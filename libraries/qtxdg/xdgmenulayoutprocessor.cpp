@@ -27,21 +27,18 @@
 
 
 #include "xdgmenulayoutprocessor.h"
-#include "xmlhelper.h"
+#include "xdgmenuelement_p.h"
 #include <QDebug>
 #include <QtCore/QMap>
 
 
 /************************************************
-
+ Like the QDomElement::elementsByTagName(), the
+ elements of the submenus are searched too.
  ************************************************/
-QDomElement findLastElementByTag(const QDomElement element, const QString tagName)
+XdgMenuElement* findLastElementByTag(const XdgMenuElement* element, const QString& tagName)
 {
-    QDomNodeList l = element.elementsByTagName(tagName);
-    if (l.isEmpty())
-        return QDomElement();
-
-    return l.at(l.length()-1).toElement();
+    return element->lastDescendant(tagName);
 }
 
 
@@ -58,8 +55,9 @@ QDomElement findLastElementByTag(const QDomElement element, const QString tagNam
      <Merge type="files"/>
  </DefaultLayout>
  ************************************************/
-XdgMenuLayoutProcessor::XdgMenuLayoutProcessor(QDomElement& element):
-    mElement(element)
+XdgMenuLayoutProcessor::XdgMenuLayoutProcessor(XdgMenuElement* element):
+    mElement(element),
+    mResult(0)
 {
     mDefaultParams.mShowEmpty = false;
     mDefaultParams.mInline = false;
@@ -69,21 +67,21 @@ XdgMenuLayoutProcessor::XdgMenuLayoutProcessor(QDomElement& element):
 
     mDefaultLayout = findLastElementByTag(element, "DefaultLayout");
 
-    if (mDefaultLayout.isNull())
+    if (!mDefaultLayout)
     {
         // Create DefaultLayout node
-        QDomDocument doc = element.ownerDocument();
-        mDefaultLayout = doc.createElement("DefaultLayout");
+        XdgMenuDocument* doc = element->document();
+        mDefaultLayout = doc->createElement("DefaultLayout");
 
-        QDomElement menus = doc.createElement("Merge");
-        menus.setAttribute("type", "menus");
-        mDefaultLayout.appendChild(menus);
+        XdgMenuElement* menus = doc->createElement("Merge");
+        menus->setAttribute("type", "menus");
+        mDefaultLayout->appendChild(menus);
 
-        QDomElement files = doc.createElement("Merge");
-        files.setAttribute("type", "files");
-        mDefaultLayout.appendChild(files);
+        XdgMenuElement* files = doc->createElement("Merge");
+        files->setAttribute("type", "files");
+        mDefaultLayout->appendChild(files);
 
-        mElement.appendChild(mDefaultLayout);
+        mElement->appendChild(mDefaultLayout);
     }
 
     setParams(mDefaultLayout, &mDefaultParams);
@@ -91,7 +89,7 @@ XdgMenuLayoutProcessor::XdgMenuLayoutProcessor(QDomElement& element):
     // If a menu does not contain a <Layout> element or if it contains an empty <Layout> element
     // then the default layout should be used.
     mLayout = findLastElementByTag(element, "Layout");
-    if (mLayout.isNull() || !mLayout.hasChildNodes())
+    if (!mLayout || mLayout->children().isEmpty())
         mLayout = mDefaultLayout;
 }
 
@@ -99,15 +97,16 @@ XdgMenuLayoutProcessor::XdgMenuLayoutProcessor(QDomElement& element):
 /************************************************
 
  ************************************************/
-XdgMenuLayoutProcessor::XdgMenuLayoutProcessor(QDomElement& element, XdgMenuLayoutProcessor *parent):
-    mElement(element)
+XdgMenuLayoutProcessor::XdgMenuLayoutProcessor(XdgMenuElement* element, XdgMenuLayoutProcessor *parent):
+    mElement(element),
+    mResult(0)
 {
     mDefaultParams = parent->mDefaultParams;
 
     // DefaultLayout ............................
-    QDomElement defaultLayout = findLastElementByTag(element, "DefaultLayout");
+    XdgMenuElement* defaultLayout = findLastElementByTag(element, "DefaultLayout");
 
-    if (defaultLayout.isNull())
+    if (!defaultLayout)
         mDefaultLayout = parent->mDefaultLayout;
     else
         mDefaultLayout = defaultLayout;
@@ -117,7 +116,7 @@ XdgMenuLayoutProcessor::XdgMenuLayoutProcessor(QDomElement& element, XdgMenuLayo
     // If a menu does not contain a <Layout> element or if it contains an empty <Layout> element
     // then the default layout should be used.
     mLayout = findLastElementByTag(element, "Layout");
-    if (mLayout.isNull() || !mLayout.hasChildNodes())
+    if (!mLayout || mLayout->children().isEmpty())
         mLayout = mDefaultLayout;
 
 }
@@ -126,54 +125,51 @@ XdgMenuLayoutProcessor::XdgMenuLayoutProcessor(QDomElement& element, XdgMenuLayo
 /************************************************
 
  ************************************************/
-void XdgMenuLayoutProcessor::setParams(QDomElement defaultLayout, LayoutParams *result)
+void XdgMenuLayoutProcessor::setParams(const XdgMenuElement* defaultLayout, LayoutParams *result)
 {
-    if (defaultLayout.hasAttribute("show_empty"))
-        result->mShowEmpty = defaultLayout.attribute("show_empty") == "true";
+    if (defaultLayout->hasAttribute("show_empty"))
+        result->mShowEmpty = defaultLayout->attribute("show_empty") == "true";
 
-    if (defaultLayout.hasAttribute("inline"))
-        result->mInline = defaultLayout.attribute("inline") == "true";
+    if (defaultLayout->hasAttribute("inline"))
+        result->mInline = defaultLayout->attribute("inline") == "true";
 
-    if (defaultLayout.hasAttribute("inline_limit"))
-        result->mInlineLimit = defaultLayout.attribute("inline_limit").toInt();
+    if (defaultLayout->hasAttribute("inline_limit"))
+        result->mInlineLimit = defaultLayout->attribute("inline_limit").toInt();
 
-    if (defaultLayout.hasAttribute("inline_header"))
-        result->mInlineHeader = defaultLayout.attribute("inline_header") == "true";
+    if (defaultLayout->hasAttribute("inline_header"))
+        result->mInlineHeader = defaultLayout->attribute("inline_header") == "true";
 
-    if (defaultLayout.hasAttribute("inline_alias"))
-        result->mInlineAlias = defaultLayout.attribute("inline_alias") == "true";
+    if (defaultLayout->hasAttribute("inline_alias"))
+        result->mInlineAlias = defaultLayout->attribute("inline_alias") == "true";
 }
 
 
 /************************************************
 
  ************************************************/
-QDomElement XdgMenuLayoutProcessor::searchElement(const QString &tagName, const QString &attributeName, const QString &attributeValue) const
+XdgMenuElement* XdgMenuLayoutProcessor::searchElement(const QString &tagName, const QString &attributeName, const QString &attributeValue) const
 {
-    DomElementIterator it(mElement, tagName);
-    while (it.hasNext())
+    foreach (XdgMenuElement* e, mElement->children())
     {
-        QDomElement e = it.next();
-        if (e.attribute(attributeName) == attributeValue)
+        if (e->tagName() == tagName && e->attribute(attributeName) == attributeValue)
         {
             return e;
         }
     }
 
-    return QDomElement();
+    return 0;
 }
 
 
 /************************************************
 
  ************************************************/
-int childsCount(const QDomElement& element)
+int childsCount(const XdgMenuElement* element)
 {
     int count = 0;
-    DomElementIterator it(element);
-    while (it.hasNext())
+    foreach (const XdgMenuElement* e, element->children())
     {
-        QString tag = it.next().tagName();
+        const QString& tag = e->tagName();
         if (tag == "AppLink" || tag == "Menu" || tag == "Separator")
             count ++;
     }
@@ -187,71 +183,50 @@ int childsCount(const QDomElement& element)
  ************************************************/
 void XdgMenuLayoutProcessor::run()
 {
-    QDomDocument doc = mLayout.ownerDocument();
-    mResult = doc.createElement("Result");
-    mElement.appendChild(mResult);
+    XdgMenuDocument* doc = mElement->document();
+    mResult = doc->createElement("Result");
+    mElement->appendChild(mResult);
 
     // Process childs menus ...............................
+    foreach (XdgMenuElement* e, mElement->children("Menu"))
     {
-        DomElementIterator it(mElement, "Menu");
-        while (it.hasNext())
-        {
-            QDomElement e = it.next();
-            XdgMenuLayoutProcessor p(e, this);
-            p.run();
-        }
+        XdgMenuLayoutProcessor p(e, this);
+        p.run();
     }
 
 
     // Step 1 ...................................
-    DomElementIterator it(mLayout);
-    it.toFront();
-    while (it.hasNext())
+    foreach (const XdgMenuElement* e, mLayout->children())
     {
-        QDomElement e = it.next();
-
-        if (e.tagName() == "Filename")
+        if (e->tagName() == "Filename")
             processFilenameTag(e);
 
-        else if (e.tagName() == "Menuname")
+        else if (e->tagName() == "Menuname")
             processMenunameTag(e);
 
-        else if (e.tagName() == "Separator")
+        else if (e->tagName() == "Separator")
             processSeparatorTag(e);
 
-        else if (e.tagName() == "Merge")
+        else if (e->tagName() == "Merge")
         {
-            QDomElement merge = mResult.ownerDocument().createElement("Merge");
-            merge.setAttribute("type", e.attribute("type"));
-            mResult.appendChild(merge);
+            XdgMenuElement* merge = doc->createElement("Merge");
+            merge->setAttribute("type", e->attribute("type"));
+            mResult->appendChild(merge);
         }
     }
 
     // Step 2 ...................................
-    {
-        MutableDomElementIterator ri(mResult, "Merge");
-        while (ri.hasNext())
-        {
-            processMergeTag(ri.next());
-        }
-    }
+    foreach (XdgMenuElement* e, mResult->children("Merge"))
+        processMergeTag(e);
 
     // Move result cilds to element .............
-    MutableDomElementIterator ri(mResult);
-    while (ri.hasNext())
-    {
-        mElement.appendChild(ri.next());
-    }
+    foreach (XdgMenuElement* e, mResult->children())
+        mElement->appendChild(e);
 
     // Final ....................................
-    mElement.removeChild(mResult);
-
-    if (mLayout.parentNode() == mElement)
-        mElement.removeChild(mLayout);
-
-    if (mDefaultLayout.parentNode() == mElement)
-        mElement.removeChild(mDefaultLayout);
-
+    mElement->removeChild(mResult);
+    mElement->removeChild(mLayout);
+    mElement->removeChild(mDefaultLayout);
 }
 
 
@@ -259,13 +234,11 @@ void XdgMenuLayoutProcessor::run()
  The <Filename> element is the most basic matching rule.
  It matches a desktop entry if the desktop entry has the given desktop-file id
  ************************************************/
-void XdgMenuLayoutProcessor::processFilenameTag(const QDomElement &element)
+void XdgMenuLayoutProcessor::processFilenameTag(const XdgMenuElement* element)
 {
-    QString id = element.text();
-
-    QDomElement appLink = searchElement("AppLink", "id", id);
-    if (!appLink.isNull())
-        mResult.appendChild(appLink);
+    XdgMenuElement* appLink = searchElement("AppLink", "id", element->text());
+    if (appLink)
+        mResult->appendChild(appLink);
 }
 
 
@@ -301,11 +274,10 @@ void XdgMenuLayoutProcessor::processFilenameTag(const QDomElement &element)
  "OpenOffice 4.2" entry being inlined in the current menu but the "OpenOffice 4.2" caption of the
  entry would be replaced with "WordProcessor".
  ************************************************/
-void XdgMenuLayoutProcessor::processMenunameTag(const QDomElement &element)
+void XdgMenuLayoutProcessor::processMenunameTag(const XdgMenuElement* element)
 {
-    QString id = element.text();
-    QDomElement menu = searchElement("Menu", "name", id);
-    if (menu.isNull())
+    XdgMenuElement* menu = searchElement("Menu", "name", element->text());
+    if (!menu)
         return;
 
     LayoutParams params = mDefaultParams;
@@ -317,8 +289,8 @@ void XdgMenuLayoutProcessor::processMenunameTag(const QDomElement &element)
     {
         if (params.mShowEmpty)
         {
-            menu.setAttribute("keep", "true");
-            mResult.appendChild(menu);
+            menu->setAttribute("keep", "true");
+            mResult->appendChild(menu);
         }
         return;
     }
@@ -336,7 +308,7 @@ void XdgMenuLayoutProcessor::processMenunameTag(const QDomElement &element)
 
     if (!doInline)
     {
-        mResult.appendChild(menu);
+        mResult->appendChild(menu);
         return;
     }
 
@@ -344,29 +316,23 @@ void XdgMenuLayoutProcessor::processMenunameTag(const QDomElement &element)
     // Header ....................................
     if (doHeader)
     {
-        QDomElement header = mLayout.ownerDocument().createElement("Header");
+        XdgMenuElement* header = mElement->document()->createElement("Header");
 
-        QDomNamedNodeMap attrs = menu.attributes();
-        for (int i=0; i < attrs.count(); ++i)
-        {
-            header.setAttributeNode(attrs.item(i).toAttr());
-        }
+        foreach (const XdgMenuElement::Attribute& attr, menu->attributes())
+            header->setAttribute(attr.first, attr.second);
 
-        mResult.appendChild(header);
+        mResult->appendChild(header);
     }
 
     // Alias .....................................
     if (doAlias)
     {
-        menu.firstChild().toElement().setAttribute("title", menu.attribute("title"));
+        menu->firstChild()->setAttribute("title", menu->attribute("title"));
     }
 
     // Inline ....................................
-    MutableDomElementIterator it(menu);
-    while (it.hasNext())
-    {
-        mResult.appendChild(it.next());
-    }
+    foreach (XdgMenuElement* e, menu->children())
+        mResult->appendChild(e);
 
 }
 
@@ -376,10 +342,11 @@ void XdgMenuLayoutProcessor::processMenunameTag(const QDomElement &element)
  <Separator> elements at the start of a menu, at the end of a menu or that directly
  follow other <Separator> elements may be ignored.
  ************************************************/
-void XdgMenuLayoutProcessor::processSeparatorTag(const QDomElement &element)
+void XdgMenuLayoutProcessor::processSeparatorTag(const XdgMenuElement* element)
 {
-    QDomElement separator = element.ownerDocument().createElement("Separator");
-    mResult.appendChild(separator);
+    Q_UNUSED(element)
+    XdgMenuElement* separator = mElement->document()->createElement("Separator");
+    mResult->appendChild(separator);
 }
 
 
@@ -399,28 +366,26 @@ void XdgMenuLayoutProcessor::processSeparatorTag(const QDomElement &element)
     mentioned should be inserted in alphabetical order of their visual caption at this point.
 
  ************************************************/
-void XdgMenuLayoutProcessor::processMergeTag(const QDomElement &element)
+void XdgMenuLayoutProcessor::processMergeTag(XdgMenuElement* element)
 {
-    QString type = element.attribute("type");
-    QMap<QString, QDomElement> map;
-    MutableDomElementIterator it(mElement);
+    QString type = element->attribute("type");
+    QMap<QString, XdgMenuElement*> map;
 
-    while (it.hasNext())
+    foreach (XdgMenuElement* e, mElement->children())
     {
-        QDomElement e = it.next();
         if (
-            ((type == "menus" || type == "all") && e.tagName() == "Menu" ) ||
-            ((type == "files" || type == "all") && e.tagName() == "AppLink")
+            ((type == "menus" || type == "all") && e->tagName() == "Menu" ) ||
+            ((type == "files" || type == "all") && e->tagName() == "AppLink")
            )
-            map.insert(e.attribute("title"), e);
+            map.insert(e->attribute("title"), e);
     }
 
-    QMapIterator<QString, QDomElement> mi(map);
+    QMapIterator<QString, XdgMenuElement*> mi(map);
     while (mi.hasNext()) {
         mi.next();
-        mResult.insertBefore(mi.value(), element);
+        mResult->insertBefore(mi.value(), element);
     }
 
-    mResult.removeChild(element);
+    mResult->removeChild(element);
 }
 
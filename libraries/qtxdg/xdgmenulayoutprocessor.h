@@ -29,8 +29,10 @@
 #ifndef QTXDG_XDGMENULAYOUTPROCESSOR_H
 #define QTXDG_XDGMENULAYOUTPROCESSOR_H
 
-#include <QtXml/QDomElement>
 #include <QtCore/QList>
+#include <QtCore/QString>
+
+class XdgMenuElement;
 
 struct LayoutItem
 {
@@ -91,25 +93,25 @@ struct LayoutParams
 class XdgMenuLayoutProcessor
 {
 public:
-    XdgMenuLayoutProcessor(QDomElement& element);
+    XdgMenuLayoutProcessor(XdgMenuElement* element);
     void run();
 
 protected:
-    XdgMenuLayoutProcessor(QDomElement& element, XdgMenuLayoutProcessor *parent);
+    XdgMenuLayoutProcessor(XdgMenuElement* element, XdgMenuLayoutProcessor *parent);
 
 private:
-    void setParams(QDomElement defaultLayout, LayoutParams *result);
-    QDomElement searchElement(const QString &tagName, const QString &attributeName, const QString &attributeValue) const;
-    void processFilenameTag(const QDomElement &element);
-    void processMenunameTag(const QDomElement &element);
-    void processSeparatorTag(const QDomElement &element);
-    void processMergeTag(const QDomElement &element);
+    void setParams(const XdgMenuElement* defaultLayout, LayoutParams *result);
+    XdgMenuElement* searchElement(const QString &tagName, const QString &attributeName, const QString &attributeValue) const;
+    void processFilenameTag(const XdgMenuElement* element);
+    void processMenunameTag(const XdgMenuElement* element);
+    void processSeparatorTag(const XdgMenuElement* element);
+    void processMergeTag(XdgMenuElement* element);
 
     LayoutParams mDefaultParams;
-    QDomElement& mElement;
-    QDomElement mDefaultLayout;
-    QDomElement mLayout;
-    QDomElement mResult;
+    XdgMenuElement* mElement;
+    XdgMenuElement* mDefaultLayout;
+    XdgMenuElement* mLayout;
+    XdgMenuElement* mResult;
 };
 
 #endif // QTXDG_XDGMENULAYOUTPROCESSOR_H
@@ -0,0 +1,688 @@
+/* BEGIN_COMMON_COPYRIGHT_HEADER
+ * (c)LGPL2+
+ *
+ * Razor - a lightweight, Qt based, desktop toolset
+ * http://razor-qt.org
+ *
+ * Copyright: 2010-2012 Razor team
+ * Authors:
+ *   Alexander Sokoloff <sokoloff.a@gmail.com>
+ *
+ * This program or library is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA
+ *
+ * END_COMMON_COPYRIGHT_HEADER */
+
+#include "xdgmenunode.h"
+#include "xdgmenunode_p.h"
+#include "xdgmenuelement_p.h"
+#include "xdgdesktopfile_p.h"
+
+#include <QtXml/QDomDocument>
+#include <QtXml/QDomElement>
+#include <QtCore/QDataStream>
+#include <QtCore/QIODevice>
+#include <QtCore/QtAlgorithms>
+
+
+#define FNV_OFFSET_BASIS Q_UINT64_C(14695981039346656037)
+#define FNV_PRIME        Q_UINT64_C(1099511628211)
+
+
+/************************************************
+
+ ************************************************/
+static inline quint64 fnvHash(quint64 h, quint32 value)
+{
+    for (int i=0; i<4; ++i)
+    {
+        h ^= (value >> (i * 8)) & 0xFF;
+        h *= FNV_PRIME;
+    }
+    return h;
+}
+
+
+/************************************************
+ The length is folded first, so the neighbour
+ strings can't be shifted into each other.
+ ************************************************/
+static inline quint64 fnvHash(quint64 h, const QString& str)
+{
+    h = fnvHash(h, (quint32)str.length());
+    const ushort* p = str.utf16();
+    const ushort* end = p + str.length();
+    for (; p != end; ++p)
+    {
+        h ^= *p & 0xFF;
+        h *= FNV_PRIME;
+        h ^= *p >> 8;
+        h *= FNV_PRIME;
+    }
+    return h;
+}
+
+
+/************************************************
+
+ ************************************************/
+XdgMenuNode::XdgMenuNode():
+    mIndex(-1)
+{
+}
+
+
+/************************************************
+
+ ************************************************/
+XdgMenuNode::XdgMenuNode(XdgMenuTree* tree, int index):
+    mTree(tree),
+    mIndex(index)
+{
+}
+
+
+/************************************************
+
+ ************************************************/
+XdgMenuNode::XdgMenuNode(const XdgMenuNode& other):
+    mTree(other.mTree),
+    mIndex(other.mIndex)
+{
+}
+
+
+/************************************************
+
+ ************************************************/
+XdgMenuNode::~XdgMenuNode()
+{
+}
+
+
+/************************************************
+
+ ************************************************/
+XdgMenuNode& XdgMenuNode::operator=(const XdgMenuNode& other)
+{
+    mTree = other.mTree;
+    mIndex = other.mIndex;
+    return *this;
+}
+
+
+/************************************************
+
+ ************************************************/
+bool XdgMenuNode::operator==(const XdgMenuNode& other) const
+{
+    return mTree == other.mTree && mIndex == other.mIndex;
+}
+
+
+/************************************************
+
+ ************************************************/
+bool XdgMenuNode::isSameAs(const XdgMenuNode& other) const
+{
+    if (!mTree || !other.mTree)
+        return !mTree && !other.mTree;
+
+    if (mTree == other.mTree && mIndex == other.mIndex)
+        return true;
+
+    return mTree->sameSubtree(mIndex, *other.mTree, other.mIndex);
+}
+
+
+/************************************************
+
+ ************************************************/
+XdgMenuNode::Type XdgMenuNode::type() const
+{
+    if (!mTree)
+        return UnknownType;
+
+    return mTree->mItems.at(mIndex).type;
+}
+
+
+/************************************************
+
+ ************************************************/
+QString XdgMenuNode::tagName() const
+{
+    if (!mTree)
+        return QString();
+
+    return mTree->mItems.at(mIndex).tagName;
+}
+
+
+/************************************************
+
+ ************************************************/
+bool XdgMenuNode::hasAttribute(const QString& name) const
+{
+    if (!mTree)
+        return false;
+
+    return mTree->findAttribute(mIndex, name) > -1;
+}
+
+
+/************************************************
+
+ ************************************************/
+QString XdgMenuNode::attribute(const QString& name, const QString& defaultValue) const
+{
+    if (!mTree)
+        return defaultValue;
+
+    int n = mTree->findAttribute(mIndex, name);
+    if (n < 0)
+        return defaultValue;
+
+    return mTree->mAttributes.at(n).second;
+}
+
+
+/************************************************
+
+ ************************************************/
+XdgMenuNode XdgMenuNode::parent() const
+{
+    if (!mTree || mTree->mItems.at(mIndex).parent < 0)
+        return XdgMenuNode();
+
+    return XdgMenuNode(mTree.data(), mTree->mItems.at(mIndex).parent);
+}
+
+
+/************************************************
+
+ ************************************************/
+int XdgMenuNode::childCount() const
+{
+    if (!mTree)
+        return 0;
+
+    return mTree->mItems.at(mIndex).childCount;
+}
+
+
+/************************************************
+
+ ************************************************/
+XdgMenuNode XdgMenuNode::child(int index) const
+{
+    if (!mTree)
+        return XdgMenuNode();
+
+    const XdgMenuTree::Item& item = mTree->mItems.at(mIndex);
+    if (index < 0 || index >= item.childCount)
+        return XdgMenuNode();
+
+    return XdgMenuNode(mTree.data(), item.firstChild + index);
+}
+
+
+/************************************************
+ The items have about ten attributes, the linear
+ search is faster than any hash here.
+ ************************************************/
+int XdgMenuTree::findAttribute(int index, const QString& name) const
+{
+    const Item& item = mItems.at(index);
+    int end = item.firstAttribute + item.attributeCount;
+    for (int i = item.firstAttribute; i < end; ++i)
+    {
+        if (mAttributes.at(i).first == name)
+            return i;
+    }
+
+    return -1;
+}
+
+
+/************************************************
+
+ ************************************************/
+void XdgMenuTree::appendItem(const XdgMenuElement* element, int parent)
+{
+    Item item;
+    // The names of the elements are already interned.
+    item.tagName = element->tagName();
+
+    if (item.tagName == "AppLink")
+        item.type = XdgMenuNode::AppLinkType;
+    else if (item.tagName == "Menu")
+        item.type = XdgMenuNode::MenuType;
+    else if (item.tagName == "Separator")
+        item.type = XdgMenuNode::SeparatorType;
+    else
+        item.type = XdgMenuNode::UnknownType;
+
+    item.parent = parent;
+    item.firstChild = 0;
+    item.childCount = 0;
+
+    item.firstAttribute = mAttributes.count();
+    item.attributeCount = element->attributes().count();
+    mAttributes << element->attributes();
+
+    addFingerprint(item);
+    mItems << item;
+}
+
+
+/************************************************
+
+ ************************************************/
+XdgMenuTree::XdgMenuTree():
+    mFingerprint(FNV_OFFSET_BASIS)
+{
+}
+
+
+/************************************************
+
+ ************************************************/
+static bool attributeNameLessThan(const XdgMenuTree::Attribute& a, const XdgMenuTree::Attribute& b)
+{
+    return a.first < b.first;
+}
+
+
+/************************************************
+ Folds the item into the fingerprint. The position
+ in the tree is defined by the parent index, the
+ attributes must be already appended. They are
+ hashed sorted by name, like sameAttributes() the
+ fingerprint doesn't depend on their order.
+ ************************************************/
+void XdgMenuTree::addFingerprint(const Item& item)
+{
+    quint64 h = mFingerprint;
+    h = fnvHash(h, (quint32)item.type);
+    h = fnvHash(h, (quint32)item.parent);
+    h = fnvHash(h, item.tagName);
+
+    QVector<Attribute> attrs = mAttributes.mid(item.firstAttribute, item.attributeCount);
+    if (attrs.count() > 1)
+        qSort(attrs.begin(), attrs.end(), attributeNameLessThan);
+
+    foreach (const Attribute& attr, attrs)
+    {
+        h = fnvHash(h, attr.first);
+        h = fnvHash(h, attr.second);
+    }
+
+    mFingerprint = h;
+}
+
+
+/************************************************
+ The elements are converted in the breadth-first
+ order, so the children of each item are stored
+ one after another.
+ ************************************************/
+XdgMenuTree* XdgMenuTree::fromElement(const XdgMenuElement* root)
+{
+    XdgMenuTree* tree = new XdgMenuTree();
+    if (!root)
+        return tree;
+
+    QVector<const XdgMenuElement*> elements;
+    elements << root;
+    tree->appendItem(root, -1);
+
+    for (int n=0; n<elements.count(); ++n)
+    {
+        int first = tree->mItems.count();
+        foreach (const XdgMenuElement* e, elements.at(n)->children())
+        {
+            tree->appendItem(e, n);
+            elements << e;
+        }
+
+        tree->mItems[n].firstChild = first;
+        tree->mItems[n].childCount = tree->mItems.count() - first;
+    }
+
+    tree->mItems.squeeze();
+    tree->mAttributes.squeeze();
+    return tree;
+}
+
+
+/************************************************
+
+ ************************************************/
+void XdgMenuTree::appendElement(int index, QDomDocument& doc, QDomNode& parent) const
+{
+    const Item& item = mItems.at(index);
+    QDomElement element = doc.createElement(item.tagName);
+
+    int end = item.firstAttribute + item.attributeCount;
+    for (int i = item.firstAttribute; i < end; ++i)
+        element.setAttribute(mAttributes.at(i).first, mAttributes.at(i).second);
+
+    parent.appendChild(element);
+
+    end = item.firstChild + item.childCount;
+    for (int i = item.firstChild; i < end; ++i)
+        appendElement(i, doc, element);
+}
+
+
+/************************************************
+
+ ************************************************/
+QDomDocument XdgMenuTree::toDom() const
+{
+    QDomDocument doc;
+    if (!mItems.isEmpty())
+        appendElement(0, doc, doc);
+
+    return doc;
+}
+
+
+/************************************************
+
+ ************************************************/
+void XdgMenuTree::save(QDataStream& stream) const
+{
+    stream << (quint32)mItems.count();
+    foreach (const Item& item, mItems)
+    {
+        stream << (qint32)item.type << item.tagName << (qint32)item.parent
+               << (qint32)item.firstChild << (qint32)item.childCount
+               << (qint32)item.firstAttribute << (qint32)item.attributeCount;
+    }
+
+    stream << (quint32)mAttributes.count();
+    foreach (const Attribute& attr, mAttributes)
+        stream << attr.first << attr.second;
+}
+
+
+/************************************************
+
+ ************************************************/
+XdgMenuTree* XdgMenuTree::load(QDataStream& stream)
+{
+    XdgMenuTree* tree = new XdgMenuTree();
+
+    // The counts are checked against the rest of the stream before anything
+    // is allocated: every item takes at least 28 bytes, every attribute 8.
+    quint32 count;
+    stream >> count;
+    if (stream.status() != QDataStream::Ok || count > stream.device()->bytesAvailable() / 28)
+    {
+        delete tree;
+        return 0;
+    }
+
+    tree->mItems.reserve(count);
+    for (quint32 n=0; n<count && stream.status() == QDataStream::Ok; ++n)
+    {
+        Item item;
+        qint32 type, parent, firstChild, childCount, firstAttribute, attributeCount;
+        stream >> type >> item.tagName >> parent >> firstChild >> childCount >> firstAttribute >> attributeCount;
+
+        item.type = (XdgMenuNode::Type)type;
+        item.tagName = internString(item.tagName);
+        item.parent = parent;
+        item.firstChild = firstChild;
+        item.childCount = childCount;
+        item.firstAttribute = firstAttribute;
+        item.attributeCount = attributeCount;
+        tree->mItems << item;
+    }
+
+    stream >> count;
+    if (stream.status() != QDataStream::Ok || count > stream.device()->bytesAvailable() / 8)
+    {
+        delete tree;
+        return 0;
+    }
+
+    tree->mAttributes.reserve(count);
+    for (quint32 n=0; n<count && stream.status() == QDataStream::Ok; ++n)
+    {
+        Attribute attr;
+        stream >> attr.first >> attr.second;
+        attr.first = internString(attr.first);
+        tree->mAttributes << attr;
+    }
+
+    if (stream.status() != QDataStream::Ok)
+    {
+        delete tree;
+        return 0;
+    }
+
+    // The ranges must not point outside of the vectors.
+    foreach (const Item& item, tree->mItems)
+    {
+        if (item.parent < -1 || item.parent >= tree->mItems.count() ||
+            item.firstChild < 0 || item.childCount < 0 ||
+            item.firstChild + item.childCount > tree->mItems.count() ||
+            item.firstAttribute < 0 || item.attributeCount < 0 ||
+            item.firstAttribute + item.attributeCount > tree->mAttributes.count())
+        {
+            delete tree;
+            return 0;
+        }
+    }
+
+    foreach (const Item& item, tree->mItems)
+        tree->addFingerprint(item);
+
+    return tree;
+}
+
+
+/************************************************
+
+ ************************************************/
+void XdgMenuTree::collectMenus(int index, const QString& path, QMap<QString, int>* menus) const
+{
+    const Item& item = mItems.at(index);
+    int n = findAttribute(index, "name");
+    QString menuPath = path + "/" + (n < 0 ? QString() : mAttributes.at(n).second);
+    menus->insert(menuPath, index);
+
+    int end = item.firstChild + item.childCount;
+    for (int i = item.firstChild; i < end; ++i)
+    {
+        if (mItems.at(i).type == XdgMenuNode::MenuType)
+            collectMenus(i, menuPath, menus);
+    }
+}
+
+
+/************************************************
+ The attributes are compared by the names, the
+ order of the DOM attributes is not defined.
+ ************************************************/
+bool XdgMenuTree::sameAttributes(int index, const XdgMenuTree& other, int otherIndex) const
+{
+    const Item& item = mItems.at(index);
+    if (item.attributeCount != other.mItems.at(otherIndex).attributeCount)
+        return false;
+
+    int end = item.firstAttribute + item.attributeCount;
+    for (int i = item.firstAttribute; i < end; ++i)
+    {
+        int n = other.findAttribute(otherIndex, mAttributes.at(i).first);
+        if (n < 0 || other.mAttributes.at(n).second != mAttributes.at(i).second)
+            return false;
+    }
+
+    return true;
+}
+
+
+/************************************************
+
+ ************************************************/
+bool XdgMenuTree::sameSubtree(int index, const XdgMenuTree& other, int otherIndex) const
+{
+    const Item& item = mItems.at(index);
+    const Item& otherItem = other.mItems.at(otherIndex);
+
+    if (item.tagName != otherItem.tagName ||
+        item.childCount != otherItem.childCount ||
+        !sameAttributes(index, other, otherIndex))
+    {
+        return false;
+    }
+
+    for (int i=0; i<item.childCount; ++i)
+    {
+        if (!sameSubtree(item.firstChild + i, other, otherItem.firstChild + i))
+            return false;
+    }
+
+    return true;
+}
+
+
+/************************************************
+ Returns the AppLink items of the menu by their ids.
+ ************************************************/
+QHash<QString, int> XdgMenuTree::appLinks(int index) const
+{
+    QHash<QString, int> res;
+    const Item& item = mItems.at(index);
+    int end = item.firstChild + item.childCount;
+    for (int i = item.firstChild; i < end; ++i)
+    {
+        if (mItems.at(i).type != XdgMenuNode::AppLinkType)
+            continue;
+
+        int n = findAttribute(i, "id");
+        res.insert(n < 0 ? QString() : mAttributes.at(n).second, i);
+    }
+
+    return res;
+}
+
+
+/************************************************
+ The order of the menu items, the separators are
+ counted too.
+ ************************************************/
+QStringList XdgMenuTree::layout(int index) const
+{
+    QStringList res;
+    const Item& item = mItems.at(index);
+    int end = item.firstChild + item.childCount;
+    for (int i = item.firstChild; i < end; ++i)
+    {
+        int n = findAttribute(i, mItems.at(i).type == XdgMenuNode::AppLinkType ? "id" : "name");
+        res << mItems.at(i).tagName + ":" + (n < 0 ? QString() : mAttributes.at(n).second);
+    }
+
+    return res;
+}
+
+
+/************************************************
+
+ ************************************************/
+XdgMenuDiff XdgMenuTree::diff(const XdgMenuTree* oldTree, const XdgMenuTree* newTree)
+{
+    QMap<QString, int> oldMenus;
+    if (oldTree && !oldTree->mItems.isEmpty())
+        oldTree->collectMenus(0, QString(), &oldMenus);
+
+    QMap<QString, int> newMenus;
+    if (newTree && !newTree->mItems.isEmpty())
+        newTree->collectMenus(0, QString(), &newMenus);
+
+    XdgMenuDiff res;
+
+    // Removed menus .................................
+    QMapIterator<QString, int> o(oldMenus);
+    while (o.hasNext())
+    {
+        o.next();
+        if (newMenus.contains(o.key()))
+            continue;
+
+        XdgMenuChanges changes;
+        changes.status = XdgMenuChanges::MenuRemoved;
+        changes.menu = o.key();
+        changes.removed = oldTree->appLinks(o.value()).keys();
+        res << changes;
+    }
+
+    // Added and changed menus .......................
+    QMapIterator<QString, int> n(newMenus);
+    while (n.hasNext())
+    {
+        n.next();
+        XdgMenuChanges changes;
+        changes.menu = n.key();
+        QHash<QString, int> newApps = newTree->appLinks(n.value());
+
+        if (!oldMenus.contains(n.key()))
+        {
+            changes.status = XdgMenuChanges::MenuAdded;
+            changes.added = newApps.keys();
+            res << changes;
+            continue;
+        }
+
+        int oldIndex = oldMenus.value(n.key());
+        QHash<QString, int> oldApps = oldTree->appLinks(oldIndex);
+
+        QHashIterator<QString, int> i(newApps);
+        while (i.hasNext())
+        {
+            i.next();
+            if (!oldApps.contains(i.key()))
+                changes.added << i.key();
+            else if (!newTree->sameAttributes(i.value(), *oldTree, oldApps.value(i.key())))
+                changes.modified << i.key();
+        }
+
+        QHashIterator<QString, int> j(oldApps);
+        while (j.hasNext())
+        {
+            j.next();
+            if (!newApps.contains(j.key()))
+                changes.removed << j.key();
+        }
+
+        if (changes.added.isEmpty() &&
+            changes.removed.isEmpty() &&
+            changes.modified.isEmpty() &&
+            newTree->sameAttributes(n.value(), *oldTree, oldIndex) &&
+            newTree->layout(n.value()) == oldTree->layout(oldIndex))
+        {
+            continue;
+        }
+
+        changes.status = XdgMenuChanges::MenuChanged;
+        res << changes;
+    }
+
+    return res;
+}
@@ -0,0 +1,140 @@
+/* BEGIN_COMMON_COPYRIGHT_HEADER
+ * (c)LGPL2+
+ *
+ * Razor - a lightweight, Qt based, desktop toolset
+ * http://razor-qt.org
+ *
+ * Copyright: 2010-2012 Razor team
+ * Authors:
+ *   Alexander Sokoloff <sokoloff.a@gmail.com>
+ *
+ * This program or library is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA
+ *
+ * END_COMMON_COPYRIGHT_HEADER */
+
+#ifndef QTXDG_XDGMENUNODE_H
+#define QTXDG_XDGMENUNODE_H
+
+#include <QtCore/QString>
+#include <QtCore/QSharedData>
+#include <QtCore/QStringList>
+#include <QtCore/QList>
+#include <QtCore/QMetaType>
+
+class XdgMenuTree;
+
+
+/*! @brief The XdgMenuNode class gives a read-only access to the item of the built menu.
+
+ The XdgMenu keeps the result of the build as a compact tree, XdgMenuNode is a light
+ handle for the item of this tree. The handle shares the tree, so it stays valid after
+ the XdgMenu was rebuilt or destroyed.
+
+ Example usage:
+ @code
+    void walk(const XdgMenuNode& menu)
+    {
+        for (int i=0; i<menu.childCount(); ++i)
+        {
+            XdgMenuNode node = menu.child(i);
+            if (node.type() == XdgMenuNode::MenuType)
+                walk(node);
+            else if (node.type() == XdgMenuNode::AppLinkType)
+                qDebug() << node.title() << node.desktopFile();
+        }
+    }
+
+    walk(xdgMenu.rootNode());
+ @endcode
+ */
+class XdgMenuNode
+{
+public:
+    enum Type
+    {
+        UnknownType,
+        MenuType,
+        AppLinkType,
+        SeparatorType
+    };
+
+    /// Constructs a null node.
+    XdgMenuNode();
+    XdgMenuNode(const XdgMenuNode& other);
+    ~XdgMenuNode();
+    XdgMenuNode& operator=(const XdgMenuNode& other);
+    bool operator==(const XdgMenuNode& other) const;
+    bool operator!=(const XdgMenuNode& other) const { return !operator==(other); }
+
+    bool isNull() const { return !mTree; }
+
+    /// Returns true if both nodes and all their children have the same tags and attributes.
+    bool isSameAs(const XdgMenuNode& other) const;
+    Type type() const;
+
+    /// Returns the tag name of the corresponding element of the XdgMenu::xml().
+    QString tagName() const;
+    bool hasAttribute(const QString& name) const;
+    QString attribute(const QString& name, const QString& defaultValue = QString()) const;
+
+    QString name() const        { return attribute("name");         }
+    QString title() const       { return attribute("title");        }
+    QString comment() const     { return attribute("comment");      }
+    QString icon() const        { return attribute("icon");         }
+    QString genericName() const { return attribute("genericName");  }
+    QString exec() const        { return attribute("exec");         }
+    QString desktopFile() const { return attribute("desktopFile");  }
+
+    XdgMenuNode parent() const;
+    int childCount() const;
+    XdgMenuNode child(int index) const;
+
+private:
+    XdgMenuNode(XdgMenuTree* tree, int index);
+
+    QExplicitlySharedDataPointer<XdgMenuTree> mTree;
+    int mIndex;
+
+    friend class XdgMenu;
+};
+
+
+/*! @brief The changes of the one menu after the XdgMenu was rebuilt.
+
+ The menu is identified by the path of the names, like "/Applications/Internet".
+ The applications are identified by the desktop-file ids.
+ */
+struct XdgMenuChanges
+{
+    enum Status
+    {
+        MenuAdded,
+        MenuRemoved,
+        MenuChanged
+    };
+
+    Status status;
+    QString menu;
+    QStringList added;
+    QStringList removed;
+    QStringList modified;
+};
+
+typedef QList<XdgMenuChanges> XdgMenuDiff;
+
+Q_DECLARE_METATYPE(XdgMenuDiff)
+
+#endif // QTXDG_XDGMENUNODE_H
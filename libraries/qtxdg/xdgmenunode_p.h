@@ -0,0 +1,98 @@
+/* BEGIN_COMMON_COPYRIGHT_HEADER
+ * (c)LGPL2+
+ *
+ * Razor - a lightweight, Qt based, desktop toolset
+ * http://razor-qt.org
+ *
+ * Copyright: 2010-2012 Razor team
+ * Authors:
+ *   Alexander Sokoloff <sokoloff.a@gmail.com>
+ *
+ * This program or library is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA
+ *
+ * END_COMMON_COPYRIGHT_HEADER */
+
+#ifndef QTXDG_XDGMENUNODE_P_H
+#define QTXDG_XDGMENUNODE_P_H
+
+#include "xdgmenunode.h"
+#include <QtCore/QSharedData>
+#include <QtCore/QString>
+#include <QtCore/QVector>
+#include <QtCore/QPair>
+#include <QtCore/QMap>
+#include <QtCore/QHash>
+#include <QtCore/QStringList>
+
+class QDomDocument;
+class QDomNode;
+class QDataStream;
+class XdgMenuElement;
+
+
+/*! The nodes are stored in one vector in the breadth-first order, so the children
+    of any node are the contiguous range of this vector. The tag and attribute
+    names are interned. */
+class XdgMenuTree: public QSharedData
+{
+public:
+    struct Item
+    {
+        XdgMenuNode::Type type;
+        QString tagName;
+        int parent;
+        int firstChild;
+        int childCount;
+        int firstAttribute;
+        int attributeCount;
+    };
+
+    typedef QPair<QString, QString> Attribute;
+
+    static XdgMenuTree* fromElement(const XdgMenuElement* root);
+    QDomDocument toDom() const;
+
+    void save(QDataStream& stream) const;
+    //! Returns 0 if the stream is corrupted.
+    static XdgMenuTree* load(QDataStream& stream);
+
+    int findAttribute(int index, const QString& name) const;
+
+    bool sameSubtree(int index, const XdgMenuTree& other, int otherIndex) const;
+
+    //! Compares the menus of the trees, any of them can be 0.
+    static XdgMenuDiff diff(const XdgMenuTree* oldTree, const XdgMenuTree* newTree);
+
+    QVector<Item> mItems;
+    QVector<Attribute> mAttributes;
+
+    //! The 64-bit FNV-1a hash of the items and attributes, equal trees have equal fingerprints.
+    quint64 mFingerprint;
+
+private:
+    void collectMenus(int index, const QString& path, QMap<QString, int>* menus) const;
+    bool sameAttributes(int index, const XdgMenuTree& other, int otherIndex) const;
+    QHash<QString, int> appLinks(int index) const;
+    QStringList layout(int index) const;
+
+    XdgMenuTree();
+
+    void appendItem(const XdgMenuElement* element, int parent);
+    void addFingerprint(const Item& item);
+    void appendElement(int index, QDomDocument& doc, QDomNode& parent) const;
+};
+
+#endif // QTXDG_XDGMENUNODE_P_H
@@ -27,9 +27,9 @@
 
 
 #include "xdgmenureader.h"
-#include "xdgmenu.h"
+#include "xdgmenu_p.h"
+#include "xdgmenuelement_p.h"
 #include "xdgdirs.h"
-#include "xmlhelper.h"
 
 #include <QtCore/QFile>
 #include <QtCore/QFileInfo>
@@ -37,17 +37,17 @@
 #include <QtCore/QString>
 #include <QtCore/QDir>
 #include <QDebug>
-#include <QtXml/QDomNamedNodeMap>
-#include <QtXml/QDomNode>
 
 
 
 /************************************************
 
  ************************************************/
-XdgMenuReader::XdgMenuReader(XdgMenu* menu, XdgMenuReader*  parentReader, QObject *parent) :
+XdgMenuReader::XdgMenuReader(XdgMenuBuilder* builder, XdgMenuDocument* document, XdgMenuReader*  parentReader, QObject *parent) :
     QObject(parent),
-    mMenu(menu)
+    mDocument(document),
+    mRoot(0),
+    mBuilder(builder)
 {
     mParentReader = parentReader;
     if (mParentReader)
@@ -92,13 +92,14 @@ bool XdgMenuReader::load(const QString& fileName, const QString& baseDir)
         return false;
     }
     //qDebug() << "Load file:" << mFileName;
-    mMenu->addWatchPath(mFileName);
+    mBuilder->addInput(mFileName);
 
     QString errorStr;
     int errorLine;
     int errorColumn;
 
-    if (!mXml.setContent(&file, true, &errorStr, &errorLine, &errorColumn))
+    mRoot = mDocument->parse(&file, &errorStr, &errorLine, &errorColumn);
+    if (!mRoot)
     {
         mErrorStr = tr("Parse error at line %1, column %2:\n%3")
                         .arg(errorLine)
@@ -107,17 +108,14 @@ bool XdgMenuReader::load(const QString& fileName, const QString& baseDir)
        return false;
     }
 
-    QDomElement root = mXml.documentElement();
-
-    QDomElement debugElement = mXml.createElement("FileInfo");
-    debugElement.setAttribute("file", mFileName);
+    XdgMenuElement* debugElement = mDocument->createElement("FileInfo");
+    debugElement->setAttribute("file", mFileName);
     if (mParentReader)
-        debugElement.setAttribute("parent", mParentReader->fileName());
+        debugElement->setAttribute("parent", mParentReader->fileName());
 
-    QDomNode null;
-    root.insertBefore(debugElement, null);
+    mRoot->appendChild(debugElement);
 
-    processMergeTags(root);
+    processMergeTags(mRoot);
     return true;
 }
 
@@ -126,72 +124,71 @@ bool XdgMenuReader::load(const QString& fileName, const QString& baseDir)
  Duplicate <MergeXXX> elements (that specify the same file) are handled as with
  duplicate <AppDir> elements (the last duplicate is used).
  ************************************************/
-void XdgMenuReader::processMergeTags(QDomElement& element)
+void XdgMenuReader::processMergeTags(XdgMenuElement* element)
 {
-    QDomElement n = element.lastChildElement();
+    QList<XdgMenuElement*> childs = element->children();
     QStringList mergedFiles;
 
-
-    while (!n.isNull())
+    for (int i=childs.count()-1; i>=0; --i)
     {
-        QDomElement next = n.previousSiblingElement();
+        XdgMenuElement* n = childs.at(i);
+        QString tagName = n->tagName();
+
         // MergeFile ..................
-        if (n.tagName() == "MergeFile")
+        if (tagName == "MergeFile")
         {
             processMergeFileTag(n, &mergedFiles);
-            n.parentNode().removeChild(n);
+            n->remove();
         }
 
         // MergeDir ...................
-        else if(n.tagName() == "MergeDir")
+        else if(tagName == "MergeDir")
         {
             processMergeDirTag(n, &mergedFiles);
-            n.parentNode().removeChild(n);
+            n->remove();
         }
 
         // DefaultMergeDirs ...........
-        else if (n.tagName() == "DefaultMergeDirs")
+        else if (tagName == "DefaultMergeDirs")
         {
             processDefaultMergeDirsTag(n, &mergedFiles);
-            n.parentNode().removeChild(n);
+            n->remove();
         }
 
         // AppDir ...................
-        else if(n.tagName() == "AppDir")
+        else if(tagName == "AppDir")
         {
             processAppDirTag(n);
-            n.parentNode().removeChild(n);
+            n->remove();
         }
 
         // DefaultAppDirs .............
-        else if(n.tagName() == "DefaultAppDirs")
+        else if(tagName == "DefaultAppDirs")
         {
             processDefaultAppDirsTag(n);
-            n.parentNode().removeChild(n);
+            n->remove();
         }
 
         // DirectoryDir ...................
-        else if(n.tagName() == "DirectoryDir")
+        else if(tagName == "DirectoryDir")
         {
             processDirectoryDirTag(n);
-            n.parentNode().removeChild(n);
+            n->remove();
         }
 
         // DefaultDirectoryDirs ...........
-        else if(n.tagName() == "DefaultDirectoryDirs")
+        else if(tagName == "DefaultDirectoryDirs")
         {
             processDefaultDirectoryDirsTag(n);
-            n.parentNode().removeChild(n);
+            n->remove();
         }
 
 
         // Menu .......................
-        else if(n.tagName() == "Menu")
+        else if(tagName == "Menu")
         {
             processMergeTags(n);
         }
-
-        n = next;
     }
 
 }
@@ -213,13 +210,13 @@ void XdgMenuReader::processMergeTags(QDomElement& element)
  filename. The first file encountered should be merged. There should be no merging
  at all if no matching file is found. ( Libmenu additional scans ~/.config/menus.)
  ************************************************/
-void XdgMenuReader::processMergeFileTag(QDomElement& element, QStringList* mergedFiles)
+void XdgMenuReader::processMergeFileTag(XdgMenuElement* element, QStringList* mergedFiles)
 {
     //qDebug() << "Process " << element;// << "in" << mFileName;
 
-    if (element.attribute("type") != "parent")
+    if (element->attribute("type") != "parent")
     {
-        mergeFile(element.text(), element, mergedFiles);
+        mergeFile(element->text(), element, mergedFiles);
     }
 
     else
@@ -272,12 +269,12 @@ void XdgMenuReader::processMergeFileTag(QDomElement& element, QStringList* merge
 
  KDE additional scans ~/.config/menus.
  ************************************************/
-void XdgMenuReader::processMergeDirTag(QDomElement& element, QStringList* mergedFiles)
+void XdgMenuReader::processMergeDirTag(XdgMenuElement* element, QStringList* mergedFiles)
 {
     //qDebug() << "Process " << element;// << "in" << mFileName;
 
-    mergeDir(element.text(), element, mergedFiles);
-    element.parentNode().removeChild(element);
+    mergeDir(element->text(), element, mergedFiles);
+    element->remove();
 }
 
 
@@ -295,11 +292,11 @@ void XdgMenuReader::processMergeDirTag(QDomElement& element, QStringList* merged
  for tasks or menus other than the main application menu. In that case the first part
  of the name of the default merge directory is derived from the name of the .menu file.
  ************************************************/
-void XdgMenuReader::processDefaultMergeDirsTag(QDomElement& element, QStringList* mergedFiles)
+void XdgMenuReader::processDefaultMergeDirsTag(XdgMenuElement* element, QStringList* mergedFiles)
 {
     //qDebug() << "Process " << element;// << "in" << mFileName;
 
-    QString menuBaseName = QFileInfo(mMenu->menuFileName()).baseName();
+    QString menuBaseName = QFileInfo(mBuilder->menuFileName()).baseName();
     int n = menuBaseName.lastIndexOf('-');
     if (n>-1)
         menuBaseName = menuBaseName.mid(n+1);
@@ -321,10 +318,10 @@ void XdgMenuReader::processDefaultMergeDirsTag(QDomElement& element, QStringList
  If the filename given as an <AppDir> is not an absolute path, it should be located
  relative to the location of the menu file being parsed.
  ************************************************/
-void XdgMenuReader::processAppDirTag(QDomElement& element)
+void XdgMenuReader::processAppDirTag(XdgMenuElement* element)
 {
     //qDebug() << "Process " << element;
-    addDirTag(element, "AppDir", element.text());
+    addDirTag(element, "AppDir", element->text());
 }
 
 
@@ -335,7 +332,7 @@ void XdgMenuReader::processAppDirTag(QDomElement& element)
 
  menu-cache additional prepends $XDG_DATA_HOME/applications.
  ************************************************/
-void XdgMenuReader::processDefaultAppDirsTag(QDomElement& element)
+void XdgMenuReader::processDefaultAppDirsTag(XdgMenuElement* element)
 {
     //qDebug() << "Process " << element;
     QStringList dirs = XdgDirs::dataDirs();
@@ -352,10 +349,10 @@ void XdgMenuReader::processDefaultAppDirsTag(QDomElement& element)
  If the filename given as a <DirectoryDir> is not an absolute path, it should be
  located relative to the location of the menu file being parsed.
  ************************************************/
-void XdgMenuReader::processDirectoryDirTag(QDomElement& element)
+void XdgMenuReader::processDirectoryDirTag(XdgMenuElement* element)
 {
     //qDebug() << "Process " << element;
-    addDirTag(element, "DirectoryDir", element.text());
+    addDirTag(element, "DirectoryDir", element->text());
 }
 
 
@@ -366,7 +363,7 @@ void XdgMenuReader::processDirectoryDirTag(QDomElement& element)
 
  menu-cache additional prepends $XDG_DATA_HOME/applications.
  ************************************************/
-void XdgMenuReader::processDefaultDirectoryDirsTag(QDomElement& element)
+void XdgMenuReader::processDefaultDirectoryDirsTag(XdgMenuElement* element)
 {
     //qDebug() << "Process " << element;
     QStringList dirs = XdgDirs::dataDirs();
@@ -379,15 +376,15 @@ void XdgMenuReader::processDefaultDirectoryDirsTag(QDomElement& element)
 /************************************************
 
  ************************************************/
-void XdgMenuReader::addDirTag(QDomElement& previousElement, const QString& tagName, const QString& dir)
+void XdgMenuReader::addDirTag(XdgMenuElement* previousElement, const QString& tagName, const QString& dir)
 {
     QFileInfo dirInfo(mDirName, dir);
     if (dirInfo.isDir())
     {
 //        qDebug() << "\tAdding " + dirInfo.canonicalFilePath();
-        QDomElement element = mXml.createElement(tagName);
-        element.appendChild(mXml.createTextNode(dirInfo.canonicalFilePath()));
-        previousElement.parentNode().insertBefore(element, previousElement);
+        XdgMenuElement* element = mDocument->createElement(tagName);
+        element->setText(dirInfo.canonicalFilePath());
+        previousElement->parent()->insertBefore(element, previousElement);
     }
 }
 
@@ -396,9 +393,9 @@ void XdgMenuReader::addDirTag(QDomElement& previousElement, const QString& tagNa
  If fileName is not an absolute path then the file to be merged should be located
  relative to the location of this menu file.
  ************************************************/
-void XdgMenuReader::mergeFile(const QString& fileName, QDomElement& element, QStringList* mergedFiles)
+void XdgMenuReader::mergeFile(const QString& fileName, XdgMenuElement* element, QStringList* mergedFiles)
 {
-    XdgMenuReader reader(mMenu, this);
+    XdgMenuReader reader(mBuilder, mDocument, this);
     QFileInfo fileInfo(QDir(mDirName), fileName);
 
     if (!fileInfo.exists())
@@ -416,18 +413,14 @@ void XdgMenuReader::mergeFile(const QString& fileName, QDomElement& element, QSt
     if (reader.load(fileName, mDirName))
     {
         //qDebug() << "\tOK";
-        QDomElement n = reader.xml().firstChildElement().firstChildElement();
-        while (!n.isNull())
+        // The merged file is read into the same document, so
+        // its elements are moved instead of being copied.
+        foreach (XdgMenuElement* n, reader.root()->children())
         {
             // As a special exception, remove the <Name> element from the root
             // element of each file being merged.
-            if (n.tagName() != "Name")
-            {
-                QDomNode imp = mXml.importNode(n, true);
-                element.parentNode().insertBefore(imp, element);
-            }
-
-            n = n.nextSiblingElement();
+            if (n->tagName() != "Name")
+                element->parent()->insertBefore(n, element);
         }
     }
 }
@@ -436,7 +429,7 @@ void XdgMenuReader::mergeFile(const QString& fileName, QDomElement& element, QSt
 /************************************************
 
  ************************************************/
-void XdgMenuReader::mergeDir(const QString& dirName, QDomElement& element, QStringList* mergedFiles)
+void XdgMenuReader::mergeDir(const QString& dirName, XdgMenuElement* element, QStringList* mergedFiles)
 {
     QFileInfo dirInfo(mDirName, dirName);
 
@@ -32,49 +32,53 @@
 #include <QtCore/QObject>
 #include <QtCore/QString>
 #include <QtCore/QStringList>
-#include <QtXml/QDomDocument>
-#include <QtXml/QDomElement>
-class XdgMenu;
+
+class XdgMenuBuilder;
+class XdgMenuDocument;
+class XdgMenuElement;
+
 class XdgMenuReader : public QObject
 {
     Q_OBJECT
 public:
-    explicit XdgMenuReader(XdgMenu* menu, XdgMenuReader*  parentReader = 0, QObject *parent = 0);
+    explicit XdgMenuReader(XdgMenuBuilder* builder, XdgMenuDocument* document, XdgMenuReader*  parentReader = 0, QObject *parent = 0);
     virtual ~XdgMenuReader();
 
     bool load(const QString& fileName, const QString& baseDir = "");
     QString fileName() const { return mFileName; }
     QString errorString() const { return mErrorStr; }
-    QDomDocument& xml() { return mXml; }
+    //! The root element of the loaded file, it's created in the document of the reader.
+    XdgMenuElement* root() const { return mRoot; }
 
 signals:
 
 public slots:
 
 protected:
-    void processMergeTags(QDomElement& element);
-    void processMergeFileTag(QDomElement& element, QStringList* mergedFiles);
-    void processMergeDirTag(QDomElement& element, QStringList* mergedFiles);
-    void processDefaultMergeDirsTag(QDomElement& element, QStringList* mergedFiles);
+    void processMergeTags(XdgMenuElement* element);
+    void processMergeFileTag(XdgMenuElement* element, QStringList* mergedFiles);
+    void processMergeDirTag(XdgMenuElement* element, QStringList* mergedFiles);
+    void processDefaultMergeDirsTag(XdgMenuElement* element, QStringList* mergedFiles);
 
-    void processAppDirTag(QDomElement& element);
-    void processDefaultAppDirsTag(QDomElement& element);
+    void processAppDirTag(XdgMenuElement* element);
+    void processDefaultAppDirsTag(XdgMenuElement* element);
 
-    void processDirectoryDirTag(QDomElement& element);
-    void processDefaultDirectoryDirsTag(QDomElement& element);
-    void addDirTag(QDomElement& previousElement, const QString& tagName, const QString& dir);
+    void processDirectoryDirTag(XdgMenuElement* element);
+    void processDefaultDirectoryDirsTag(XdgMenuElement* element);
+    void addDirTag(XdgMenuElement* previousElement, const QString& tagName, const QString& dir);
 
-    void mergeFile(const QString& fileName, QDomElement& element, QStringList* mergedFiles);
-    void mergeDir(const QString& dirName, QDomElement& element, QStringList* mergedFiles);
+    void mergeFile(const QString& fileName, XdgMenuElement* element, QStringList* mergedFiles);
+    void mergeDir(const QString& dirName, XdgMenuElement* element, QStringList* mergedFiles);
 
 private:
     QString mFileName;
     QString mDirName;
     QString mErrorStr;
-    QDomDocument mXml;
+    XdgMenuDocument* mDocument;
+    XdgMenuElement* mRoot;
     XdgMenuReader*  mParentReader;
     QStringList mBranchFiles;
-    XdgMenu* mMenu;
+    XdgMenuBuilder* mBuilder;
 };
 
 #endif // QTXDG_XDGMENUREADER_H
@@ -32,7 +32,7 @@
 *********************************************************************/
 
 #include "xdgmenurules.h"
-#include "xmlhelper.h"
+#include "xdgmenuelement_p.h"
 
 #include <QStringList>
 #include <QDebug>
@@ -42,7 +42,7 @@
 /************************************************
 
  ************************************************/
-XdgMenuRule::XdgMenuRule(const QDomElement& element, QObject* parent) :
+XdgMenuRule::XdgMenuRule(const XdgMenuElement* element, QObject* parent) :
     QObject(parent)
 {
     Q_UNUSED(element)
@@ -65,36 +65,32 @@ XdgMenuRule::~XdgMenuRule()
  inside the <Or> element match a desktop entry, then the entire <Or> rule matches
  the desktop entry.
  ************************************************/
-XdgMenuRuleOr::XdgMenuRuleOr(const QDomElement& element, QObject* parent) :
+XdgMenuRuleOr::XdgMenuRuleOr(const XdgMenuElement* element, QObject* parent) :
     XdgMenuRule(element, parent)
 {
     //qDebug() << "Create OR rule";
-    DomElementIterator iter(element, "");
-
-    while(iter.hasNext())
+    foreach (const XdgMenuElement* e, element->children())
     {
-        QDomElement e = iter.next();
-
-        if (e.tagName() == "Or")
+        if (e->tagName() == "Or")
             mChilds.append(new XdgMenuRuleOr(e, this));
 
-        else if (e.tagName() == "And")
+        else if (e->tagName() == "And")
             mChilds.append(new XdgMenuRuleAnd(e, this));
 
-        else if (e.tagName() == "Not")
+        else if (e->tagName() == "Not")
             mChilds.append(new XdgMenuRuleNot(e, this));
 
-        else if (e.tagName() == "Filename")
+        else if (e->tagName() == "Filename")
             mChilds.append(new XdgMenuRuleFileName(e, this));
 
-        else if (e.tagName() == "Category")
+        else if (e->tagName() == "Category")
             mChilds.append(new XdgMenuRuleCategory(e, this));
 
-        else if (e.tagName() == "All")
+        else if (e->tagName() == "All")
             mChilds.append(new XdgMenuRuleAll(e, this));
 
         else
-            qWarning() << "Unknown rule" << e.tagName();
+            qWarning() << "Unknown rule" << e->tagName();
     }
 
 }
@@ -117,7 +113,7 @@ bool XdgMenuRuleOr::check(const QString& desktopFileId, const XdgDesktopFile& de
  inside the <And> element match a desktop entry, then the entire <And> rule matches
  the desktop entry.
  ************************************************/
-XdgMenuRuleAnd::XdgMenuRuleAnd(const QDomElement& element, QObject *parent) :
+XdgMenuRuleAnd::XdgMenuRuleAnd(const XdgMenuElement* element, QObject *parent) :
     XdgMenuRuleOr(element, parent)
 {
 //    qDebug() << "Create AND rule";
@@ -143,7 +139,7 @@ bool XdgMenuRuleAnd::check(const QString& desktopFileId, const XdgDesktopFile& d
  not match the desktop entry. That is, matching rules below <Not> have a logical OR
  relationship.
  ************************************************/
-XdgMenuRuleNot::XdgMenuRuleNot(const QDomElement& element, QObject *parent) :
+XdgMenuRuleNot::XdgMenuRuleNot(const XdgMenuElement* element, QObject *parent) :
     XdgMenuRuleOr(element, parent)
 {
 //    qDebug() << "Create NOT rule";
@@ -164,11 +160,11 @@ bool XdgMenuRuleNot::check(const QString& desktopFileId, const XdgDesktopFile& d
  The <Filename> element is the most basic matching rule. It matches a desktop entry
  if the desktop entry has the given desktop-file id. See Desktop-File Id.
  ************************************************/
-XdgMenuRuleFileName::XdgMenuRuleFileName(const QDomElement& element, QObject *parent) :
+XdgMenuRuleFileName::XdgMenuRuleFileName(const XdgMenuElement* element, QObject *parent) :
     XdgMenuRule(element, parent)
 {
     //qDebug() << "Create FILENAME rule";
-    mId = element.text();
+    mId = element->text();
 }
 
 
@@ -188,10 +184,10 @@ bool XdgMenuRuleFileName::check(const QString& desktopFileId, const XdgDesktopFi
  The <Category> element is another basic matching predicate. It matches a desktop entry
  if the desktop entry has the given category in its Categories field.
  ************************************************/
-XdgMenuRuleCategory::XdgMenuRuleCategory(const QDomElement& element, QObject *parent) :
+XdgMenuRuleCategory::XdgMenuRuleCategory(const XdgMenuElement* element, QObject *parent) :
     XdgMenuRule(element, parent)
 {
-    mCategory = element.text();
+    mCategoryId = XdgDesktopFile::categoryId(element->text());
 }
 
 
@@ -201,14 +197,14 @@ XdgMenuRuleCategory::XdgMenuRuleCategory(const QDomElement& element, QObject *pa
 bool XdgMenuRuleCategory::check(const QString& desktopFileId, const XdgDesktopFile& desktopFile)
 {
     Q_UNUSED(desktopFileId)
-    return desktopFile.value("Categories").toString().split(';').contains(mCategory);
+    return desktopFile.hasCategory(mCategoryId);
 }
 
 
 /************************************************
  The <All> element is a matching rule that matches all desktop entries.
  ************************************************/
-XdgMenuRuleAll::XdgMenuRuleAll(const QDomElement& element, QObject *parent) :
+XdgMenuRuleAll::XdgMenuRuleAll(const XdgMenuElement* element, QObject *parent) :
     XdgMenuRule(element, parent)
 {
 }
@@ -227,6 +223,207 @@ bool XdgMenuRuleAll::check(const QString& desktopFileId, const XdgDesktopFile& d
 
 
 
+
+/************************************************
+
+ ************************************************/
+XdgMenuRuleAppTable::XdgMenuRuleAppTable():
+    mCount(0)
+{
+}
+
+
+/************************************************
+
+ ************************************************/
+int XdgMenuRuleAppTable::add(const XdgDesktopFile& desktopFile)
+{
+    int index = mCount++;
+
+    foreach (int id, desktopFile.categoryIds())
+    {
+        if (id >= mCategories.count())
+            mCategories.resize(id + 1);
+
+        QBitArray& bits = mCategories[id];
+        if (bits.size() <= index)
+            bits.resize(qMax(index + 1, bits.size() * 2));
+
+        bits.setBit(index);
+    }
+
+    return index;
+}
+
+
+/************************************************
+
+ ************************************************/
+QBitArray XdgMenuRuleAppTable::categoryBits(int categoryId) const
+{
+    if (categoryId < 0 || categoryId >= mCategories.count())
+        return QBitArray(mCount);
+
+    QBitArray bits = mCategories.at(categoryId);
+    bits.resize(mCount);
+    return bits;
+}
+
+
+
+
+/************************************************
+
+ ************************************************/
+XdgMenuRuleProgram::XdgMenuRuleProgram():
+    mValid(true)
+{
+}
+
+
+/************************************************
+ Like the XdgMenuRuleOr, the childs of the element
+ are joined by OR. The results of the all added
+ elements are joined by OR too.
+ ************************************************/
+void XdgMenuRuleProgram::add(const XdgMenuElement* element)
+{
+    compileChilds(element);
+}
+
+
+/************************************************
+ Returns the number of the results pushed on the stack.
+ ************************************************/
+int XdgMenuRuleProgram::compileChilds(const XdgMenuElement* element)
+{
+    int count = 0;
+    foreach (const XdgMenuElement* e, element->children())
+    {
+        if (compileRule(e))
+            count++;
+    }
+
+    return count;
+}
+
+
+/************************************************
+
+ ************************************************/
+bool XdgMenuRuleProgram::compileRule(const XdgMenuElement* element)
+{
+    Op op;
+    const QString& tag = element->tagName();
+
+    if (tag == "Or" || tag == "And" || tag == "Not")
+    {
+        op.arg = compileChilds(element);
+        if (tag == "Or")
+            op.code = OpOr;
+        else if (tag == "And")
+            op.code = OpAnd;
+        else
+            op.code = OpNot;
+    }
+
+    else if (tag == "Filename")
+    {
+        op.code = OpFileName;
+        op.arg = mFileNames.count();
+        mFileNames << element->text();
+    }
+
+    else if (tag == "Category")
+    {
+        op.code = OpCategory;
+        op.arg = XdgDesktopFile::categoryId(element->text());
+    }
+
+    else if (tag == "All")
+    {
+        op.code = OpAll;
+        op.arg = 0;
+    }
+
+    else
+    {
+        // The XdgMenuRule classes report it.
+        mValid = false;
+        return false;
+    }
+
+    mOps << op;
+    return true;
+}
+
+
+/************************************************
+
+ ************************************************/
+QBitArray XdgMenuRuleProgram::evaluate(const XdgMenuRuleAppTable& table, const QBitArray& pool, const QVector<int>& fileNameApps) const
+{
+    int size = table.count();
+    QVector<QBitArray> stack;
+
+    foreach (const Op& op, mOps)
+    {
+        switch (op.code)
+        {
+        case OpAll:
+            stack << pool;
+            break;
+
+        case OpCategory:
+            stack << table.categoryBits(op.arg);
+            break;
+
+        case OpFileName:
+        {
+            QBitArray bits(size);
+            int app = fileNameApps.at(op.arg);
+            if (app > -1)
+                bits.setBit(app);
+            stack << bits;
+            break;
+        }
+
+        case OpOr:
+        case OpNot:
+        {
+            QBitArray bits(size);
+            for (int i = stack.count() - op.arg; i < stack.count(); ++i)
+                bits |= stack.at(i);
+
+            stack.resize(stack.count() - op.arg);
+            stack << (op.code == OpNot ? ~bits : bits);
+            break;
+        }
+
+        case OpAnd:
+        {
+            // The empty <And> matches nothing.
+            QBitArray bits(size, op.arg > 0);
+            for (int i = stack.count() - op.arg; i < stack.count(); ++i)
+                bits &= stack.at(i);
+
+            stack.resize(stack.count() - op.arg);
+            stack << bits;
+            break;
+        }
+        }
+    }
+
+    QBitArray res(size);
+    foreach (const QBitArray& bits, stack)
+        res |= bits;
+
+    return res & pool;
+}
+
+
+
+
 /************************************************
 
  ************************************************/
@@ -247,18 +444,20 @@ XdgMenuRules::~XdgMenuRules()
 /************************************************
 
  ************************************************/
-void XdgMenuRules::addInclude(const QDomElement& element)
+void XdgMenuRules::addInclude(const XdgMenuElement* element)
 {
     mIncludeRules.append(new XdgMenuRuleOr(element, this));
+    mIncludeProgram.add(element);
 }
 
 
 /************************************************
 
  ************************************************/
-void XdgMenuRules::addExclude(const QDomElement& element)
+void XdgMenuRules::addExclude(const XdgMenuElement* element)
 {
     mExcludeRules.append(new XdgMenuRuleOr(element, this));
+    mExcludeProgram.add(element);
 }
 
 
@@ -35,16 +35,20 @@
 #define QTXDG_XDGMENURULES_H
 
 #include <QtCore/QObject>
-#include <QtXml/QDomElement>
 #include <QtCore/QLinkedList>
+#include <QtCore/QVector>
+#include <QtCore/QBitArray>
+#include <QtCore/QStringList>
 
 #include "xdgdesktopfile.h"
 
+class XdgMenuElement;
+
 class XdgMenuRule : public QObject
 {
     Q_OBJECT
 public:
-    explicit XdgMenuRule(const QDomElement& element, QObject* parent = 0);
+    explicit XdgMenuRule(const XdgMenuElement* element, QObject* parent = 0);
     virtual ~XdgMenuRule();
 
     virtual bool check(const QString& desktopFileId, const XdgDesktopFile& desktopFile) = 0;
@@ -55,7 +59,7 @@ class XdgMenuRuleOr : public XdgMenuRule
 {
     Q_OBJECT
 public:
-    explicit XdgMenuRuleOr(const QDomElement& element, QObject* parent = 0);
+    explicit XdgMenuRuleOr(const XdgMenuElement* element, QObject* parent = 0);
 
     bool check(const QString& desktopFileId, const XdgDesktopFile& desktopFile);
 
@@ -68,7 +72,7 @@ class XdgMenuRuleAnd : public XdgMenuRuleOr
 {
     Q_OBJECT
 public:
-    explicit XdgMenuRuleAnd(const QDomElement& element, QObject* parent = 0);
+    explicit XdgMenuRuleAnd(const XdgMenuElement* element, QObject* parent = 0);
     bool check(const QString& desktopFileId, const XdgDesktopFile& desktopFile);
 };
 
@@ -77,7 +81,7 @@ class XdgMenuRuleNot : public XdgMenuRuleOr
 {
     Q_OBJECT
 public:
-    explicit XdgMenuRuleNot(const QDomElement& element, QObject* parent = 0);
+    explicit XdgMenuRuleNot(const XdgMenuElement* element, QObject* parent = 0);
     bool check(const QString& desktopFileId, const XdgDesktopFile& desktopFile);
 };
 
@@ -86,7 +90,7 @@ class XdgMenuRuleFileName : public XdgMenuRule
 {
     Q_OBJECT
 public:
-    explicit XdgMenuRuleFileName(const QDomElement& element, QObject* parent = 0);
+    explicit XdgMenuRuleFileName(const XdgMenuElement* element, QObject* parent = 0);
     bool check(const QString& desktopFileId, const XdgDesktopFile& desktopFile);
 private:
     QString mId;
@@ -97,10 +101,10 @@ class XdgMenuRuleCategory : public XdgMenuRule
 {
     Q_OBJECT
 public:
-    explicit XdgMenuRuleCategory(const QDomElement& element, QObject* parent = 0);
+    explicit XdgMenuRuleCategory(const XdgMenuElement* element, QObject* parent = 0);
     bool check(const QString& desktopFileId, const XdgDesktopFile& desktopFile);
 private:
-    QString mCategory;
+    int mCategoryId;
 };
 
 
@@ -108,12 +112,75 @@ class XdgMenuRuleAll : public XdgMenuRule
 {
     Q_OBJECT
 public:
-    explicit XdgMenuRuleAll(const QDomElement& element, QObject* parent = 0);
+    explicit XdgMenuRuleAll(const XdgMenuElement* element, QObject* parent = 0);
     bool check(const QString& desktopFileId, const XdgDesktopFile& desktopFile);
 };
 
 
 
+/*! The desktop files of the one menu build. Each file gets an index, for every
+    category the table keeps the bitset of the files which have it. */
+class XdgMenuRuleAppTable
+{
+public:
+    XdgMenuRuleAppTable();
+
+    int add(const XdgDesktopFile& desktopFile);
+    int count() const { return mCount; }
+    QBitArray categoryBits(int categoryId) const;
+
+private:
+    int mCount;
+    QVector<QBitArray> mCategories;
+};
+
+
+/*! The rules of the <Include> or <Exclude> elements compiled into the flat postfix
+    program. The program is evaluated for all files of the XdgMenuRuleAppTable at
+    once, every step works with the bitsets. */
+class XdgMenuRuleProgram
+{
+public:
+    XdgMenuRuleProgram();
+
+    void add(const XdgMenuElement* element);
+
+    /// False if the element contains the rule the program does not support.
+    bool isValid() const { return mValid; }
+
+    /// The desktop-file ids used by the <Filename> rules.
+    const QStringList& fileNames() const { return mFileNames; }
+
+    /*! Returns the bitset of the files from the pool which matches the rules.
+        fileNameApps contains the file index for each fileNames() item, or -1. */
+    QBitArray evaluate(const XdgMenuRuleAppTable& table, const QBitArray& pool, const QVector<int>& fileNameApps) const;
+
+private:
+    enum OpCode
+    {
+        OpAll,
+        OpCategory,
+        OpFileName,
+        OpOr,
+        OpAnd,
+        OpNot
+    };
+
+    struct Op
+    {
+        OpCode code;
+        int arg;
+    };
+
+    int compileChilds(const XdgMenuElement* element);
+    bool compileRule(const XdgMenuElement* element);
+
+    QVector<Op> mOps;
+    QStringList mFileNames;
+    bool mValid;
+};
+
+
 class XdgMenuRules : public QObject
 {
     Q_OBJECT
@@ -121,15 +188,22 @@ public:
     explicit XdgMenuRules(QObject* parent = 0);
     virtual ~XdgMenuRules();
 
-    void addInclude(const QDomElement& element);
-    void addExclude(const QDomElement& element);
+    void addInclude(const XdgMenuElement* element);
+    void addExclude(const XdgMenuElement* element);
 
     bool checkInclude(const QString& desktopFileId, const XdgDesktopFile& desktopFile);
     bool checkExclude(const QString& desktopFileId, const XdgDesktopFile& desktopFile);
 
+    /// True if the programs can be used instead of checkInclude() and checkExclude().
+    bool isCompiled() const { return mIncludeProgram.isValid() && mExcludeProgram.isValid(); }
+    const XdgMenuRuleProgram& includeProgram() const { return mIncludeProgram; }
+    const XdgMenuRuleProgram& excludeProgram() const { return mExcludeProgram; }
+
 protected:
     QLinkedList<XdgMenuRule*> mIncludeRules;
     QLinkedList<XdgMenuRule*> mExcludeRules;
+    XdgMenuRuleProgram mIncludeProgram;
+    XdgMenuRuleProgram mExcludeProgram;
 };
 
 #endif // QTXDG_XDGMENURULES_H
@@ -35,10 +35,14 @@
 #include <QtCore/QEvent>
 #include <QtCore/QDebug>
 #include <QtCore/QUrl>
+#include <QtCore/QHash>
 #include <QtGui/QDrag>
 #include <QtGui/QMouseEvent>
 #include <QtGui/QApplication>
 
+// The changes of the menus by the menu paths.
+typedef QHash<QString, XdgMenuChanges> XdgMenuWidgetChanges;
+
 class XdgMenuWidgetPrivate
 {
 private:
@@ -47,13 +51,29 @@ private:
 
 public:
     explicit XdgMenuWidgetPrivate(XdgMenuWidget* parent):
-        q_ptr(parent)
+        q_ptr(parent),
+        mPopulated(false)
     {}
 
     void init(const QDomElement& xml);
-    void buildMenu();
+    void init(const XdgMenuNode& node);
+    void initMenu(const QString& title, const QString& comment, const QString& iconName);
+    void buildMenu(QHash<QString, XdgMenuWidget*>* reuse = 0, QHash<QString, QAction*>* reuseLinks = 0,
+                   const QString& path = QString(), const XdgMenuWidgetChanges* changes = 0);
+    void rebuildItems(QHash<QString, QAction*>* reuseLinks = 0,
+                      const QString& path = QString(), const XdgMenuWidgetChanges* changes = 0);
+    void reload(const XdgMenuNode& node, bool updateHeader);
+    void reload(const XdgMenuNode& node, bool updateHeader, const QString& path, const XdgMenuWidgetChanges& changes);
+    void rebind(const XdgMenuNode& node);
+    QString name() const;
 
     QDomElement mXml;
+    XdgMenuNode mNode;
+
+    // The items created by the widget, the actions added by the user are not there.
+    bool mPopulated;
+    QList<QAction*> mActions;
+    QList<XdgMenuWidget*> mSubMenus;
 
     void mouseMoveEvent(QMouseEvent *event);
 
@@ -61,6 +81,8 @@ public:
 
 private:
     XdgAction* createAction(const QDomElement& xml);
+    XdgAction* createAction(const XdgMenuNode& node);
+    XdgAction* createAction(const QString& desktopFile, QString title, const QString& genericName);
     static QString escape(QString string);
 };
 
@@ -73,7 +95,8 @@ XdgMenuWidget::XdgMenuWidget(const XdgMenu& xdgMenu, const QString& title, QWidg
     QMenu(parent),
     d_ptr(new XdgMenuWidgetPrivate(this))
 {
-    d_ptr->init(xdgMenu.xml().documentElement());
+    connect(this, SIGNAL(aboutToShow()), this, SLOT(populate()));
+    d_ptr->init(xdgMenu.rootNode());
     setTitle(XdgMenuWidgetPrivate::escape(title));
 }
 
@@ -84,10 +107,23 @@ XdgMenuWidget::XdgMenuWidget(const QDomElement& menuElement, QWidget* parent):
     QMenu(parent),
     d_ptr(new XdgMenuWidgetPrivate(this))
 {
+    connect(this, SIGNAL(aboutToShow()), this, SLOT(populate()));
     d_ptr->init(menuElement);
 }
 
 
+/************************************************
+
+ ************************************************/
+XdgMenuWidget::XdgMenuWidget(const XdgMenuNode& menuNode, QWidget* parent):
+    QMenu(parent),
+    d_ptr(new XdgMenuWidgetPrivate(this))
+{
+    connect(this, SIGNAL(aboutToShow()), this, SLOT(populate()));
+    d_ptr->init(menuNode);
+}
+
+
 /************************************************
 
  ************************************************/
@@ -95,7 +131,11 @@ XdgMenuWidget::XdgMenuWidget(const XdgMenuWidget& other, QWidget* parent):
     QMenu(parent),
     d_ptr(new XdgMenuWidgetPrivate(this))
 {
-    d_ptr->init(other.d_ptr->mXml);
+    connect(this, SIGNAL(aboutToShow()), this, SLOT(populate()));
+    if (other.d_ptr->mNode.isNull())
+        d_ptr->init(other.d_ptr->mXml);
+    else
+        d_ptr->init(other.d_ptr->mNode);
 }
 
 
@@ -106,17 +146,55 @@ void XdgMenuWidgetPrivate::init(const QDomElement& xml)
 {
     Q_Q(XdgMenuWidget);
     mXml = xml;
+    mNode = XdgMenuNode();
 
     q->clear();
+    mPopulated = false;
+    mActions.clear();
+    mSubMenus.clear();
 
     QString title;
     if (! xml.attribute("title").isEmpty())
         title = xml.attribute("title");
     else
         title = xml.attribute("name");
-    q->setTitle(escape(title));
 
-    q->setToolTip(xml.attribute("comment"));
+    initMenu(title, xml.attribute("comment"), xml.attribute("icon"));
+}
+
+
+/************************************************
+
+ ************************************************/
+void XdgMenuWidgetPrivate::init(const XdgMenuNode& node)
+{
+    Q_Q(XdgMenuWidget);
+    mXml = QDomElement();
+    mNode = node;
+
+    q->clear();
+    mPopulated = false;
+    mActions.clear();
+    mSubMenus.clear();
+
+    QString title = node.title();
+    if (title.isEmpty())
+        title = node.name();
+
+    initMenu(title, node.comment(), node.icon());
+}
+
+
+/************************************************
+ The items are created on the first show of the
+ menu, see XdgMenuWidget::populate().
+ ************************************************/
+void XdgMenuWidgetPrivate::initMenu(const QString& title, const QString& comment, const QString& iconName)
+{
+    Q_Q(XdgMenuWidget);
+
+    q->setTitle(escape(title));
+    q->setToolTip(comment);
 
 
     QIcon parentIcon;
@@ -124,9 +202,200 @@ void XdgMenuWidgetPrivate::init(const QDomElement& xml)
     if (parentMenu)
         parentIcon = parentMenu->icon();
 
-    q->setIcon(XdgIcon::fromTheme(mXml.attribute("icon"), parentIcon));
+    q->setIcon(XdgIcon::fromTheme(iconName, parentIcon));
+}
+
+
+/************************************************
+
+ ************************************************/
+QString XdgMenuWidgetPrivate::name() const
+{
+    if (!mNode.isNull())
+        return mNode.name();
+
+    return mXml.attribute("name");
+}
+
+
+/************************************************
+
+ ************************************************/
+void XdgMenuWidget::populate()
+{
+    Q_D(XdgMenuWidget);
+    if (d->mPopulated)
+        return;
+
+    d->mPopulated = true;
+    d->buildMenu();
+}
+
 
-    buildMenu();
+/************************************************
+
+ ************************************************/
+void XdgMenuWidget::reload(const XdgMenu& xdgMenu)
+{
+    Q_D(XdgMenuWidget);
+    d->reload(xdgMenu.rootNode(), false);
+}
+
+
+/************************************************
+
+ ************************************************/
+void XdgMenuWidget::reload(const XdgMenu& xdgMenu, const XdgMenuDiff& diff)
+{
+    Q_D(XdgMenuWidget);
+    XdgMenuWidgetChanges changes;
+    foreach (const XdgMenuChanges& menuChanges, diff)
+        changes.insert(menuChanges.menu, menuChanges);
+
+    d->reload(xdgMenu.rootNode(), false, QString(), changes);
+}
+
+
+/************************************************
+ The nodes are the same, only the references to the
+ new tree are updated, so the old tree can be freed.
+ ************************************************/
+void XdgMenuWidgetPrivate::rebind(const XdgMenuNode& node)
+{
+    mNode = node;
+    mXml = QDomElement();
+
+    int n = 0;
+    for (int i=0; i<node.childCount() && n<mSubMenus.count(); ++i)
+    {
+        XdgMenuNode child = node.child(i);
+        if (child.type() == XdgMenuNode::MenuType)
+            mSubMenus.at(n++)->d_ptr->rebind(child);
+    }
+}
+
+
+/************************************************
+ The unchanged submenus are kept with their items,
+ the changed ones are filled again, the submenus
+ which were never shown stay empty.
+ ************************************************/
+void XdgMenuWidgetPrivate::reload(const XdgMenuNode& node, bool updateHeader)
+{
+    if (!mNode.isNull() && mNode.isSameAs(node))
+    {
+        rebind(node);
+        return;
+    }
+
+    if (updateHeader)
+    {
+        QString title = node.title();
+        if (title.isEmpty())
+            title = node.name();
+
+        initMenu(title, node.comment(), node.icon());
+    }
+
+    mXml = QDomElement();
+    mNode = node;
+
+    if (mPopulated)
+        rebuildItems();
+}
+
+
+/************************************************
+ Only the menus listed in the changes are filled
+ again. The layout of the other menus is unchanged,
+ so their submenus follow the order of the nodes.
+ The actions of the unchanged applications are kept.
+ ************************************************/
+void XdgMenuWidgetPrivate::reload(const XdgMenuNode& node, bool updateHeader,
+                                  const QString& path, const XdgMenuWidgetChanges& changes)
+{
+    QString menuPath = path + "/" + node.name();
+    XdgMenuWidgetChanges::ConstIterator menuChanges = changes.constFind(menuPath);
+
+    if (menuChanges == changes.constEnd())
+    {
+        mNode = node;
+        mXml = QDomElement();
+
+        int n = 0;
+        for (int i=0; i<node.childCount() && n<mSubMenus.count(); ++i)
+        {
+            XdgMenuNode child = node.child(i);
+            if (child.type() == XdgMenuNode::MenuType)
+                mSubMenus.at(n++)->d_ptr->reload(child, true, menuPath, changes);
+        }
+        return;
+    }
+
+    if (updateHeader)
+    {
+        QString title = node.title();
+        if (title.isEmpty())
+            title = node.name();
+
+        initMenu(title, node.comment(), node.icon());
+    }
+
+    // The actions follow the nodes they were created for.
+    QHash<QString, QAction*> links;
+    if (mPopulated && !mNode.isNull())
+    {
+        int n = 0;
+        for (int i=0; i<mNode.childCount() && n<mActions.count(); ++i)
+        {
+            XdgMenuNode child = mNode.child(i);
+            if (child.type() == XdgMenuNode::UnknownType)
+                continue;
+
+            QAction* action = mActions.at(n++);
+            QString id = child.attribute("id");
+            if (child.type() == XdgMenuNode::AppLinkType && !menuChanges.value().modified.contains(id))
+                links.insert(id, action);
+        }
+    }
+
+    mXml = QDomElement();
+    mNode = node;
+
+    if (mPopulated)
+        rebuildItems(&links, menuPath, &changes);
+}
+
+
+/************************************************
+ The submenus are reused by the names, the actions
+ of the applications by the desktop file ids.
+ ************************************************/
+void XdgMenuWidgetPrivate::rebuildItems(QHash<QString, QAction*>* reuseLinks,
+                                        const QString& path, const XdgMenuWidgetChanges* changes)
+{
+    Q_Q(XdgMenuWidget);
+
+    QHash<QString, XdgMenuWidget*> oldMenus;
+    foreach (XdgMenuWidget* menu, mSubMenus)
+        oldMenus.insert(menu->d_ptr->name(), menu);
+
+    QList<QAction*> oldActions = mActions;
+    foreach (QAction* action, oldActions)
+        q->removeAction(action);
+
+    mActions.clear();
+    mSubMenus.clear();
+    buildMenu(&oldMenus, reuseLinks, path, changes);
+
+    // Delete the items which were not reused.
+    foreach (QAction* action, oldActions)
+    {
+        if (!mActions.contains(action) && action->parent() == q)
+            delete action;
+    }
+
+    qDeleteAll(oldMenus);
 }
 
 
@@ -145,7 +414,10 @@ XdgMenuWidget::~XdgMenuWidget()
 XdgMenuWidget& XdgMenuWidget::operator=(const XdgMenuWidget& other)
 {
     Q_D(XdgMenuWidget);
-    d->init(other.d_ptr->mXml);
+    if (other.d_ptr->mNode.isNull())
+        d->init(other.d_ptr->mXml);
+    else
+        d->init(other.d_ptr->mNode);
 
     return *this;
 }
@@ -175,6 +447,17 @@ bool XdgMenuWidget::event(QEvent* event)
 }
 
 
+/************************************************
+ The icons are decoded on the worker threads, so
+ the big menus open without waiting for them.
+ ************************************************/
+void XdgMenuWidget::paintEvent(QPaintEvent* event)
+{
+    XdgIconAsyncPaint async(this);
+    QMenu::paintEvent(event);
+}
+
+
 /************************************************
 
  ************************************************/
@@ -204,16 +487,60 @@ void XdgMenuWidgetPrivate::mouseMoveEvent(QMouseEvent *event)
 
 
 /************************************************
-
+ The items are inserted before the actions which
+ were added to the menu by the user.
  ************************************************/
-void XdgMenuWidgetPrivate::buildMenu()
+void XdgMenuWidgetPrivate::buildMenu(QHash<QString, XdgMenuWidget*>* reuse, QHash<QString, QAction*>* reuseLinks,
+                                     const QString& path, const XdgMenuWidgetChanges* changes)
 {
     Q_Q(XdgMenuWidget);
 
     QAction* first = 0;
     if (!q->actions().isEmpty())
-        first = q->actions().last();
+        first = q->actions().first();
 
+    if (!mNode.isNull())
+    {
+        for (int i=0; i<mNode.childCount(); ++i)
+        {
+            XdgMenuNode node = mNode.child(i);
+            switch (node.type())
+            {
+            case XdgMenuNode::MenuType:
+            {
+                XdgMenuWidget* menu = reuse ? reuse->take(node.name()) : 0;
+                if (menu && changes)
+                    menu->d_ptr->reload(node, true, path, *changes);
+                else if (menu)
+                    menu->d_ptr->reload(node, true);
+                else
+                    menu = new XdgMenuWidget(node, q);
+
+                mSubMenus << menu;
+                mActions << q->insertMenu(first, menu);
+                break;
+            }
+
+            case XdgMenuNode::AppLinkType:
+            {
+                QAction* action = reuseLinks ? reuseLinks->take(node.attribute("id")) : 0;
+                if (!action)
+                    action = createAction(node);
+                q->insertAction(first, action);
+                mActions << action;
+                break;
+            }
+
+            case XdgMenuNode::SeparatorType:
+                mActions << q->insertSeparator(first);
+                break;
+
+            default:
+                break;
+            }
+        }
+        return;
+    }
 
     DomElementIterator it(mXml, "");
     while(it.hasNext())
@@ -222,15 +549,23 @@ void XdgMenuWidgetPrivate::buildMenu()
 
         // Build submenu ........................
         if (xml.tagName() == "Menu")
-            q->insertMenu(first, new XdgMenuWidget(xml, q));
+        {
+            XdgMenuWidget* menu = new XdgMenuWidget(xml, q);
+            mSubMenus << menu;
+            mActions << q->insertMenu(first, menu);
+        }
 
         //Build application link ................
         else if (xml.tagName() == "AppLink")
-            q->insertAction(first, createAction(xml));
+        {
+            XdgAction* action = createAction(xml);
+            q->insertAction(first, action);
+            mActions << action;
+        }
 
         //Build separator .......................
         else if (xml.tagName() == "Separator")
-            q->insertSeparator(first);
+            mActions << q->insertSeparator(first);
 
     }
 }
@@ -241,19 +576,42 @@ void XdgMenuWidgetPrivate::buildMenu()
  ************************************************/
 XdgAction* XdgMenuWidgetPrivate::createAction(const QDomElement& xml)
 {
-    Q_Q(XdgMenuWidget);
-    XdgAction* action = new XdgAction(xml.attribute("desktopFile"), q);
-
     QString title;
     if (!xml.attribute("title").isEmpty())
         title = xml.attribute("title");
     else
         title = xml.attribute("name");
 
+    return createAction(xml.attribute("desktopFile"), title, xml.attribute("genericName"));
+}
+
+
+/************************************************
+
+ ************************************************/
+XdgAction* XdgMenuWidgetPrivate::createAction(const XdgMenuNode& node)
+{
+    QString title = node.title();
+    if (title.isEmpty())
+        title = node.name();
+
+    return createAction(node.desktopFile(), title, node.genericName());
+}
+
+
+/************************************************
+
+ ************************************************/
+XdgAction* XdgMenuWidgetPrivate::createAction(const QString& desktopFile, QString title, const QString& genericName)
+{
+    Q_Q(XdgMenuWidget);
+
+    // The file is already parsed by the menu build, the cached copy is shared.
+    XdgAction* action = new XdgAction(XdgDesktopFileCache::snapshot(desktopFile), q);
 
-    if (!xml.attribute("genericName").isEmpty() &&
-         xml.attribute("genericName") != title)
-        title += QString(" (%1)").arg(xml.attribute("genericName"));
+    if (!genericName.isEmpty() &&
+         genericName != title)
+        title += QString(" (%1)").arg(genericName);
 
     action->setText(escape(title));
     return action;
@@ -31,6 +31,7 @@
 
 #include <QMenu>
 #include <QtXml/QDomElement>
+#include "xdgmenunode.h"
 
 class XdgMenu;
 class QEvent;
@@ -68,6 +69,9 @@ public:
     /// Constructs a menu for menuElement with parent.
     explicit XdgMenuWidget(const QDomElement& menuElement, QWidget* parent=0);
 
+    /// Constructs a menu for menuNode with parent.
+    explicit XdgMenuWidget(const XdgMenuNode& menuNode, QWidget* parent=0);
+
     /// Constructs a copy of other.
     XdgMenuWidget(const XdgMenuWidget& other, QWidget* parent=0);
 
@@ -77,8 +81,28 @@ public:
     /// Destroys the menu.
     virtual ~XdgMenuWidget();
 
+    /*!
+     * Updates the menu after the xdgMenu was rebuilt. The unchanged submenus are kept,
+     * the actions added to the menu by the user are kept too.
+     */
+    void reload(const XdgMenu& xdgMenu);
+
+    /*!
+     * Updates only the menus listed in the diff, see XdgMenu::menuChanged(). The actions
+     * of the unchanged applications are kept.
+     */
+    void reload(const XdgMenu& xdgMenu, const XdgMenuDiff& diff);
+
+public slots:
+    /*!
+     * Creates the items of the menu if they were not created yet. It's called when
+     * the menu is shown for the first time, call it if you need the size of the menu before.
+     */
+    void populate();
+
 protected:
     bool event(QEvent* event);
+    void paintEvent(QPaintEvent* event);
 
 private:
     XdgMenuWidgetPrivate* const d_ptr;
@@ -33,6 +33,7 @@
 #include <magic.h>
 #include <QDebug>
 #include <QtCore/QStringList>
+#include <QtCore/QThreadStorage>
 
 
 /************************************************
@@ -45,6 +46,46 @@ XdgMimeInfo::XdgMimeInfo(const QString& mimeType)
 }
 
 
+/************************************************
+ Loading the magic database is expensive, so each
+ thread keeps its handle till the thread exits.
+ The libmagic handles are not thread safe.
+ ************************************************/
+class XdgMagicHandle
+{
+public:
+    XdgMagicHandle()
+    {
+        mMagic = magic_open(MAGIC_MIME_TYPE); // Open predictor
+        if (!mMagic)
+        {
+            qWarning() << "libmagic: Unable to initialize magic library";
+            return;
+        }
+
+        if (magic_load(mMagic, 0)) // if not 0 - error
+        {
+            qWarning() << QString("libmagic: Can't load magic database - %1").arg(magic_error(mMagic));
+            magic_close(mMagic); // Close predictor
+            mMagic = 0;
+        }
+    }
+
+    ~XdgMagicHandle()
+    {
+        if (mMagic)
+            magic_close(mMagic);
+    }
+
+    magic_t magic() const { return mMagic; }
+
+private:
+    magic_t mMagic;
+};
+
+static QThreadStorage<XdgMagicHandle*> magicHandles;
+
+
 /************************************************
 
  ************************************************/
@@ -53,19 +94,12 @@ QString getFileMimeType(const QFileInfo& fileInfo)
 
     QString result("application/octet-stream");
 
-    magic_t magicMimePredictor;
-    magicMimePredictor = magic_open(MAGIC_MIME_TYPE); // Open predictor
-    if (!magicMimePredictor) {
-        qWarning() << "libmagic: Unable to initialize magic library";
-        return result;
-    }
-
+    if (!magicHandles.hasLocalData())
+        magicHandles.setLocalData(new XdgMagicHandle());
 
-    if (magic_load(magicMimePredictor, 0)) { // if not 0 - error
-        qWarning() << QString("libmagic: Can't load magic database - %1").arg(magic_error(magicMimePredictor));
-        magic_close(magicMimePredictor); // Close predictor
+    magic_t magicMimePredictor = magicHandles.localData()->magic();
+    if (!magicMimePredictor)
         return result;
-    }
 
     QByteArray ar = fileInfo.absoluteFilePath().toLocal8Bit();
     char *file = ar.data();
@@ -73,10 +107,8 @@ QString getFileMimeType(const QFileInfo& fileInfo)
     // getting mime-type ........................
     const char *mime;
     mime = magic_file(magicMimePredictor, file);
-    result = QString(mime);
-
-    // Close predictor ..........................
-    magic_close(magicMimePredictor);
+    if (mime)
+        result = QString(mime);
 
     return result;
 }
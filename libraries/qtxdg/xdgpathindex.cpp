@@ -0,0 +1,243 @@
+/* BEGIN_COMMON_COPYRIGHT_HEADER
+ * (c)LGPL2+
+ *
+ * Razor - a lightweight, Qt based, desktop toolset
+ * http://razor-qt.org
+ *
+ * Copyright: 2010-2012 Razor team
+ * Authors:
+ *   Alexander Sokoloff <sokoloff.a@gmail.com>
+ *
+ * This program or library is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA
+ *
+ * END_COMMON_COPYRIGHT_HEADER */
+
+#include "xdgpathindex.h"
+#include "xdgpathindex_p.h"
+
+#include <QtCore/QDir>
+#include <QtCore/QFileInfo>
+#include <QtCore/QFileSystemWatcher>
+#include <QtCore/QCoreApplication>
+#include <QtCore/QThread>
+#include <QtCore/QMutexLocker>
+
+#include <stdlib.h>
+
+Q_GLOBAL_STATIC(QMutex, instanceMutex)
+
+
+/************************************************
+ The index watches the directories, so it lives
+ in the main thread.
+ ************************************************/
+XdgPathIndexPrivate* XdgPathIndexPrivate::instance()
+{
+    static XdgPathIndexPrivate* inst = 0;
+    QMutexLocker locker(instanceMutex());
+    if (!inst)
+    {
+        inst = new XdgPathIndexPrivate();
+        if (QCoreApplication::instance())
+            inst->moveToThread(QCoreApplication::instance()->thread());
+    }
+
+    return inst;
+}
+
+
+/************************************************
+
+ ************************************************/
+XdgPathIndexPrivate::XdgPathIndexPrivate():
+    QObject(),
+    mDirty(true)
+{
+    mWatcher = new QFileSystemWatcher(this);
+    connect(mWatcher, SIGNAL(directoryChanged(QString)), this, SLOT(directoryChanged(QString)));
+}
+
+
+/************************************************
+
+ ************************************************/
+QStringList XdgPathIndexPrivate::readDir(const QString& dirName) const
+{
+    QStringList res;
+    QDir dir(dirName);
+    QFileInfoList files = dir.entryInfoList(QDir::Files | QDir::Executable);
+    foreach (QFileInfo file, files)
+        res << file.fileName();
+
+    return res;
+}
+
+
+/************************************************
+ Called with the locked mutex. Reads the changed
+ directories and merges the index again.
+ ************************************************/
+void XdgPathIndexPrivate::update()
+{
+    QString path = QString::fromLocal8Bit(getenv("PATH"));
+    if (path != mPath)
+    {
+        mPath = path;
+        QStringList dirs;
+        foreach (QString dir, path.split(':', QString::SkipEmptyParts))
+        {
+            if (!dirs.contains(dir))
+                dirs << dir;
+        }
+
+        mDirs = dirs;
+        mDirEntries.clear();
+        mDirtyDirs = dirs.toSet();
+        mDirty = true;
+
+        if (QThread::currentThread() == thread())
+            watchDirs(dirs);
+        else
+            QMetaObject::invokeMethod(this, "watchDirs", Qt::QueuedConnection, Q_ARG(QStringList, dirs));
+    }
+
+    if (!mDirty)
+        return;
+
+    foreach (QString dir, mDirtyDirs)
+        mDirEntries.insert(dir, readDir(dir));
+    mDirtyDirs.clear();
+
+    mExecutables.clear();
+    foreach (QString dir, mDirs)
+    {
+        foreach (QString name, mDirEntries.value(dir))
+        {
+            if (!mExecutables.contains(name))
+                mExecutables.insert(name, QDir(dir).absoluteFilePath(name));
+        }
+    }
+
+    mDirty = false;
+}
+
+
+/************************************************
+
+ ************************************************/
+void XdgPathIndexPrivate::watchDirs(const QStringList& dirs)
+{
+    QStringList old = mWatcher->directories();
+    if (!old.isEmpty())
+        mWatcher->removePaths(old);
+
+    foreach (QString dir, dirs)
+    {
+        if (QFileInfo(dir).isDir())
+            mWatcher->addPath(dir);
+    }
+}
+
+
+/************************************************
+
+ ************************************************/
+void XdgPathIndexPrivate::directoryChanged(const QString& dirName)
+{
+    QMutexLocker locker(&mMutex);
+    mDirtyDirs << dirName;
+    mDirty = true;
+}
+
+
+/************************************************
+
+ ************************************************/
+QString XdgPathIndexPrivate::which(const QString& program)
+{
+    QMutexLocker locker(&mMutex);
+    update();
+    return mExecutables.value(program);
+}
+
+
+/************************************************
+
+ ************************************************/
+QStringList XdgPathIndexPrivate::complete(const QString& prefix, int max)
+{
+    QMutexLocker locker(&mMutex);
+    update();
+
+    QStringList res;
+    QMap<QString, QString>::const_iterator i = mExecutables.lowerBound(prefix);
+    while (i != mExecutables.constEnd() && i.key().startsWith(prefix))
+    {
+        if (max > 0 && res.count() >= max)
+            break;
+
+        res << i.key();
+        ++i;
+    }
+
+    return res;
+}
+
+
+/************************************************
+ The names with the slash are checked directly.
+ ************************************************/
+QString XdgPathIndex::which(const QString& program)
+{
+    if (program.isEmpty())
+        return QString();
+
+    if (program.contains('/'))
+    {
+        QFileInfo fi(program);
+        if (fi.isAbsolute())
+            return fi.isExecutable() ? fi.absoluteFilePath() : QString();
+
+        // The relative path is searched in the $PATH directories.
+        foreach (QString dir, QString::fromLocal8Bit(getenv("PATH")).split(':', QString::SkipEmptyParts))
+        {
+            QFileInfo f(QDir(dir), program);
+            if (f.isExecutable())
+                return f.absoluteFilePath();
+        }
+        return QString();
+    }
+
+    return XdgPathIndexPrivate::instance()->which(program);
+}
+
+
+/************************************************
+
+ ************************************************/
+bool XdgPathIndex::isExecutable(const QString& program)
+{
+    return !which(program).isEmpty();
+}
+
+
+/************************************************
+
+ ************************************************/
+QStringList XdgPathIndex::complete(const QString& prefix, int max)
+{
+    return XdgPathIndexPrivate::instance()->complete(prefix, max);
+}
@@ -0,0 +1,54 @@
+/* BEGIN_COMMON_COPYRIGHT_HEADER
+ * (c)LGPL2+
+ *
+ * Razor - a lightweight, Qt based, desktop toolset
+ * http://razor-qt.org
+ *
+ * Copyright: 2010-2012 Razor team
+ * Authors:
+ *   Alexander Sokoloff <sokoloff.a@gmail.com>
+ *
+ * This program or library is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA
+ *
+ * END_COMMON_COPYRIGHT_HEADER */
+
+#ifndef QTXDG_XDGPATHINDEX_H
+#define QTXDG_XDGPATHINDEX_H
+
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+
+/*! @brief The XdgPathIndex class gives the fast access to the executables from the $PATH.
+
+ Every directory of the $PATH is read once, the index is shared by the process and
+ is refreshed when the directories or the $PATH are changed. All methods are thread-safe.
+ */
+class XdgPathIndex
+{
+public:
+    /*! Returns the absolute file name of the program. The program name without the
+        slash is searched in the $PATH, an empty string is returned if it's not found. */
+    static QString which(const QString& program);
+
+    /// Returns true if the program exists and is executable, see which().
+    static bool isExecutable(const QString& program);
+
+    /*! Returns the sorted names of the executables from the $PATH which start with
+        the prefix. If max is positive, no more than max names are returned. */
+    static QStringList complete(const QString& prefix, int max = -1);
+};
+
+#endif // QTXDG_XDGPATHINDEX_H
@@ -0,0 +1,72 @@
+/* BEGIN_COMMON_COPYRIGHT_HEADER
+ * (c)LGPL2+
+ *
+ * Razor - a lightweight, Qt based, desktop toolset
+ * http://razor-qt.org
+ *
+ * Copyright: 2010-2012 Razor team
+ * Authors:
+ *   Alexander Sokoloff <sokoloff.a@gmail.com>
+ *
+ * This program or library is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA
+ *
+ * END_COMMON_COPYRIGHT_HEADER */
+
+#ifndef QTXDG_XDGPATHINDEX_P_H
+#define QTXDG_XDGPATHINDEX_P_H
+
+#include <QtCore/QObject>
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+#include <QtCore/QHash>
+#include <QtCore/QMap>
+#include <QtCore/QSet>
+#include <QtCore/QMutex>
+
+class QFileSystemWatcher;
+
+/*! The executables of every $PATH directory are kept separately, so only the
+    changed directory is read again. mExecutables maps the program name to the
+    file from the first directory of the $PATH which contains it. */
+class XdgPathIndexPrivate: public QObject
+{
+    Q_OBJECT
+public:
+    static XdgPathIndexPrivate* instance();
+
+    QString which(const QString& program);
+    QStringList complete(const QString& prefix, int max);
+
+private slots:
+    void directoryChanged(const QString& dirName);
+    void watchDirs(const QStringList& dirs);
+
+private:
+    XdgPathIndexPrivate();
+    void update();
+    QStringList readDir(const QString& dirName) const;
+
+    QString mPath;
+    QStringList mDirs;
+    QHash<QString, QStringList> mDirEntries;
+    QSet<QString> mDirtyDirs;
+    QMap<QString, QString> mExecutables;
+    bool mDirty;
+    QFileSystemWatcher* mWatcher;
+    QMutex mMutex;
+};
+
+#endif // QTXDG_XDGPATHINDEX_P_H
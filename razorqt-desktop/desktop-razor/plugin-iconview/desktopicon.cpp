@@ -59,8 +59,8 @@ IconBase::IconBase(QGraphicsItem * parent)
 
 void IconBase::setIcon(const QIcon & icon)
 {
-    m_pm = icon.pixmap(32, 32, QIcon::Active);
-    m_pm_hi = icon.pixmap(32, 32, QIcon::Selected);
+    m_icon = icon;
+    update();
 }
 
 void IconBase::setText(const QString & text)
@@ -81,7 +81,11 @@ void IconBase::paint(QPainter * painter, const QStyleOptionGraphicsItem * option
     int iw = 32 / 2;
     int ih = 32 / 2;
     QRect target(w - iw, h - ih - 10, 32, 32);
-    painter->drawPixmap(target, m_highlight ? m_pm_hi : m_pm, source);
+    // The pixmap is requested while painting, so the theme icons
+    // are decoded on the worker threads.
+    XdgIconAsyncPaint async(widget);
+    QPixmap pm = m_icon.pixmap(32, 32, m_highlight ? QIcon::Selected : QIcon::Active);
+    painter->drawPixmap(target, pm, source);
 
     QRectF textRect(0, 50, 80, 30);
 
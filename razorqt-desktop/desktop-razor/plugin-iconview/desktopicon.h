@@ -30,6 +30,7 @@
 
 #include <QGraphicsLayoutItem>
 #include <QGraphicsTextItem>
+#include <QIcon>
 #include <qtxdg/xdgdesktopfile.h>
 #include "desktopplugin.h"
 
@@ -71,8 +72,7 @@ protected:
     virtual void hoverLeaveEvent(QGraphicsSceneHoverEvent * event);
 
 private:
-    QPixmap m_pm; // std
-    QPixmap m_pm_hi; // highlight
+    QIcon m_icon;
     bool m_highlight;
     QString m_text;
     DesktopPlugin::IconLaunchMode m_launchMode;
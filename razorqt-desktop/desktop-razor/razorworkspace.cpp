@@ -82,7 +82,7 @@ RazorWorkSpace::RazorWorkSpace(RazorSettings * config, int screen, int desktop,
 
     m_xdgMenu.setEnvironments(QStringList() << "X-RAZOR" << "Razor");
     bool res = m_xdgMenu.read(m_menuFile);
-    connect(&m_xdgMenu, SIGNAL(changed()), this, SLOT(buildMenu()));
+    connect(&m_xdgMenu, SIGNAL(menuChanged(XdgMenuDiff)), this, SLOT(updateMenu(XdgMenuDiff)));
 
     if (res)
     {
@@ -306,6 +306,16 @@ void RazorWorkSpace::buildMenu()
     delete prevMenu;
 }
 
+void RazorWorkSpace::updateMenu(const XdgMenuDiff &diff)
+{
+    // Only the changed submenus are filled again
+    XdgMenuWidget *menu = qobject_cast<XdgMenuWidget*>(m_menu);
+    if (menu)
+        menu->reload(m_xdgMenu, diff);
+    else
+        buildMenu();
+}
+
 void RazorWorkSpace::mouseReleaseEvent(QMouseEvent* _ev)
 {
     DesktopWidgetPlugin * plug = getPluginFromItem(m_scene->itemAt(_ev->posF()));
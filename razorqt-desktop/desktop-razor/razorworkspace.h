@@ -114,6 +114,7 @@ private slots:
     void setDesktopBackground();
     void addPlugin(const RazorPluginInfo &pluginInfo);
     void buildMenu();
+    void updateMenu(const XdgMenuDiff &diff);
 };
 
 #endif
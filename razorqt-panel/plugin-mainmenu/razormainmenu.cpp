@@ -34,7 +34,6 @@
 #include <QSettings>
 #include <QFileInfo>
 #include <QAction>
-#include <QtCore/QTimer>
 #include <QtGui/QMessageBox>
 #include <razorqt/powermanager.h>
 #include <razorqt/screensaver.h>
@@ -75,6 +74,9 @@ RazorMainMenu::RazorMainMenu(const RazorPanelPluginStartInfo* startInfo, QWidget
     mShortcut = new QxtGlobalShortcut(this);
     connect(mShortcut, SIGNAL(activated()), this, SLOT(showHideMenu()));
 
+    connect(&mXdgMenu, SIGNAL(ready(bool)), this, SLOT(menuReady(bool)));
+    connect(&mXdgMenu, SIGNAL(menuChanged(XdgMenuDiff)), this, SLOT(updateMenu(XdgMenuDiff)));
+
     addWidget(&mButton);
     settingsChanged();
 }
@@ -108,6 +110,11 @@ void RazorMainMenu::showMenu()
     if (!mMenu)
         return;
 
+    // The size of the menu is needed before it's shown.
+    XdgMenuWidget *xdgMenu = qobject_cast<XdgMenuWidget*>(mMenu);
+    if (xdgMenu)
+        xdgMenu->populate();
+
     int x, y;
 
     switch (panel()->position())
@@ -163,18 +170,8 @@ void RazorMainMenu::settingsChanged()
     mXdgMenu.setEnvironments(QStringList() << "X-RAZOR" << "Razor");
     mXdgMenu.setLogDir(mLogDir);
 
-    bool res = mXdgMenu.read(mMenuFile);
-    connect(&mXdgMenu, SIGNAL(changed()), this, SLOT(buildMenu()));
-    if (res)
-    {
-        QTimer::singleShot(1000, this, SLOT(buildMenu()));
-    }
-    else
-    {
-        QMessageBox::warning(this, "Parse error", mXdgMenu.errorString());
-        return;
-    }
-
+    // The menu is built on the worker thread, see menuReady().
+    mXdgMenu.readAsync(mMenuFile);
 
     mShortcut->setShortcut(settings().value("shortcut", "ALT+F1").toString());
     mTopMenuStyle.setIconSize(settings().value("iconSize", 16).toInt());
@@ -182,11 +179,31 @@ void RazorMainMenu::settingsChanged()
 }
 
 
+/************************************************
+
+ ************************************************/
+void RazorMainMenu::menuReady(bool success)
+{
+    if (success)
+        buildMenu();
+    else
+        QMessageBox::warning(this, "Parse error", mXdgMenu.errorString());
+}
+
+
 /************************************************
 
  ************************************************/
 void RazorMainMenu::buildMenu()
 {
+    // The submenus are filled when they are shown, the unchanged ones are reused.
+    XdgMenuWidget *xdgMenu = qobject_cast<XdgMenuWidget*>(mMenu);
+    if (xdgMenu)
+    {
+        xdgMenu->reload(mXdgMenu);
+        return;
+    }
+
     XdgMenuWidget *menu = new XdgMenuWidget(mXdgMenu, "", this);
     menu->setObjectName("TopLevelMainMenu");
     menu->setStyle(&mTopMenuStyle);
@@ -204,6 +221,19 @@ void RazorMainMenu::buildMenu()
 }
 
 
+/************************************************
+ Only the changed submenus are filled again.
+ ************************************************/
+void RazorMainMenu::updateMenu(const XdgMenuDiff &diff)
+{
+    XdgMenuWidget *xdgMenu = qobject_cast<XdgMenuWidget*>(mMenu);
+    if (xdgMenu)
+        xdgMenu->reload(mXdgMenu, diff);
+    else
+        buildMenu();
+}
+
+
 /************************************************
 
  ************************************************/
@@ -72,6 +72,8 @@ protected slots:
     void buildMenu();
 
 private slots:
+    void menuReady(bool success);
+    void updateMenu(const XdgMenuDiff &diff);
     void showMenu();
     void showHideMenu();
 };
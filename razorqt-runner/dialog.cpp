@@ -34,6 +34,7 @@
 
 #include <razorqt/razorsettings.h>
 #include <qtxdg/xdgicon.h>
+#include <qtxdg/xdgpathindex.h>
 #include <razorqxt/qxtglobalshortcut.h>
 #include <razorqt/powermanager.h>
 #include <razorqt/screensaver.h>
@@ -206,12 +207,47 @@ bool Dialog::editKeyPressEvent(QKeyEvent *event)
 
         qApp->sendEvent(ui->commandList, event);
         return true;
+
+    case Qt::Key_Tab:
+        completeCommand();
+        return true;
     }
 
     return QDialog::eventFilter(ui->commandList, event);
 }
 
 
+/************************************************
+ Completes the program name from the $PATH to the
+ longest common prefix, like the shell does.
+ ************************************************/
+void Dialog::completeCommand()
+{
+    QString text = ui->commandEd->text();
+    if (text.isEmpty() || text.contains(' ') || text.contains('/'))
+        return;
+
+    QStringList names = XdgPathIndex::complete(text);
+    if (names.isEmpty())
+        return;
+
+    QString completion = names.first();
+    foreach (QString name, names)
+    {
+        int n = text.length();
+        while (n < completion.length() && n < name.length() && completion.at(n) == name.at(n))
+            ++n;
+        completion.truncate(n);
+    }
+
+    if (names.count() == 1)
+        completion += ' ';
+
+    if (completion != text)
+        ui->commandEd->setText(completion);
+}
+
+
 /************************************************
  eventFilter for ui->commandList
  ************************************************/
@@ -57,6 +57,7 @@ protected:
     void resizeEvent(QResizeEvent *event);
     bool eventFilter(QObject *object, QEvent *event);
     bool editKeyPressEvent(QKeyEvent *event);
+    void completeCommand();
     bool listKeyPressEvent(QKeyEvent *event);
 
 private:
@@ -32,12 +32,13 @@
 #include <qtxdg/xdgicon.h>
 #include <qtxdg/xdgdesktopfile.h>
 #include <qtxdg/xdgmenu.h>
-#include <qtxdg/xmlhelper.h>
 #include <qtxdg/xdgdirs.h>
+#include <qtxdg/xdgpathindex.h>
 
 #include <QtCore/QProcess>
 #include <QtCore/QtAlgorithms>
 #include <QtCore/QFileInfo>
+#include <QtCore/QSet>
 #include <QtCore/QSettings>
 #include <QtCore/QDir>
 #include <QtGui/QApplication>
@@ -125,16 +126,16 @@ CommandProvider::~CommandProvider()
 /************************************************
 
  ************************************************/
-AppLinkItem::AppLinkItem(const QDomElement &element):
+AppLinkItem::AppLinkItem(const XdgMenuNode &node):
         CommandProviderItem()
 {
-    mIconName = element.attribute("icon");
-    mTitle = element.attribute("title");
-    mComment = element.attribute("genericName");
-    mToolTip = element.attribute("comment");
-    mCommand = element.attribute("exec");
-    mProgram = QFileInfo(element.attribute("exec")).baseName().section(" ", 0, 0);
-    mDesktopFile = element.attribute("desktopFile");
+    mIconName = node.icon();
+    mTitle = node.title();
+    mComment = node.genericName();
+    mToolTip = node.comment();
+    mCommand = node.exec();
+    mProgram = QFileInfo(mCommand).baseName().section(" ", 0, 0);
+    mDesktopFile = node.desktopFile();
     QMetaObject::invokeMethod(this, "updateIcon", Qt::QueuedConnection);
 }
 
@@ -183,8 +184,7 @@ unsigned int AppLinkItem::rank(const QString &pattern) const
  ************************************************/
 bool AppLinkItem::run() const
 {
-    XdgDesktopFile *desktop = XdgDesktopFileCache::getFile(mDesktopFile);
-    return desktop->startDetached();
+    return XdgDesktopFileCache::snapshot(mDesktopFile).startDetached();
 }
 
 
@@ -213,10 +213,10 @@ AppLinkProvider::AppLinkProvider():
         CommandProvider(),
         mXdgMenu( new XdgMenu())
 {
-    mXdgMenu->setEnvironments("X-RAZOR");
-    connect(mXdgMenu, SIGNAL(changed()), this, SLOT(update()));
-    mXdgMenu->read(XdgMenu::getMenuFileName());
-    update();
+    mXdgMenu->setEnvironments(QStringList() << "X-RAZOR" << "Razor");
+    connect(mXdgMenu, SIGNAL(ready(bool)), this, SLOT(update()));
+    connect(mXdgMenu, SIGNAL(menuChanged(XdgMenuDiff)), this, SLOT(update(XdgMenuDiff)));
+    mXdgMenu->readAsync(XdgMenu::getMenuFileName());
 }
 
 
@@ -230,64 +230,118 @@ AppLinkProvider::~AppLinkProvider()
 
 
 /************************************************
-
+ Collects the application links of the menu by the
+ desktop file ids. If ids isn't empty, only these
+ links are collected.
  ************************************************/
-void doUpdate(const QDomElement &xml, QHash<QString, AppLinkItem*> &items)
+static void collectAppLinks(const XdgMenuNode &menu, const QSet<QString> &ids, QHash<QString, XdgMenuNode> &links)
 {
-    DomElementIterator it(xml, "");
-    while (it.hasNext())
+    for (int i=0; i<menu.childCount(); ++i)
     {
-        QDomElement e = it.next();
+        XdgMenuNode node = menu.child(i);
 
-        // Build submenu ........................
-        if (e.tagName() == "Menu")
-            doUpdate(e, items);
+        // Submenu ..............................
+        if (node.type() == XdgMenuNode::MenuType)
+            collectAppLinks(node, ids, links);
 
-        //Build application link ................
-        else if (e.tagName() == "AppLink")
+        // Application link .....................
+        else if (node.type() == XdgMenuNode::AppLinkType)
         {
-            AppLinkItem *item = new AppLinkItem(e);
-            delete items[item->command()]; // delete previous item;
-            items.insert(item->command(), item);
+            QString id = node.attribute("id");
+            if ((ids.isEmpty() || ids.contains(id)) && !links.contains(id))
+                links.insert(id, node);
         }
     }
 }
 
 
 /************************************************
+ The item of the application link is created, updated
+ or removed, as the link is in the menu.
+ ************************************************/
+void AppLinkProvider::updateItem(const QString &id, const XdgMenuNode &node)
+{
+    AppLinkItem *item = mItems.value(id);
+
+    if (node.isNull())
+    {
+        if (item)
+        {
+            mItems.remove(id);
+            removeAll(item);
+            delete item;
+        }
+        return;
+    }
+
+    AppLinkItem *newItem = new AppLinkItem(node);
+    if (item)
+    {
+        *(item) = *newItem;  // Copy by value, not pointer!
+        delete newItem;
+    }
+    else
+    {
+        mItems.insert(id, newItem);
+        append(newItem);
+    }
+}
+
 
+/************************************************
+ Rebuilds all the items, the menu was read.
  ************************************************/
 void AppLinkProvider::update()
 {
     emit aboutToBeChanged();
-    QHash<QString, AppLinkItem*> newItems;
-    doUpdate(mXdgMenu->xml().documentElement(), newItems);
+
+    QHash<QString, XdgMenuNode> links;
+    collectAppLinks(mXdgMenu->rootNode(), QSet<QString>(), links);
+
+    foreach (QString id, mItems.keys())
     {
-        QMutableListIterator<CommandProviderItem*> i(*this);
-        while (i.hasNext()) {
-            AppLinkItem *item = static_cast<AppLinkItem*>(i.next());
-            AppLinkItem *newItem = newItems.take(item->command());
-            if (newItem)
-            {
-                *(item) = *newItem;  // Copy by value, not pointer!
-                delete newItem;
-            }
-            else
-            {
-                i.remove();
-                delete item;
-            }
-        }
+        if (!links.contains(id))
+            updateItem(id, XdgMenuNode());
     }
 
+    QHashIterator<QString, XdgMenuNode> i(links);
+    while (i.hasNext())
     {
-        QHashIterator<QString, AppLinkItem*> i(newItems);
-        while (i.hasNext())
-        {
-            append(i.next().value());
-        }
+        i.next();
+        updateItem(i.key(), i.value());
+    }
+
+    emit changed();
+}
+
+
+/************************************************
+ Only the items of the added, removed or modified
+ applications are updated. An application can be in
+ several menus, so the link is looked up in the
+ whole menu before the item is removed.
+ ************************************************/
+void AppLinkProvider::update(const XdgMenuDiff &diff)
+{
+    QSet<QString> ids;
+    foreach (const XdgMenuChanges &changes, diff)
+    {
+        ids += changes.added.toSet();
+        ids += changes.removed.toSet();
+        ids += changes.modified.toSet();
     }
 
+    if (ids.isEmpty())
+        return;
+
+    emit aboutToBeChanged();
+
+    QHash<QString, XdgMenuNode> links;
+    collectAppLinks(mXdgMenu->rootNode(), ids, links);
+
+    foreach (QString id, ids)
+        updateItem(id, links.value(id));
+
     emit changed();
 }
 
@@ -405,24 +459,7 @@ CustomCommandItem::CustomCommandItem(CustomCommandProvider *provider):
  ************************************************/
 QString which(const QString &progName)
 {
-    if (progName.isEmpty())
-        return "";
-
-    if (progName.startsWith(QDir::separator()))
-    {
-        if (QFileInfo(progName).isExecutable())
-            QFileInfo(progName).absoluteFilePath();
-    }
-
-    QStringList dirs = QString(getenv("PATH")).split(":");
-
-    foreach (QString dir, dirs)
-    {
-        if (QFileInfo(QDir(dir), progName).isExecutable())
-            return QFileInfo(QDir(dir), progName).absoluteFilePath();
-    }
-
-    return "";
+    return XdgPathIndex::which(progName);
 }
 
 
@@ -31,8 +31,10 @@
 #define PROVIDERS_H
 
 #include <QtCore/QList>
+#include <QtCore/QHash>
 #include <QtCore/QRegExp>
 #include <QtXml/QDomElement>
+#include <qtxdg/xdgmenunode.h>
 #include <QtCore/QString>
 #include <QtGui/QIcon>
 
@@ -108,7 +110,7 @@ class AppLinkItem: public CommandProviderItem
 {
     Q_OBJECT
 public:
-    AppLinkItem(const QDomElement &element);
+    AppLinkItem(const XdgMenuNode &node);
 
     bool run() const;
     bool compare(const QRegExp &regExp) const;
@@ -137,9 +139,13 @@ public:
 
 private slots:
     void update();
+    void update(const XdgMenuDiff &diff);
 
 private:
+    void updateItem(const QString &id, const XdgMenuNode &node);
+
     XdgMenu *mXdgMenu;
+    QHash<QString, AppLinkItem*> mItems; // The items by the desktop file ids.
 };
 
 
@@ -34,6 +34,8 @@
 #include <QtGui/QTextDocument>
 #include <QtGui/QPainter>
 #include <QtGui/QAbstractTextDocumentLayout>
+#include <QtGui/QAbstractItemView>
+#include <qtxdg/xdgicon.h>
 
 
 
@@ -120,7 +122,11 @@ void HtmlDelegate::paint(QPainter* painter, const QStyleOptionViewItem& option,
     painter->translate(options.rect.left(), options.rect.top());
     QRect iconRect = QRect(4, 4, iconSize.width(), iconSize.height());
 
-    icon.paint(painter, iconRect);
+    {
+        const QAbstractItemView* view = qobject_cast<const QAbstractItemView*>(options.widget);
+        XdgIconAsyncPaint async(view ? view->viewport() : 0);
+        icon.paint(painter, iconRect);
+    }
 
     doc.setTextWidth(options.rect.width() - mIconSize.width() - 10);
 